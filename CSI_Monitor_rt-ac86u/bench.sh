@@ -0,0 +1,19 @@
+#!/bin/bash
+# Build and run the CSI kernel microbenchmarks.
+#   ./bench.sh            build for this host and run
+#   ./bench.sh aarch64    build a static aarch64 binary (run it on the router)
+# Extra arguments after the target are passed to csi_bench (see -h).
+
+TARGET=${1:-host}
+shift
+TAG=$(git rev-parse --short HEAD 2>/dev/null || echo none)
+WRAP="-DCSI_BENCH_WRAP_ALLOC -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc"
+
+if [ "$TARGET" = "aarch64" ]; then
+    aarch64-linux-gnu-gcc src/csi_bench.c src/csi_kernels.c src/csi_decoders.c src/csi_mimo.c src/csi_window.c -o csi_bench_aarch64 -lm -O3 --static $WRAP || exit 1
+    echo "Built csi_bench_aarch64; run on the router with: ./csi_bench_aarch64 -t $TAG -f 1800"
+    exit 0
+fi
+
+gcc src/csi_bench.c src/csi_kernels.c src/csi_decoders.c src/csi_mimo.c src/csi_window.c -o csi_bench -lm -O3 $WRAP || exit 1
+./csi_bench -t "$TAG" "$@"
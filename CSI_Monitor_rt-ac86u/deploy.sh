@@ -6,7 +6,7 @@ ROUTER_IP="192.168.2.2"
 
 # Compile (produces ARM executable)
 rm csi_analyzer
-aarch64-linux-gnu-gcc src/csi_analyzer.c -o csi_analyzer -lm -O3 --static
+aarch64-linux-gnu-gcc src/csi_analyzer.c src/csi_kernels.c src/csi_decoders.c src/csi_mimo.c src/csi_window.c src/queue_sampler.c -o csi_analyzer -lm -O3 --static
 sshpass -p ${pw} ssh "${user}@${ROUTER_IP}" "rm /jffs/csi_analyzer"
 sshpass -p ${pw} scp csi_analyzer ${user}@${ROUTER_IP}:/jffs/
 echo "copying done"
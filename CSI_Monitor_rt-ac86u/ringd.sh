@@ -0,0 +1,10 @@
+#!/bin/bash
+# Build and run csi_ringd on the monitoring host (see src/csi_ring.h).
+#   ./ringd.sh [options]   options are passed to csi_ringd (see -h)
+# The Python monitors read the ring with live_monitoring/csi_ring.py.
+# Also builds libcsi_rec.so, the session recorder (src/csi_rec.h) that
+# live_monitoring/csi_record.py loads; -r records from csi_ringd itself.
+
+gcc -shared -fPIC src/csi_rec.c -o libcsi_rec.so -O2 -Wall || exit 1
+gcc src/csi_ringd.c src/csi_ring.c src/csi_rec.c -o csi_ringd -O2 -Wall -lrt || exit 1
+./csi_ringd "$@"
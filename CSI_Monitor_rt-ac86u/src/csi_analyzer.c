@@ -13,11 +13,17 @@
 #include <math.h>
 #include <complex.h>
 #include <errno.h>
+#include <poll.h>
+#include <sys/timerfd.h>
+
+#include "csi_kernels.h"
+#include "csi_decoders.h"
+#include "csi_mimo.h"
+#include "csi_window.h"
+#include "queue_sampler.h"
 
 #define PORT 5500
 #define BUF_SIZE 65535
-#define NFFT 64
-#define k_tof_unpack_sgn_mask (1<<31)
 
 // Control message configuration
 #define CONTROL_IP "192.168.1.1"
@@ -27,198 +33,6 @@
 #define DATA_IP "192.168.1.2"
 #define DATA_PORT 12346
 
-//#define K_TOF_UNPACK_SGN_MASK (1 << 31)  // same as 1<<11 for 12-bit numbers
-
-#include <stdio.h>
-#include <stdint.h>
-#include <math.h>
-
-#define K_TOF_UNPACK_SGN_MASK (1u<<31)
-
-void unpack_float_double(int nfft, uint32_t *H, double *Hout_re, double *Hout_im) {
-    int nman = 12;
-    int nexp = 6;
-    int e_p = (1 << (nexp - 1));
-    int nbits = 10;
-    int autoscale = 1;
-
-    int8_t He[256];
-    int maxbit = -e_p;
-    int e_zero = -nman;
-
-    //printf("Subc | Hraw(hex)  | vi | vq | e(orig) | e_shifted | RE | IM\n");
-    //printf("------------------------------------------------------------\n");
-
-    /* masks & sign-bit detection same as mex */
-    uint32_t iq_mask = (1u << (nman - 1)) - 1u;     // 11-bit mask (0x7FF)
-    uint32_t e_mask  = (1u << nexp) - 1u;           // exponent mask
-    uint32_t sgnr_mask = (1u << (nexp + 2 * nman - 1)); // bit that indicates sign of real in packed word
-    uint32_t sgni_mask = (sgnr_mask >> nman);           // sign bit for imag
-
-    /* First pass: extract vi/vq (unsigned 11 bits), exponent, compute He & maxbit (autoscale) */
-    for (int i = 0; i < nfft; ++i) {
-        uint32_t Hval = H[i];
-
-        /* Extract 11-bit mantissas in the same bit positions as the .mex code */
-        int32_t vi = (int32_t)((Hval >> (nexp + nman)) & iq_mask);  // real mantissa raw (0..0x7FF)
-        int32_t vq = (int32_t)((Hval >> nexp) & iq_mask);          // imag mantissa raw (0..0x7FF)
-
-        /* exponent in low bits (signed two's complement if >= e_p) */
-        int e = (int)(Hval & e_mask);
-        if (e >= e_p) e -= (e_p << 1);
-        He[i] = (int8_t)e;
-
-        /* autoscale: use absolute magnitude of mantissas (but mantissas still unsigned here) */
-        if (autoscale) {
-            uint32_t x = (uint32_t)vi | (uint32_t)vq; // still unsigned fields
-            if (x) {
-                uint32_t m = 0xffff0000u;
-                uint32_t b = 0xffffu;
-                int s = 16;
-                int tmp_e = e;
-                while (s > 0) {
-                    if (x & m) {
-                        tmp_e += s;
-                        x >>= s;
-                    }
-                    s >>= 1;
-                    m = (m >> s) & b;
-                    b >>= s;
-                }
-                if (tmp_e > maxbit) maxbit = tmp_e;
-            }
-        }
-    }
-
-    int shft = nbits - maxbit;
-
-    /* Second pass: perform sign marking, sign extraction and shifting identical to .mex */
-    for (int i = 0; i < nfft; ++i) {
-        uint32_t Hval = H[i];
-        int e_scaled = He[i] + shft;
-
-        /* re/im raw (unsigned 11-bit) */
-        int32_t re = (int32_t)((Hval >> (nexp + nman)) & iq_mask);
-        int32_t im = (int32_t)((Hval >> nexp) & iq_mask);
-
-        /* mark sign bits in same way as mex: set high-bit sentinel if packed sign bit present */
-        if (Hval & sgnr_mask) re |= (int32_t)K_TOF_UNPACK_SGN_MASK;
-        if (Hval & sgni_mask) im |= (int32_t)K_TOF_UNPACK_SGN_MASK;
-
-        /* now perform sign extraction & shifting exactly like mex's second loop */
-        int sgn = 1;
-        if (re & (int32_t)K_TOF_UNPACK_SGN_MASK) {
-            sgn = -1;
-            re &= ~(int32_t)K_TOF_UNPACK_SGN_MASK;
-        }
-        if (e_scaled < e_zero) {
-            re = 0;
-        } else if (e_scaled < 0) {
-            re = (re >> (-e_scaled));
-        } else {
-            re = (re << e_scaled);
-        }
-        re = sgn * re;
-
-        sgn = 1;
-        if (im & (int32_t)K_TOF_UNPACK_SGN_MASK) {
-            sgn = -1;
-            im &= ~(int32_t)K_TOF_UNPACK_SGN_MASK;
-        }
-        if (e_scaled < e_zero) {
-            im = 0;
-        } else if (e_scaled < 0) {
-            im = (im >> (-e_scaled));
-        } else {
-            im = (im << e_scaled);
-        }
-        im = sgn * im;
-
-        Hout_re[i] = (double)re;
-        Hout_im[i] = (double)im;
-
-        //printf("[%2d] 0x%08X  %10d  %10d  %3d      %3d  %12.6f  %12.6f\n",
-        //       i, Hval, re, im, He[i], e_scaled, Hout_re[i], Hout_im[i]);
-    }
-}
-
-
-// --- Fixed unpack function (same as before) ---
-void unpack_float_4366c0(int nfft, uint32_t *H, int32_t *Hout) {
-    int nbits = 10;
-    int autoscale = 1;
-    int nman = 12;
-    int nexp = 6;
-    int e_p = (1 << (nexp - 1));
-    int maxbit = -e_p;
-
-
-    int e_zero = -nman;
-    int n_out = (nfft << 1);
-    int e_shift = 1;
-    int8_t He[256];
-    uint32_t iq_mask = (1 << (nman - 1)) - 1;
-    uint32_t e_mask = (1 << nexp) - 1;
-    uint32_t sgnr_mask = (1 << (nexp + 2*nman - 1));
-    uint32_t sgni_mask = (sgnr_mask >> nman);
-    int32_t *pOut = Hout;
-
-    
-     printf("Subc | Hraw(hex)  | vi        | vq        | e(before) | e_scaled | RE           | IM\n");
-    printf("----------------------------------------------------------------------------------------\n");
-
-    
-    for (int i = 0; i < nfft; i++) {
-        int32_t vi = (int32_t)((H[i] >> (nexp + nman)) & iq_mask);
-        int32_t vq = (int32_t)((H[i] >> nexp) & iq_mask);
-        int e = (int)(H[i] & e_mask);
-        if (e >= e_p)
-            e -= (e_p << 1);
-        He[i] = (int8_t)e;
-        uint32_t x = (uint32_t)vi | (uint32_t)vq;
-        if (autoscale && x) {
-            uint32_t m = 0xffff0000, b = 0xffff;
-            int s = 16;
-            while (s > 0) {
-                if (x & m) {
-                    e += s;
-                    x >>= s;
-                }
-                s >>= 1;
-                m = (m >> s) & b;
-                b >>= s;
-            }
-            if (e > maxbit)
-                maxbit = e;
-        }
-        if (H[i] & sgnr_mask)
-            vi |= k_tof_unpack_sgn_mask;
-        if (H[i] & sgni_mask)
-            vq |= k_tof_unpack_sgn_mask;
-        Hout[i << 1] = vi;
-        Hout[(i << 1) + 1] = vq;
-    }
-    int shft = nbits - maxbit;
-    for (int i = 0; i < n_out; i++) {
-        int e = He[(i >> e_shift)] + shft;
-        int32_t vi = *pOut;
-        int sgn = 1;
-        if (vi & k_tof_unpack_sgn_mask) {
-            sgn = -1;
-            vi &= ~k_tof_unpack_sgn_mask;
-        }
-        if (e < e_zero) {
-            vi = 0;
-        } else if (e < 0) {
-            e = -e;
-            vi = (vi >> (-e));
-        } else {
-            vi = (vi << e);
-        }
-        *pOut++ = (int32_t)(sgn * vi);
-    }
-}
-
 // --- CSI header struct ---
 typedef struct __attribute__((__packed__)) {
     uint32_t magic;
@@ -229,7 +43,80 @@ typedef struct __attribute__((__packed__)) {
     uint16_t chipver;
 } csi_header_t;
 
-int main() {
+void print_usage(const char *program_name) {
+    printf("Usage: %s [options]\n", program_name);
+    printf("Options:\n");
+    printf("  -c chip        Force decoder: 4366c0, 4358, 43455c0, 4339 (default: from chipver)\n");
+    printf("  -w frames      Sliding variance window per core (0=off, max %d, default: 10)\n", CSI_WIN_MAX);
+    printf("  -q hz          Sample queue backlog / SNR at this rate (0=off, max %d, default: 0)\n", QUEUE_SAMPLER_MAX_HZ);
+    printf("  -i ifname      Wi-Fi interface for queue / SNR samples (default: eth6)\n");
+    printf("  -s streams     Enable MIMO metrics for frames with this many spatial streams (1-4)\n");
+    printf("  -a cores       RX cores per MIMO frame (1-4, default: 4)\n");
+    printf("  -u dB          Eigenvalue range counted as usable streams (default: 20)\n");
+    printf("  -h             Show this help\n");
+}
+
+int main(int argc, char **argv) {
+    int mimo_streams = 0;
+    int mimo_cores = MIMO_MAX_CORES;
+    float mimo_usable_db = 20.0f;
+    const csi_decoder_t *forced_dec = NULL;
+    int window_len = 10;
+    int queue_hz = 0;
+    const char *queue_if = "eth6";
+    int opt;
+
+    while ((opt = getopt(argc, argv, "c:w:q:i:s:a:u:h")) != -1) {
+        switch (opt) {
+            case 'c':
+                forced_dec = csi_find_decoder_name(optarg);
+                if (!forced_dec) {
+                    fprintf(stderr, "Error: Unknown chip '%s'\n", optarg);
+                    return 1;
+                }
+                break;
+            case 'w':
+                window_len = atoi(optarg);
+                if (window_len < 0 || window_len > CSI_WIN_MAX) {
+                    fprintf(stderr, "Error: Window must be 0-%d frames\n", CSI_WIN_MAX);
+                    return 1;
+                }
+                break;
+            case 'q':
+                queue_hz = atoi(optarg);
+                if (queue_hz < 0 || queue_hz > QUEUE_SAMPLER_MAX_HZ) {
+                    fprintf(stderr, "Error: Queue sample rate must be 0-%d Hz\n", QUEUE_SAMPLER_MAX_HZ);
+                    return 1;
+                }
+                break;
+            case 'i':
+                queue_if = optarg;
+                break;
+            case 's':
+                mimo_streams = atoi(optarg);
+                if (mimo_streams < 1 || mimo_streams > MIMO_MAX_STREAMS) {
+                    fprintf(stderr, "Error: Streams must be 1-%d\n", MIMO_MAX_STREAMS);
+                    return 1;
+                }
+                break;
+            case 'a':
+                mimo_cores = atoi(optarg);
+                if (mimo_cores < 1 || mimo_cores > MIMO_MAX_CORES) {
+                    fprintf(stderr, "Error: Cores must be 1-%d\n", MIMO_MAX_CORES);
+                    return 1;
+                }
+                break;
+            case 'u':
+                mimo_usable_db = atof(optarg);
+                break;
+            case 'h':
+                print_usage(argv[0]);
+                return 0;
+            default:
+                print_usage(argv[0]);
+                return 1;
+        }
+    }
 
     //Testing dummy csi:
     /*
@@ -305,44 +192,120 @@ int main() {
     printf("Listening for Nexmon CSI packets on UDP port %d...\n", PORT);
     printf("Sending CSI (64 carriers) to %s:%d via TCP\n", DATA_IP, DATA_PORT);
 
+    // MIMO frame assembly (one sounding = all cores x streams with the same seq)
+    static mimo_asm_t mimo;
+    mimo_metrics_t mimo_out;
+    if (mimo_streams) {
+        mimo_init(&mimo, mimo_cores, mimo_streams, mimo_usable_db);
+        printf("MIMO metrics on %dx%d frames (usable streams within %.1f dB)\n",
+               mimo_cores, mimo_streams, mimo_usable_db);
+    }
+
+    // Per-core sliding variance of amplitude / residual phase (stream 0 reports)
+    static csi_window_t window;
+    csi_window_stats_t window_out;
+    if (window_len) {
+        csi_window_init(&window, window_len);
+        printf("Sliding variance over %d frames per core\n", window_len);
+    }
+
+    // Queue backlog / SNR samples, multiplexed into the same TCP stream
+    static queue_sampler_t qs;
+    int tfd = -1;
+    if (queue_hz) {
+        if (queue_sampler_open(&qs, queue_if) < 0) return 1;
+        tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+        if (tfd < 0) { perror("timerfd_create"); return 1; }
+        long period_ns = 1000000000L / queue_hz;
+        struct itimerspec its = {
+            .it_interval = { period_ns / 1000000000L, period_ns % 1000000000L },
+            .it_value    = { period_ns / 1000000000L, period_ns % 1000000000L },
+        };
+        if (timerfd_settime(tfd, 0, &its, NULL) < 0) { perror("timerfd_settime"); return 1; }
+        printf("Sampling queue / SNR on %s at %d Hz\n", queue_if, queue_hz);
+    }
+
+    const csi_decoder_t *dec = NULL;
+    uint16_t dec_chipver = 0;
+    struct pollfd pfd[2] = {
+        { .fd = sock, .events = POLLIN },
+        { .fd = tfd,  .events = POLLIN },
+    };
+
     while (1) {
+        if (poll(pfd, tfd >= 0 ? 2 : 1, -1) < 0) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            break;
+        }
+
+        if (tfd >= 0 && (pfd[1].revents & POLLIN)) {
+            uint64_t expirations;
+            queue_sample_t qsample;
+            if (read(tfd, &expirations, sizeof(expirations)) == sizeof(expirations) &&
+                queue_sampler_read(&qs, &qsample) == 0) {
+                char qmsg[128];
+                int qpos = queue_sample_format_csv(qmsg, sizeof(qmsg), &qsample);
+                send(data_sock, qmsg, qpos, 0);
+            }
+        }
+        if (!(pfd[0].revents & POLLIN)) continue;
+
         len = recvfrom(sock, buf, sizeof(buf), 0, (struct sockaddr*)&src, &srclen);
         if (len < (ssize_t)sizeof(csi_header_t)) continue;
         csi_header_t *h = (csi_header_t*)buf;
         if (ntohl(h->magic) != 0x11111111) continue;
+        uint64_t ts_us = csi_clock_us();
+
+        // RSSI follows the station whose CSI we are reporting
+        if (queue_hz && (!qs.have_mac || memcmp(qs.sta_mac, h->src_mac, 6) != 0))
+            queue_sampler_set_station(&qs, h->src_mac);
+
+        // Pick the decoder once per chipver change
+        uint16_t chipver = ntohs(h->chipver);
+        if (!dec || chipver != dec_chipver) {
+            dec_chipver = chipver;
+            dec = forced_dec ? forced_dec : csi_find_decoder(chipver);
+            if (!dec) {
+                dec = csi_find_decoder_name("4366c0");
+                fprintf(stderr, "Unknown chipver 0x%04X, decoding as %s\n", chipver, dec->name);
+            }
+        }
 
-        uint16_t seq = ntohs(h->seq);
-        int core = ntohs(h->core_stream) & 0x7;
-        int stream = (ntohs(h->core_stream) >> 3) & 0x7;
+        csi_record_t rec;
+        rec.seq = ntohs(h->seq);
+        rec.core = ntohs(h->core_stream) & 0x7;
+        rec.stream = (ntohs(h->core_stream) >> 3) & 0x7;
+        rec.chanspec = ntohs(h->chanspec);
+        rec.chipver = chipver;
+        rec.ts_us = ts_us;
 
         uint8_t *payload = buf + sizeof(csi_header_t);
         size_t payload_len = len - sizeof(csi_header_t);
-        if (payload_len < NFFT*4) continue;
-
-        uint32_t Hraw[NFFT];
-        memcpy(Hraw, payload, NFFT * sizeof(uint32_t));
-
-        int32_t Hout[NFFT*2];
-        unpack_float_4366c0(NFFT, Hraw, Hout);
-
-        // zero guard subcarriers
-        for (int i = 0; i <= 3; i++) { Hout[2*i]=0; Hout[2*i+1]=0; }
-        Hout[2*32]=0; Hout[2*32+1]=0;
-        for (int i = 62; i <= 63; i++){ Hout[2*i]=0; Hout[2*i+1]=0; }
+        if (csi_decode(dec, payload, payload_len, &rec) < 0) continue;
 
         // Build CSV message: seq,core,stream,re0,im0,re1,im1,...
         char msg[4096];
-        int pos = snprintf(msg, sizeof(msg), "%u,%d,%d", seq, core, stream);
-        for (int i=0; i<NFFT; i++){
-            double re = (double)Hout[2*i];
-            double im = (double)Hout[2*i+1];
-            pos += snprintf(msg+pos, sizeof(msg)-pos, ",%.8f,%.8f", re, im);
-            if (pos >= (int)sizeof(msg)-32) break;
-        }
-        msg[pos++] = '\n';
+        int pos = csi_format_csv(msg, sizeof(msg), rec.seq, rec.core, rec.stream, NFFT, rec.H, rec.ts_us);
         send(data_sock, msg, pos, 0);  // TCP send
+
+        if (window_len && rec.stream == 0 &&
+            csi_window_add(&window, rec.seq, rec.core, rec.H, &window_out)) {
+            pos = csi_window_format_csv(msg, sizeof(msg), &window_out);
+            send(data_sock, msg, pos, 0);
+        }
+
+        // Spatial metrics once every core/stream of this seq has reported
+        if (mimo_streams && mimo_add(&mimo, rec.seq, rec.core, rec.stream, rec.H, &mimo_out)) {
+            pos = mimo_format_csv(msg, sizeof(msg), &mimo_out);
+            send(data_sock, msg, pos, 0);
+        }
     }
 
+    if (tfd >= 0) {
+        close(tfd);
+        queue_sampler_close(&qs);
+    }
     close(sock);
     close(data_sock);
     return 0;
@@ -0,0 +1,349 @@
+/* csi_bench.c
+   Microbenchmarks for the CSI hot path (unpack, guard zeroing, CSV build).
+   Runs each stage over a set of packed frames with warmup and repetitions,
+   prints ns/frame and cycles/subcarrier, and appends one CSV row per stage
+   to a results file so runs can be compared across commits.
+
+   Build with bench.sh; it links with -Wl,--wrap=malloc,... and defines
+   CSI_BENCH_WRAP_ALLOC so heap allocations inside a stage are counted.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "csi_kernels.h"
+#include "csi_decoders.h"
+#include "csi_mimo.h"
+#include "csi_window.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_ARCH "x86"
+#elif defined(__aarch64__)
+#define BENCH_ARCH "aarch64"
+#else
+#define BENCH_ARCH "other"
+#endif
+
+#define N_INPUT_FRAMES 256
+#define MSG_SIZE 4096
+
+// --- allocation counters ---
+static unsigned long alloc_count;
+static unsigned long alloc_bytes;
+
+#ifdef CSI_BENCH_WRAP_ALLOC
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+
+void *__wrap_malloc(size_t size) {
+    alloc_count++;
+    alloc_bytes += size;
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size) {
+    alloc_count++;
+    alloc_bytes += nmemb * size;
+    return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size) {
+    alloc_count++;
+    alloc_bytes += size;
+    return __real_realloc(ptr, size);
+}
+#endif
+
+// --- clocks ---
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// Cycle source: TSC on x86; elsewhere there is no user-readable cycle
+// counter by default, so cycles are derived from ns and -f MHz.
+static uint64_t now_cycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+// --- inputs ---
+
+// Captured 4366c0 frame (same vector as the test dummy in csi_analyzer)
+static const uint32_t H_capture[NFFT] = {
+    960268017,295920246,222781046,155145782,82261942,33758582,555686966,
+    596316022,742915893,828096053,864259381,943412661,969347573,
+    1022281973,1051357877,1014630005,1004288757,968921141,917029941,
+    866976309,807485749,712333685,614563253,555063093,108357941,
+    252017269,439692981,312487222,331509430,716933040,282379248,
+    639837681,1024565424,960511345,179906032,205589872,323197558,
+    56608758,698580662,797639542,832739190,859189046,863249654,
+    834956150,1053911477,966642677,681380854,642848502,564469622,
+    29173558,77407414,131663798,333572981,409576181,465395189,
+    513609653,275017014,286539830,296492598,289543542,326774390,
+    366893430,380022838,383708278
+};
+
+static uint32_t rng_state = 0x12345678u;
+
+static uint32_t xorshift32(void) {
+    uint32_t x = rng_state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return rng_state = x;
+}
+
+// Derive frames from the capture: jitter mantissas by a few LSBs and move
+// the exponent by +-1, keeping the packing (sign|man|sign|man|exp) valid.
+static void make_inputs(uint32_t frames[N_INPUT_FRAMES][NFFT]) {
+    const int nman = 12, nexp = 6;
+    const uint32_t iq_mask = (1u << (nman - 1)) - 1u;
+    const uint32_t e_mask = (1u << nexp) - 1u;
+
+    memcpy(frames[0], H_capture, sizeof(H_capture));
+    for (int f = 1; f < N_INPUT_FRAMES; f++) {
+        int de = (int)(xorshift32() % 3) - 1;
+        for (int i = 0; i < NFFT; i++) {
+            uint32_t h = H_capture[i];
+            uint32_t vi = (h >> (nexp + nman)) & iq_mask;
+            uint32_t vq = (h >> nexp) & iq_mask;
+            uint32_t e = h & e_mask;
+            vi = (vi + (xorshift32() & 0xF)) & iq_mask;
+            vq = (vq + (xorshift32() & 0xF)) & iq_mask;
+            e = (e + (uint32_t)de) & e_mask;
+            h &= ~((iq_mask << (nexp + nman)) | (iq_mask << nexp) | e_mask);
+            frames[f][i] = h | (vi << (nexp + nman)) | (vq << nexp) | e;
+        }
+    }
+}
+
+// --- stages ---
+static uint32_t inputs[N_INPUT_FRAMES][NFFT];
+static int32_t unpacked[N_INPUT_FRAMES][NFFT * 2];
+static volatile uint64_t sink;
+
+typedef void (*stage_fn)(int frame);
+
+static void stage_unpack_4366c0(int f) {
+    int32_t Hout[NFFT * 2];
+    unpack_float_4366c0(NFFT, inputs[f], Hout);
+    sink += (uint32_t)Hout[f & (NFFT * 2 - 1)];
+}
+
+static void stage_unpack_double(int f) {
+    double re[NFFT], im[NFFT];
+    unpack_float_double(NFFT, inputs[f], re, im);
+    sink += (uint64_t)re[f & (NFFT - 1)] + (uint64_t)im[f & (NFFT - 1)];
+}
+
+static void stage_zero_guards(int f) {
+    int32_t Hout[NFFT * 2];
+    memcpy(Hout, unpacked[f], sizeof(Hout));
+    csi_zero_guards(Hout);
+    sink += (uint32_t)Hout[2 * 5];
+}
+
+static void stage_format_csv(int f) {
+    char msg[MSG_SIZE];
+    int pos = csi_format_csv(msg, sizeof(msg), (uint16_t)f, f & 3, 0, NFFT, unpacked[f], 1234567890ull);
+    sink += (uint64_t)pos + (uint8_t)msg[pos / 2];
+}
+
+// registry decode (function pointer + guards) for the other chip formats
+static void stage_decode_4358(int f) {
+    csi_record_t rec;
+    csi_decode(csi_find_decoder(0x4358), (const uint8_t *)inputs[f], sizeof(inputs[f]), &rec);
+    sink += (uint32_t)rec.H[10];
+}
+
+static void stage_decode_int16(int f) {
+    csi_record_t rec;
+    csi_decode(csi_find_decoder(0x4345), (const uint8_t *)inputs[f], sizeof(inputs[f]), &rec);
+    sink += (uint32_t)rec.H[10];
+}
+
+// unpack + guards + CSV, as in the csi_analyzer receive loop
+static void stage_pipeline(int f) {
+    uint32_t Hraw[NFFT];
+    int32_t Hout[NFFT * 2];
+    char msg[MSG_SIZE];
+    memcpy(Hraw, inputs[f], sizeof(Hraw));
+    unpack_float_4366c0(NFFT, Hraw, Hout);
+    csi_zero_guards(Hout);
+    int pos = csi_format_csv(msg, sizeof(msg), (uint16_t)f, f & 3, 0, NFFT, Hout, csi_clock_us());
+    sink += (uint64_t)pos;
+}
+
+// 4x4 assembly + spatial metrics; one frame = 16 core/stream reports
+static mimo_asm_t mimo;
+static void stage_mimo_4x4(int f) {
+    mimo_metrics_t m;
+    for (int c = 0; c < 4; c++)
+        for (int s = 0; s < 4; s++)
+            mimo_add(&mimo, (uint16_t)f, c, s, unpacked[(f + c * 4 + s) % N_INPUT_FRAMES], &m);
+    sink += (uint64_t)m.usable_min;
+}
+
+// sliding variance update (window 10) for one core report
+static csi_window_t window;
+static void stage_window_add(int f) {
+    csi_window_stats_t ws;
+    sink += (uint64_t)csi_window_add(&window, (uint16_t)f, f & 3, unpacked[f], &ws);
+}
+
+static const struct {
+    const char *name;
+    stage_fn fn;
+} stages[] = {
+    { "unpack_4366c0", stage_unpack_4366c0 },
+    { "unpack_double", stage_unpack_double },
+    { "decode_4358",   stage_decode_4358 },
+    { "decode_int16",  stage_decode_int16 },
+    { "zero_guards",   stage_zero_guards },
+    { "format_csv",    stage_format_csv },
+    { "pipeline",      stage_pipeline },
+    { "mimo_4x4",      stage_mimo_4x4 },
+    { "window_add",    stage_window_add },
+};
+#define N_STAGES (int)(sizeof(stages) / sizeof(stages[0]))
+
+struct stage_result {
+    double ns_per_frame_med;
+    double ns_per_frame_min;
+    double cycles_per_subc;
+    double allocs_per_frame;
+    double alloc_bytes_per_frame;
+};
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+static void run_stage(stage_fn fn, int frames, int warmup, int reps, double mhz,
+                      double *rep_ns, struct stage_result *r) {
+    for (int w = 0; w < warmup; w++)
+        for (int i = 0; i < frames; i++)
+            fn(i % N_INPUT_FRAMES);
+
+    unsigned long a0 = alloc_count, b0 = alloc_bytes;
+    uint64_t cyc_total = 0;
+    for (int k = 0; k < reps; k++) {
+        uint64_t c0 = now_cycles();
+        uint64_t t0 = now_ns();
+        for (int i = 0; i < frames; i++)
+            fn(i % N_INPUT_FRAMES);
+        uint64_t t1 = now_ns();
+        cyc_total += now_cycles() - c0;
+        rep_ns[k] = (double)(t1 - t0) / frames;
+    }
+    unsigned long total_frames = (unsigned long)frames * reps;
+    r->allocs_per_frame = (double)(alloc_count - a0) / total_frames;
+    r->alloc_bytes_per_frame = (double)(alloc_bytes - b0) / total_frames;
+
+    qsort(rep_ns, reps, sizeof(double), cmp_double);
+    r->ns_per_frame_med = rep_ns[reps / 2];
+    r->ns_per_frame_min = rep_ns[0];
+
+    if (cyc_total)
+        r->cycles_per_subc = (double)cyc_total / total_frames / NFFT;
+    else if (mhz > 0)
+        r->cycles_per_subc = r->ns_per_frame_med * mhz / 1000.0 / NFFT;
+    else
+        r->cycles_per_subc = -1;
+}
+
+static void print_usage(const char *program_name) {
+    printf("Usage: %s [options]\n", program_name);
+    printf("Options:\n");
+    printf("  -n frames      Frames per repetition (default: 20000)\n");
+    printf("  -r reps        Timed repetitions per stage (default: 15)\n");
+    printf("  -w warmup      Warmup passes per stage (default: 2)\n");
+    printf("  -f MHz         CPU clock for cycles/subcarrier without a cycle counter\n");
+    printf("  -o file        Append CSV results to file (default: csi_bench_results.csv)\n");
+    printf("  -t tag         Label stored with each row, e.g. a commit id (default: none)\n");
+    printf("  -h             Show this help\n");
+}
+
+int main(int argc, char **argv) {
+    int frames = 20000, reps = 15, warmup = 2;
+    double mhz = 0;
+    const char *out_path = "csi_bench_results.csv";
+    const char *tag = "none";
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:r:w:f:o:t:h")) != -1) {
+        switch (opt) {
+            case 'n': frames = atoi(optarg); break;
+            case 'r': reps = atoi(optarg); break;
+            case 'w': warmup = atoi(optarg); break;
+            case 'f': mhz = atof(optarg); break;
+            case 'o': out_path = optarg; break;
+            case 't': tag = optarg; break;
+            case 'h':
+                print_usage(argv[0]);
+                return 0;
+            default:
+                print_usage(argv[0]);
+                return 1;
+        }
+    }
+    if (frames <= 0 || reps <= 0 || warmup < 0) {
+        fprintf(stderr, "Error: frames and reps must be > 0, warmup >= 0\n");
+        return 1;
+    }
+
+    make_inputs(inputs);
+    for (int f = 0; f < N_INPUT_FRAMES; f++) {
+        unpack_float_4366c0(NFFT, inputs[f], unpacked[f]);
+        csi_zero_guards(unpacked[f]);
+    }
+    mimo_init(&mimo, 4, 4, 20.0f);
+    csi_window_init(&window, 10);
+
+    double *rep_ns = malloc(sizeof(double) * reps);
+    if (!rep_ns) { perror("malloc"); return 1; }
+
+    FILE *out = fopen(out_path, "a");
+    if (!out) { perror(out_path); free(rep_ns); return 1; }
+    if (ftell(out) == 0)
+        fprintf(out, "tag,arch,stage,frames,reps,ns_per_frame_med,ns_per_frame_min,"
+                     "cycles_per_subc,allocs_per_frame,alloc_bytes_per_frame\n");
+
+    printf("CSI kernel benchmark (%s, NFFT %d, %d frames x %d reps, tag %s)\n",
+           BENCH_ARCH, NFFT, frames, reps, tag);
+#ifndef CSI_BENCH_WRAP_ALLOC
+    printf("(allocation counting disabled: build with bench.sh)\n");
+#endif
+    printf("%-14s | %12s | %12s | %10s | %12s\n",
+           "stage", "ns/frame med", "ns/frame min", "cyc/subc", "allocs/frame");
+    printf("---------------------------------------------------------------------------\n");
+
+    for (int s = 0; s < N_STAGES; s++) {
+        struct stage_result r;
+        run_stage(stages[s].fn, frames, warmup, reps, mhz, rep_ns, &r);
+        printf("%-14s | %12.1f | %12.1f | %10.2f | %12.3f\n",
+               stages[s].name, r.ns_per_frame_med, r.ns_per_frame_min,
+               r.cycles_per_subc, r.allocs_per_frame);
+        fprintf(out, "%s,%s,%s,%d,%d,%.3f,%.3f,%.3f,%.4f,%.1f\n",
+                tag, BENCH_ARCH, stages[s].name, frames, reps,
+                r.ns_per_frame_med, r.ns_per_frame_min, r.cycles_per_subc,
+                r.allocs_per_frame, r.alloc_bytes_per_frame);
+    }
+
+    fclose(out);
+    free(rep_ns);
+    printf("\nResults appended to %s\n", out_path);
+    return 0;
+}
@@ -0,0 +1,53 @@
+/* csi_decoders.c
+   Chip-format decoder registry (see csi_decoders.h).
+*/
+
+#include <string.h>
+
+#include "csi_decoders.h"
+
+// Packed-float payloads are copied to an aligned word buffer first
+static void decode_4366c0(int nfft, const uint8_t *payload, int32_t *Hout) {
+    uint32_t Hraw[NFFT];
+    memcpy(Hraw, payload, nfft * sizeof(uint32_t));
+    unpack_float_4366c0(nfft, Hraw, Hout);
+}
+
+static void decode_4358(int nfft, const uint8_t *payload, int32_t *Hout) {
+    uint32_t Hraw[NFFT];
+    memcpy(Hraw, payload, nfft * sizeof(uint32_t));
+    unpack_float_4358(nfft, Hraw, Hout);
+}
+
+static const csi_decoder_t decoders[] = {
+    { 0x4366, "4366c0",  4, decode_4366c0 },
+    { 0x4358, "4358",    4, decode_4358 },
+    { 0x4345, "43455c0", 4, unpack_int16_iq },
+    { 0x4339, "4339",    4, unpack_int16_iq },
+};
+#define N_DECODERS (int)(sizeof(decoders) / sizeof(decoders[0]))
+
+const csi_decoder_t *csi_find_decoder(uint16_t chipver) {
+    // the header byte order differs between firmware builds
+    uint16_t swapped = (uint16_t)((chipver >> 8) | (chipver << 8));
+    for (int i = 0; i < N_DECODERS; i++)
+        if (decoders[i].chipver == chipver || decoders[i].chipver == swapped)
+            return &decoders[i];
+    return NULL;
+}
+
+const csi_decoder_t *csi_find_decoder_name(const char *name) {
+    for (int i = 0; i < N_DECODERS; i++)
+        if (strcmp(decoders[i].name, name) == 0)
+            return &decoders[i];
+    return NULL;
+}
+
+int csi_decode(const csi_decoder_t *dec, const uint8_t *payload, size_t payload_len,
+               csi_record_t *rec) {
+    if (payload_len < NFFT * dec->bytes_per_sc)
+        return -1;
+    dec->decode(NFFT, payload, rec->H);
+    csi_zero_guards(rec->H);
+    return 0;
+}
@@ -0,0 +1,43 @@
+/* csi_decoders.h
+   Chip-format decoder registry. The decoder is picked once per packet from
+   csi_header_t.chipver; every format produces the same csi_record_t.
+*/
+
+#ifndef CSI_DECODERS_H
+#define CSI_DECODERS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "csi_kernels.h"
+
+// Normalized CSI report, identical for every chip format
+typedef struct {
+    uint16_t seq;
+    uint8_t  core;
+    uint8_t  stream;
+    uint16_t chanspec;
+    uint16_t chipver;
+    uint64_t ts_us;             // receive time, csi_clock_us()
+    int32_t  H[NFFT * 2];       // interleaved re/im, guard subcarriers zeroed
+} csi_record_t;
+
+typedef struct {
+    uint16_t chipver;
+    const char *name;
+    size_t bytes_per_sc;        // payload bytes per subcarrier
+    void (*decode)(int nfft, const uint8_t *payload, int32_t *Hout);
+} csi_decoder_t;
+
+// Decoder for chipver (either byte order), or NULL if unknown
+const csi_decoder_t *csi_find_decoder(uint16_t chipver);
+
+// Decoder by name ("4366c0", "4358", "43455c0", "4339"), or NULL
+const csi_decoder_t *csi_find_decoder_name(const char *name);
+
+// Decode a payload into rec->H and zero the guards.
+// Returns 0, or -1 if the payload is too short for NFFT subcarriers.
+int csi_decode(const csi_decoder_t *dec, const uint8_t *payload, size_t payload_len,
+               csi_record_t *rec);
+
+#endif
@@ -0,0 +1,232 @@
+/* csi_kernels.c
+   Unpack and formatting kernels shared by csi_analyzer and csi_bench.
+*/
+
+#include <stdio.h>
+#include <stdint.h>
+#include <math.h>
+
+#include "csi_kernels.h"
+
+#define K_TOF_UNPACK_SGN_MASK (1u<<31)
+#define k_tof_unpack_sgn_mask (1<<31)
+
+void unpack_float_double(int nfft, uint32_t *H, double *Hout_re, double *Hout_im) {
+    int nman = 12;
+    int nexp = 6;
+    int e_p = (1 << (nexp - 1));
+    int nbits = 10;
+    int autoscale = 1;
+
+    int8_t He[256];
+    int maxbit = -e_p;
+    int e_zero = -nman;
+
+    //printf("Subc | Hraw(hex)  | vi | vq | e(orig) | e_shifted | RE | IM\n");
+    //printf("------------------------------------------------------------\n");
+
+    /* masks & sign-bit detection same as mex */
+    uint32_t iq_mask = (1u << (nman - 1)) - 1u;     // 11-bit mask (0x7FF)
+    uint32_t e_mask  = (1u << nexp) - 1u;           // exponent mask
+    uint32_t sgnr_mask = (1u << (nexp + 2 * nman - 1)); // bit that indicates sign of real in packed word
+    uint32_t sgni_mask = (sgnr_mask >> nman);           // sign bit for imag
+
+    /* First pass: extract vi/vq (unsigned 11 bits), exponent, compute He & maxbit (autoscale) */
+    for (int i = 0; i < nfft; ++i) {
+        uint32_t Hval = H[i];
+
+        /* Extract 11-bit mantissas in the same bit positions as the .mex code */
+        int32_t vi = (int32_t)((Hval >> (nexp + nman)) & iq_mask);  // real mantissa raw (0..0x7FF)
+        int32_t vq = (int32_t)((Hval >> nexp) & iq_mask);          // imag mantissa raw (0..0x7FF)
+
+        /* exponent in low bits (signed two's complement if >= e_p) */
+        int e = (int)(Hval & e_mask);
+        if (e >= e_p) e -= (e_p << 1);
+        He[i] = (int8_t)e;
+
+        /* autoscale: use absolute magnitude of mantissas (but mantissas still unsigned here) */
+        if (autoscale) {
+            uint32_t x = (uint32_t)vi | (uint32_t)vq; // still unsigned fields
+            if (x) {
+                uint32_t m = 0xffff0000u;
+                uint32_t b = 0xffffu;
+                int s = 16;
+                int tmp_e = e;
+                while (s > 0) {
+                    if (x & m) {
+                        tmp_e += s;
+                        x >>= s;
+                    }
+                    s >>= 1;
+                    m = (m >> s) & b;
+                    b >>= s;
+                }
+                if (tmp_e > maxbit) maxbit = tmp_e;
+            }
+        }
+    }
+
+    int shft = nbits - maxbit;
+
+    /* Second pass: perform sign marking, sign extraction and shifting identical to .mex */
+    for (int i = 0; i < nfft; ++i) {
+        uint32_t Hval = H[i];
+        int e_scaled = He[i] + shft;
+
+        /* re/im raw (unsigned 11-bit) */
+        int32_t re = (int32_t)((Hval >> (nexp + nman)) & iq_mask);
+        int32_t im = (int32_t)((Hval >> nexp) & iq_mask);
+
+        /* mark sign bits in same way as mex: set high-bit sentinel if packed sign bit present */
+        if (Hval & sgnr_mask) re |= (int32_t)K_TOF_UNPACK_SGN_MASK;
+        if (Hval & sgni_mask) im |= (int32_t)K_TOF_UNPACK_SGN_MASK;
+
+        /* now perform sign extraction & shifting exactly like mex's second loop */
+        int sgn = 1;
+        if (re & (int32_t)K_TOF_UNPACK_SGN_MASK) {
+            sgn = -1;
+            re &= ~(int32_t)K_TOF_UNPACK_SGN_MASK;
+        }
+        if (e_scaled < e_zero) {
+            re = 0;
+        } else if (e_scaled < 0) {
+            re = (re >> (-e_scaled));
+        } else {
+            re = (re << e_scaled);
+        }
+        re = sgn * re;
+
+        sgn = 1;
+        if (im & (int32_t)K_TOF_UNPACK_SGN_MASK) {
+            sgn = -1;
+            im &= ~(int32_t)K_TOF_UNPACK_SGN_MASK;
+        }
+        if (e_scaled < e_zero) {
+            im = 0;
+        } else if (e_scaled < 0) {
+            im = (im >> (-e_scaled));
+        } else {
+            im = (im << e_scaled);
+        }
+        im = sgn * im;
+
+        Hout_re[i] = (double)re;
+        Hout_im[i] = (double)im;
+
+        //printf("[%2d] 0x%08X  %10d  %10d  %3d      %3d  %12.6f  %12.6f\n",
+        //       i, Hval, re, im, He[i], e_scaled, Hout_re[i], Hout_im[i]);
+    }
+}
+
+
+// --- acphy packed float unpack (sign|mantissa|sign|mantissa|exponent) ---
+// Written once and instantiated per chip with constant nman/nexp, so each
+// decoder gets its own specialized loop without format checks per sample.
+static inline __attribute__((always_inline))
+void unpack_float_acphy(int nman, int nexp, int nfft, const uint32_t *H, int32_t *Hout) {
+    int nbits = 10;
+    int autoscale = 1;
+    int e_p = (1 << (nexp - 1));
+    int maxbit = -e_p;
+
+
+    int e_zero = -nman;
+    int n_out = (nfft << 1);
+    int e_shift = 1;
+    int8_t He[256];
+    uint32_t iq_mask = (1 << (nman - 1)) - 1;
+    uint32_t e_mask = (1 << nexp) - 1;
+    uint32_t sgnr_mask = (1 << (nexp + 2*nman - 1));
+    uint32_t sgni_mask = (sgnr_mask >> nman);
+    int32_t *pOut = Hout;
+
+
+    for (int i = 0; i < nfft; i++) {
+        int32_t vi = (int32_t)((H[i] >> (nexp + nman)) & iq_mask);
+        int32_t vq = (int32_t)((H[i] >> nexp) & iq_mask);
+        int e = (int)(H[i] & e_mask);
+        if (e >= e_p)
+            e -= (e_p << 1);
+        He[i] = (int8_t)e;
+        uint32_t x = (uint32_t)vi | (uint32_t)vq;
+        if (autoscale && x) {
+            uint32_t m = 0xffff0000, b = 0xffff;
+            int s = 16;
+            while (s > 0) {
+                if (x & m) {
+                    e += s;
+                    x >>= s;
+                }
+                s >>= 1;
+                m = (m >> s) & b;
+                b >>= s;
+            }
+            if (e > maxbit)
+                maxbit = e;
+        }
+        if (H[i] & sgnr_mask)
+            vi |= k_tof_unpack_sgn_mask;
+        if (H[i] & sgni_mask)
+            vq |= k_tof_unpack_sgn_mask;
+        Hout[i << 1] = vi;
+        Hout[(i << 1) + 1] = vq;
+    }
+    int shft = nbits - maxbit;
+    for (int i = 0; i < n_out; i++) {
+        int e = He[(i >> e_shift)] + shft;
+        int32_t vi = *pOut;
+        int sgn = 1;
+        if (vi & k_tof_unpack_sgn_mask) {
+            sgn = -1;
+            vi &= ~k_tof_unpack_sgn_mask;
+        }
+        if (e < e_zero) {
+            vi = 0;
+        } else if (e < 0) {
+            vi = (vi >> (-e));
+        } else {
+            vi = (vi << e);
+        }
+        *pOut++ = (int32_t)(sgn * vi);
+    }
+}
+
+// bcm4366c0: 12-bit mantissas, 6-bit exponent
+void unpack_float_4366c0(int nfft, uint32_t *H, int32_t *Hout) {
+    unpack_float_acphy(12, 6, nfft, H, Hout);
+}
+
+// bcm4358: 9-bit mantissas, 5-bit exponent
+void unpack_float_4358(int nfft, uint32_t *H, int32_t *Hout) {
+    unpack_float_acphy(9, 5, nfft, H, Hout);
+}
+
+// bcm4339 / bcm43455c0: plain little-endian int16 I/Q pairs
+void unpack_int16_iq(int nfft, const uint8_t *payload, int32_t *Hout) {
+    for (int i = 0; i < (nfft << 1); i++)
+        Hout[i] = (int16_t)(payload[2*i] | (payload[2*i+1] << 8));
+}
+
+// zero guard subcarriers (0..3, DC at 32, 62..63)
+void csi_zero_guards(int32_t *Hout) {
+    for (int i = 0; i <= 3; i++) { Hout[2*i]=0; Hout[2*i+1]=0; }
+    Hout[2*32]=0; Hout[2*32+1]=0;
+    for (int i = 62; i <= 63; i++){ Hout[2*i]=0; Hout[2*i+1]=0; }
+}
+
+// Build CSV message: seq,core,stream,re0,im0,re1,im1,...,ts_us\n
+// The receive timestamp goes last so readers indexing re/im are unaffected.
+// Returns the number of bytes written (including the newline).
+int csi_format_csv(char *msg, size_t cap, uint16_t seq, int core, int stream,
+                   int nfft, const int32_t *Hout, uint64_t ts_us) {
+    int pos = snprintf(msg, cap, "%u,%d,%d", seq, core, stream);
+    for (int i=0; i<nfft; i++){
+        double re = (double)Hout[2*i];
+        double im = (double)Hout[2*i+1];
+        pos += snprintf(msg+pos, cap-pos, ",%.8f,%.8f", re, im);
+        if (pos >= (int)cap-32) break;
+    }
+    pos += snprintf(msg+pos, cap-pos, ",%llu", (unsigned long long)ts_us);
+    msg[pos++] = '\n';
+    return pos;
+}
@@ -0,0 +1,40 @@
+/* csi_kernels.h
+   Unpack and formatting kernels shared by csi_analyzer and csi_bench.
+*/
+
+#ifndef CSI_KERNELS_H
+#define CSI_KERNELS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+#define NFFT 64
+
+// Timestamp clock shared by CSI frames and queue samples (CLOCK_MONOTONIC, us)
+static inline uint64_t csi_clock_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ull + (uint64_t)ts.tv_nsec / 1000;
+}
+
+// bcm4366c0 packed float -> doubles (reference decoder, mirrors the .mex)
+void unpack_float_double(int nfft, uint32_t *H, double *Hout_re, double *Hout_im);
+
+// bcm4366c0 packed float -> interleaved int32 re/im (decoder used on the router)
+void unpack_float_4366c0(int nfft, uint32_t *H, int32_t *Hout);
+
+// bcm4358 packed float -> interleaved int32 re/im
+void unpack_float_4358(int nfft, uint32_t *H, int32_t *Hout);
+
+// bcm4339 / bcm43455c0 int16 I/Q -> interleaved int32 re/im
+void unpack_int16_iq(int nfft, const uint8_t *payload, int32_t *Hout);
+
+// zero guard and DC subcarriers of a 20 MHz (NFFT 64) frame
+void csi_zero_guards(int32_t *Hout);
+
+// seq,core,stream,re0,im0,...,ts_us\n; returns bytes written
+int csi_format_csv(char *msg, size_t cap, uint16_t seq, int core, int stream,
+                   int nfft, const int32_t *Hout, uint64_t ts_us);
+
+#endif
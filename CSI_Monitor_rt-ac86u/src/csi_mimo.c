@@ -0,0 +1,200 @@
+/* csi_mimo.c
+   Spatial channel metrics from assembled CSI frames.
+
+   For every subcarrier the Nrx x Nss channel H is reduced to its Gram matrix
+   (H^H H, or H H^H when Nss > Nrx), whose eigenvalues are the squared singular
+   values of H. A cyclic complex Jacobi sweep on the <= 4x4 Hermitian matrix
+   gives all of them without any allocation.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <complex.h>
+
+#include "csi_mimo.h"
+
+#define JACOBI_MAX_SWEEPS 8
+#define SPREAD_DB_CAP     90.0f   // reported spread when the smallest eigenvalue is ~0
+
+void mimo_init(mimo_asm_t *a, int exp_cores, int exp_streams, float usable_thr_db) {
+    memset(a, 0, sizeof(*a));
+    a->exp_cores = exp_cores;
+    a->exp_streams = exp_streams;
+    a->usable_thr_db = usable_thr_db;
+}
+
+// Eigenvalues of the n x n Hermitian matrix A (destroyed), n <= 4
+static void herm_eig(int n, float complex A[4][4], float *lambda) {
+    float trace = 0;
+    for (int i = 0; i < n; i++) trace += crealf(A[i][i]);
+
+    for (int sweep = 0; sweep < JACOBI_MAX_SWEEPS; sweep++) {
+        float off = 0;
+        for (int p = 0; p < n; p++)
+            for (int q = p + 1; q < n; q++)
+                off += crealf(A[p][q] * conjf(A[p][q]));
+        if (off <= 1e-12f * trace * trace) break;
+
+        for (int p = 0; p < n; p++) {
+            for (int q = p + 1; q < n; q++) {
+                float apq = cabsf(A[p][q]);
+                if (apq == 0) continue;
+
+                // rotate basis vector q by e^{-i phi} so a_pq becomes real,
+                // then apply the real Jacobi rotation
+                float complex ph = conjf(A[p][q]) / apq;
+                float app = crealf(A[p][p]), aqq = crealf(A[q][q]);
+                float theta = (aqq - app) / (2 * apq);
+                float t = (theta >= 0 ? 1.0f : -1.0f) / (fabsf(theta) + sqrtf(1 + theta * theta));
+                float c = 1 / sqrtf(1 + t * t);
+                float s = t * c;
+
+                for (int k = 0; k < n; k++) {
+                    if (k == p || k == q) continue;
+                    float complex akp = A[k][p];
+                    float complex akq = A[k][q] * ph;
+                    float complex nkp = c * akp - s * akq;
+                    float complex nkq = c * akq + s * akp;
+                    A[k][p] = nkp; A[p][k] = conjf(nkp);
+                    A[k][q] = nkq; A[q][k] = conjf(nkq);
+                }
+                A[p][p] = app - t * apq;
+                A[q][q] = aqq + t * apq;
+                A[p][q] = 0;
+                A[q][p] = 0;
+            }
+        }
+    }
+
+    for (int i = 0; i < n; i++) {
+        float l = crealf(A[i][i]);
+        lambda[i] = l > 0 ? l : 0;
+    }
+}
+
+static void compute_metrics(const mimo_asm_t *a, mimo_metrics_t *m) {
+    int nrx = a->exp_cores, nss = a->exp_streams;
+    int n = nss <= nrx ? nss : nrx;
+    float thr = powf(10.0f, -a->usable_thr_db / 10.0f);
+    float complex G[4][4];
+    float lambda[4];
+
+    m->seq = a->seq;
+    m->nrx = nrx;
+    m->nss = nss;
+    m->n_sc = 0;
+    m->usable_min = n;
+    m->usable_mean = 0;
+    m->spread_db_mean = 0;
+    m->spread_db_max = 0;
+
+    for (int sc = 0; sc < NFFT; sc++) {
+        // Gram matrix over the smaller dimension
+        for (int i = 0; i < n; i++) {
+            for (int j = i; j < n; j++) {
+                float complex g = 0;
+                if (nss <= nrx) {
+                    for (int k = 0; k < nrx; k++)
+                        g += conjf(a->H[k][i][sc]) * a->H[k][j][sc];
+                } else {
+                    for (int k = 0; k < nss; k++)
+                        g += a->H[i][k][sc] * conjf(a->H[j][k][sc]);
+                }
+                G[i][j] = g;
+                G[j][i] = conjf(g);
+            }
+        }
+
+        float trace = 0;
+        for (int i = 0; i < n; i++) trace += crealf(G[i][i]);
+        if (trace <= 0) {
+            // guard / DC subcarrier
+            m->cond[sc] = 0;
+            m->spread_db[sc] = 0;
+            m->usable[sc] = 0;
+            continue;
+        }
+
+        herm_eig(n, G, lambda);
+        float lmax = lambda[0], lmin = lambda[0];
+        for (int i = 1; i < n; i++) {
+            if (lambda[i] > lmax) lmax = lambda[i];
+            if (lambda[i] < lmin) lmin = lambda[i];
+        }
+        int usable = 0;
+        for (int i = 0; i < n; i++)
+            if (lambda[i] >= lmax * thr) usable++;
+
+        float spread_db = SPREAD_DB_CAP;
+        if (lmin > lmax * 1e-9f)
+            spread_db = 10.0f * log10f(lmax / lmin);
+
+        m->spread_db[sc] = spread_db;
+        m->cond[sc] = powf(10.0f, spread_db / 20.0f);
+        m->usable[sc] = (uint8_t)usable;
+
+        m->n_sc++;
+        if (usable < m->usable_min) m->usable_min = usable;
+        m->usable_mean += usable;
+        m->spread_db_mean += spread_db;
+        if (spread_db > m->spread_db_max) m->spread_db_max = spread_db;
+    }
+
+    if (m->n_sc) {
+        m->usable_mean /= m->n_sc;
+        m->spread_db_mean /= m->n_sc;
+    } else {
+        m->usable_min = 0;
+    }
+}
+
+static int frame_complete(const mimo_asm_t *a) {
+    for (int c = 0; c < a->exp_cores; c++)
+        for (int s = 0; s < a->exp_streams; s++)
+            if (!(a->present & (1u << (c * MIMO_MAX_STREAMS + s))))
+                return 0;
+    return 1;
+}
+
+int mimo_add(mimo_asm_t *a, uint16_t seq, int core, int stream,
+             const int32_t *Hout, mimo_metrics_t *out) {
+    if (core >= a->exp_cores || stream >= a->exp_streams)
+        return 0;
+
+    if (!a->have_seq || seq != a->seq) {
+        if (a->have_seq && a->present && !a->done)
+            a->frames_incomplete++;
+        a->have_seq = 1;
+        a->seq = seq;
+        a->present = 0;
+        a->done = 0;
+    }
+    if (a->done)
+        return 0;
+
+    float complex *dst = a->H[core][stream];
+    for (int i = 0; i < NFFT; i++)
+        dst[i] = (float)Hout[2*i] + (float)Hout[2*i+1] * I;
+    a->present |= 1u << (core * MIMO_MAX_STREAMS + stream);
+
+    if (!frame_complete(a))
+        return 0;
+
+    compute_metrics(a, out);
+    a->done = 1;
+    a->frames_complete++;
+    return 1;
+}
+
+int mimo_format_csv(char *msg, size_t cap, const mimo_metrics_t *m) {
+    int pos = snprintf(msg, cap, "M,%u,%d,%d,%d,%.3f,%.3f,%.3f",
+                       m->seq, m->nrx, m->nss, m->usable_min,
+                       m->usable_mean, m->spread_db_mean, m->spread_db_max);
+    for (int i = 0; i < NFFT && pos < (int)cap - 32; i++)
+        pos += snprintf(msg+pos, cap-pos, ",%.3f", m->cond[i]);
+    for (int i = 0; i < NFFT && pos < (int)cap - 32; i++)
+        pos += snprintf(msg+pos, cap-pos, ",%u", m->usable[i]);
+    msg[pos++] = '\n';
+    return pos;
+}
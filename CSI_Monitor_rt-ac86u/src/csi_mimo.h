@@ -0,0 +1,62 @@
+/* csi_mimo.h
+   Assembles per-core/per-stream CSI reports of one sounding (same seq) into a
+   full Nrx x Nss channel and computes spatial metrics per subcarrier.
+   Everything is fixed size (up to 4x4), no heap allocation.
+*/
+
+#ifndef CSI_MIMO_H
+#define CSI_MIMO_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <complex.h>
+
+#include "csi_kernels.h"
+
+#define MIMO_MAX_CORES   4
+#define MIMO_MAX_STREAMS 4
+
+typedef struct {
+    // configuration
+    int exp_cores;              // frame is complete once this many cores ...
+    int exp_streams;            // ... x this many streams have reported
+    float usable_thr_db;        // eigenvalue within this of the largest = usable stream
+
+    // assembly state
+    int have_seq;
+    uint16_t seq;
+    uint32_t present;           // bit (core * MIMO_MAX_STREAMS + stream)
+    int done;                   // metrics already emitted for this seq
+    float complex H[MIMO_MAX_CORES][MIMO_MAX_STREAMS][NFFT];
+
+    // counters
+    unsigned long frames_complete;
+    unsigned long frames_incomplete;
+} mimo_asm_t;
+
+typedef struct {
+    uint16_t seq;
+    int nrx, nss;
+    int n_sc;                   // subcarriers with non-zero channel
+    float cond[NFFT];           // condition number (sigma_max / sigma_min), 0 on guards
+    float spread_db[NFFT];      // eigenvalue spread 10*log10(lambda_max / lambda_min) = 20*log10(cond)
+    uint8_t usable[NFFT];       // eigenvalues within usable_thr_db of the largest
+    // per-frame summary over data subcarriers
+    int usable_min;
+    float usable_mean;
+    float spread_db_mean;
+    float spread_db_max;
+} mimo_metrics_t;
+
+void mimo_init(mimo_asm_t *a, int exp_cores, int exp_streams, float usable_thr_db);
+
+// Add one decoded report (interleaved re/im, guards already zeroed).
+// Returns 1 when the frame for the current seq is complete and *out holds its
+// metrics. A report with a new seq drops an incomplete previous frame.
+int mimo_add(mimo_asm_t *a, uint16_t seq, int core, int stream,
+             const int32_t *Hout, mimo_metrics_t *out);
+
+// M,seq,nrx,nss,usable_min,usable_mean,spread_db_mean,spread_db_max,cond0..cond63,usable0..usable63\n
+int mimo_format_csv(char *msg, size_t cap, const mimo_metrics_t *m);
+
+#endif
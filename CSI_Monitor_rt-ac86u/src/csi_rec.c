@@ -0,0 +1,200 @@
+/* csi_rec.c
+   Columnar session recorder (see csi_rec.h).
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "csi_rec.h"
+
+#define MAGIC(a, b, c, d) ((uint32_t)(a) | (uint32_t)(b) << 8 | (uint32_t)(c) << 16 | (uint32_t)(d) << 24)
+
+// Value size of every column, per table, in file order (0 ends the list)
+static const size_t col_size[CSI_REC_TABLES][CSI_REC_MAX_COLS] = {
+    [CSI_REC_FRAMES]   = { 8, 8, 2, 1, 1, NFFT * 2 * sizeof(float) },
+    [CSI_REC_VARIANCE] = { 8, 2, 1, 2, 4, 4 },
+    [CSI_REC_QUEUE]    = { 8, 8, 4, 4, 4, 2, 2, 4 },
+    [CSI_REC_FEATURES] = { 8, 1, 4, 4, 4, 4, 4, 4 },
+    [CSI_REC_DELAYS]   = { 8, 1, 4 },
+};
+
+static int n_cols(int table) {
+    int n = 0;
+    while (n < CSI_REC_MAX_COLS && col_size[table][n]) n++;
+    return n;
+}
+
+static size_t pad8(size_t n) {
+    return (n + 7) & ~(size_t)7;
+}
+
+static uint64_t realtime_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ull + (uint64_t)ts.tv_nsec / 1000;
+}
+
+static int write_all(csi_rec_t *r, const void *p, size_t len) {
+    if (r->failed) return -1;
+    if (len && fwrite(p, 1, len, r->f) != len) {
+        perror("csi_rec: write");
+        r->failed = 1;
+        return -1;
+    }
+    r->offset += len;
+    return 0;
+}
+
+csi_rec_t *csi_rec_open(const char *path) {
+    csi_rec_t *r = calloc(1, sizeof(*r));
+    if (!r) {
+        perror("calloc");
+        return NULL;
+    }
+    for (int t = 0; t < CSI_REC_TABLES; t++) {
+        for (int c = 0; c < n_cols(t); c++) {
+            r->buf[t].col[c] = malloc(col_size[t][c] * CSI_REC_CHUNK_ROWS);
+            if (!r->buf[t].col[c]) {
+                perror("malloc");
+                csi_rec_close(r);
+                return NULL;
+            }
+        }
+    }
+    r->f = fopen(path, "wb");
+    if (!r->f) {
+        perror(path);
+        csi_rec_close(r);
+        return NULL;
+    }
+    // Whole chunks per write() where possible
+    setvbuf(r->f, NULL, _IOFBF, 1 << 20);
+
+    struct {
+        uint32_t magic, version;
+        uint64_t created_us;
+        uint32_t tables, reserved;
+        uint64_t reserved2;
+    } hdr = { MAGIC('C', 'S', 'R', 'F'), CSI_REC_VERSION, realtime_us(), CSI_REC_TABLES, 0, 0 };
+    if (write_all(r, &hdr, sizeof(hdr)) < 0) {
+        csi_rec_close(r);
+        return NULL;
+    }
+    return r;
+}
+
+static int flush_table(csi_rec_t *r, int t) {
+    csi_rec_buf_t *b = &r->buf[t];
+    static const uint8_t zero[8];
+    uint64_t bytes = 0;
+    int nc = n_cols(t);
+
+    if (b->rows == 0) return 0;
+    for (int c = 0; c < nc; c++) {
+        bytes += pad8(col_size[t][c] * b->rows);
+    }
+
+    if (r->n_index == r->cap_index) {
+        uint32_t cap = r->cap_index ? r->cap_index * 2 : 1024;
+        csi_rec_index_t *idx = realloc(r->index, cap * sizeof(*idx));
+        if (!idx) {
+            perror("realloc");
+            r->failed = 1;
+            return -1;
+        }
+        r->index = idx;
+        r->cap_index = cap;
+    }
+    r->index[r->n_index++] = (csi_rec_index_t){
+        .table = (uint16_t)t, .rows = b->rows,
+        .t_first_us = b->t_first_us, .t_last_us = b->t_last_us, .offset = r->offset
+    };
+
+    csi_rec_chunk_t h = {
+        .magic = MAGIC('C', 'H', 'N', 'K'), .table = (uint16_t)t, .n_cols = (uint16_t)nc,
+        .rows = b->rows, .t_first_us = b->t_first_us, .t_last_us = b->t_last_us, .bytes = bytes
+    };
+    int rv = write_all(r, &h, sizeof(h));
+    for (int c = 0; c < nc && rv == 0; c++) {
+        size_t len = col_size[t][c] * b->rows;
+        rv = write_all(r, b->col[c], len);
+        if (rv == 0) rv = write_all(r, zero, pad8(len) - len);
+    }
+    b->rows = 0;
+    return rv;
+}
+
+int csi_rec_append(csi_rec_t *r, int table, size_t n, const void *const *col) {
+    csi_rec_buf_t *b = &r->buf[table];
+    int nc = n_cols(table);
+    size_t done = 0;
+
+    if (r->failed) return -1;
+    while (done < n) {
+        size_t take = n - done;
+        if (take > CSI_REC_CHUNK_ROWS - b->rows) take = CSI_REC_CHUNK_ROWS - b->rows;
+
+        for (int c = 0; c < nc; c++) {
+            memcpy(b->col[c] + col_size[table][c] * b->rows,
+                   (const uint8_t *)col[c] + col_size[table][c] * done, col_size[table][c] * take);
+        }
+        // The time span of the chunk, for the index
+        const uint64_t *t_us = (const uint64_t *)col[0] + done;
+        if (b->rows == 0) {
+            b->t_first_us = b->t_last_us = t_us[0];
+            b->opened_us = realtime_us();
+        }
+        for (size_t i = 0; i < take; i++) {
+            if (t_us[i] < b->t_first_us) b->t_first_us = t_us[i];
+            if (t_us[i] > b->t_last_us) b->t_last_us = t_us[i];
+        }
+        b->rows += take;
+        done += take;
+        r->rows[table] += take;
+
+        if (b->rows == CSI_REC_CHUNK_ROWS && flush_table(r, table) < 0) return -1;
+    }
+
+    // Age out every table here, so a quiet one still reaches the disk
+    uint64_t now = realtime_us();
+    for (int t = 0; t < CSI_REC_TABLES; t++) {
+        if (r->buf[t].rows && now - r->buf[t].opened_us >= CSI_REC_FLUSH_US) {
+            if (flush_table(r, t) < 0) return -1;
+            if (fflush(r->f) != 0) r->failed = 1;
+        }
+    }
+    return r->failed ? -1 : 0;
+}
+
+int csi_rec_flush(csi_rec_t *r) {
+    for (int t = 0; t < CSI_REC_TABLES; t++) {
+        if (flush_table(r, t) < 0) return -1;
+    }
+    if (!r->failed && fflush(r->f) != 0) r->failed = 1;
+    return r->failed ? -1 : 0;
+}
+
+int csi_rec_close(csi_rec_t *r) {
+    int rv = 0;
+    if (!r) return 0;
+    if (r->f) {
+        csi_rec_flush(r);
+        uint64_t index_offset = r->offset;
+        struct {
+            uint32_t magic, chunks;
+            uint64_t index_offset;
+        } trailer = { MAGIC('C', 'I', 'D', 'X'), r->n_index, index_offset };
+        write_all(r, r->index, r->n_index * sizeof(*r->index));
+        write_all(r, &trailer, sizeof(trailer));
+        if (fclose(r->f) != 0) r->failed = 1;
+        rv = r->failed ? -1 : 0;
+    }
+    for (int t = 0; t < CSI_REC_TABLES; t++) {
+        for (int c = 0; c < CSI_REC_MAX_COLS; c++) free(r->buf[t].col[c]);
+    }
+    free(r->index);
+    free(r);
+    return rv;
+}
@@ -0,0 +1,108 @@
+/* csi_rec.h
+   Columnar session recorder: CSI frames, features, queue samples and frame
+   delays in one append-only file, for hours of recording at full rate and
+   time-range reads without scanning (live_monitoring/csi_record.py).
+
+   Rows are buffered per table and written as chunks: a chunk header, then
+   each column as one contiguous array (8-byte aligned). A chunk is flushed
+   at CSI_REC_CHUNK_ROWS rows or CSI_REC_FLUSH_US after its first row, so
+   the file trails the live data by about a second. On close an index of
+   every chunk (table, rows, time span, offset) and a trailer pointing at it
+   are appended; a reader maps the file, reads the index and touches only
+   the chunks overlapping the range it wants. A file cut short by a crash
+   has no index; its chunk headers chain by length and can be walked.
+
+   All fields are in host byte order (little-endian on the recording host):
+
+     file     "CSRF", u32 version (1), u64 created_us, u32 tables, u32 0,
+              u64 0
+     chunk    "CHNK", u16 table, u16 columns, u32 rows, u32 0,
+              u64 t_first_us, u64 t_last_us, u64 bytes (column data after
+              this header), then the columns in table order
+     index    per chunk: u16 table, u16 0, u32 rows, u64 t_first_us,
+              u64 t_last_us, u64 offset of the chunk header
+     trailer  "CIDX", u32 chunks, u64 offset of the index
+
+   t_us is CLOCK_REALTIME on the host (what the monitors plot against).
+*/
+
+#ifndef CSI_REC_H
+#define CSI_REC_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "csi_kernels.h"
+
+#define CSI_REC_VERSION     1
+#define CSI_REC_MAX_COLS    8
+#define CSI_REC_CHUNK_ROWS  4096
+#define CSI_REC_FLUSH_US    1000000
+
+// Tables and their columns, in file order
+enum {
+    CSI_REC_FRAMES = 0,         // t_us u64, ts_us u64 (router), seq u16, core u8, stream u8,
+                                // csi f32[NFFT * 2] (interleaved re/im)
+    CSI_REC_VARIANCE,           // t_us u64, seq u16, core u8, n u16, ampl_var f32, phase_var f32
+    CSI_REC_QUEUE,              // t_us u64, ts_us u64 (router), backlog u32, qlen u32, drops u32,
+                                // rssi i16, noise i16, snr f32 (rssi/noise 0, snr NaN: none)
+    CSI_REC_FEATURES,           // t_us u64, core u8, ampl_mean f32, phase_std f32, ampl_ma f32,
+                                // phase_ma f32, phase_deriv f32, iat_ms f32
+    CSI_REC_DELAYS,             // t_us u64, source u8 (0: frame_delay.py), delay_ms f32
+    CSI_REC_TABLES
+};
+
+typedef struct {
+    uint32_t magic;
+    uint16_t table;
+    uint16_t n_cols;
+    uint32_t rows;
+    uint32_t reserved;
+    uint64_t t_first_us;
+    uint64_t t_last_us;
+    uint64_t bytes;
+} csi_rec_chunk_t;
+
+typedef struct {
+    uint16_t table;
+    uint16_t reserved;
+    uint32_t rows;
+    uint64_t t_first_us;
+    uint64_t t_last_us;
+    uint64_t offset;
+} csi_rec_index_t;
+
+typedef struct {
+    uint8_t *col[CSI_REC_MAX_COLS];
+    uint32_t rows;
+    uint64_t t_first_us, t_last_us;
+    uint64_t opened_us;         // first row buffered, for the flush deadline
+} csi_rec_buf_t;
+
+typedef struct {
+    FILE *f;
+    uint64_t offset;            // end of the file
+    csi_rec_buf_t buf[CSI_REC_TABLES];
+    csi_rec_index_t *index;
+    uint32_t n_index, cap_index;
+    unsigned long rows[CSI_REC_TABLES];
+    int failed;                 // a write failed; nothing more is written
+} csi_rec_t;
+
+// Create (truncate) path. Returns NULL with a message on stderr.
+csi_rec_t *csi_rec_open(const char *path);
+
+// Append n rows to a table; col[i] points at n values of column i. The
+// first column is t_us. Returns 0, or -1 once a write has failed.
+int csi_rec_append(csi_rec_t *r, int table, size_t n, const void *const *col);
+
+// Write every buffered row out now (the recorder also does this on its own
+// at chunk size or age)
+int csi_rec_flush(csi_rec_t *r);
+
+// Flush, append the index and trailer and close. Returns 0, or -1 if any
+// write failed.
+int csi_rec_close(csi_rec_t *r);
+
+#endif
@@ -0,0 +1,109 @@
+/* csi_ring.c
+   Shared-memory ring writer (see csi_ring.h).
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "csi_ring.h"
+
+// Element size of every field, per ring, in header order
+static const size_t field_size[CSI_RING_KINDS][CSI_RING_MAX_FIELDS] = {
+    [CSI_RING_FRAMES] = { 4, 8, 8, 2, 1, 1, NFFT * 2 * sizeof(float) },
+    [CSI_RING_VAR]    = { 4, 8, 2, 1, 2, 4, 4 },
+    [CSI_RING_QUEUE]  = { 4, 8, 8, 4, 4, 4, 2, 2, 1 },
+};
+static const uint32_t n_fields[CSI_RING_KINDS] = { CSI_F_FIELDS, VAR_F_FIELDS, Q_F_FIELDS };
+
+static size_t align_up(size_t n) {
+    return (n + CSI_RING_ALIGN - 1) & ~(size_t)(CSI_RING_ALIGN - 1);
+}
+
+int csi_ring_create(csi_ring_t *r, const char *name, uint32_t cap) {
+    csi_ring_header_t layout;
+    size_t size = align_up(sizeof(layout));
+
+    if (cap < 2 || cap > CSI_RING_CAP_MAX || (cap & (cap - 1))) {
+        fprintf(stderr, "Error: ring size must be a power of two, 2-%d\n", CSI_RING_CAP_MAX);
+        return -1;
+    }
+    memset(&layout, 0, sizeof(layout));
+    for (int k = 0; k < CSI_RING_KINDS; k++) {
+        layout.ring[k].cap = cap;
+        layout.ring[k].n_fields = n_fields[k];
+        for (uint32_t f = 0; f < n_fields[k]; f++) {
+            layout.ring[k].off[f] = size;
+            size = align_up(size + field_size[k][f] * cap);
+        }
+    }
+
+    memset(r, 0, sizeof(*r));
+    snprintf(r->name, sizeof(r->name), "%s%s", name[0] == '/' ? "" : "/", name);
+    // A fresh segment every time, never a layout changing under a reader;
+    // readers notice the new file and map it again
+    shm_unlink(r->name);
+    int fd = shm_open(r->name, O_CREAT | O_EXCL | O_RDWR, 0644);
+    if (fd < 0) {
+        perror("shm_open");
+        return -1;
+    }
+    if (ftruncate(fd, size) < 0) {
+        perror("ftruncate");
+        close(fd);
+        shm_unlink(r->name);
+        return -1;
+    }
+    void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("mmap");
+        shm_unlink(r->name);
+        return -1;
+    }
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    layout.nfft = NFFT;
+    layout.writer_pid = (uint32_t)getpid();
+    layout.size = size;
+    layout.started_us = (uint64_t)ts.tv_sec * 1000000ull + (uint64_t)ts.tv_nsec / 1000;
+    layout.version = CSI_RING_VERSION;
+    r->hdr = map;
+    r->size = size;
+    memcpy(r->hdr, &layout, sizeof(layout));
+    // Magic last: a reader that sees it sees the whole header
+    __atomic_store_n(&r->hdr->magic, CSI_RING_MAGIC, __ATOMIC_RELEASE);
+    return 0;
+}
+
+void csi_ring_close(csi_ring_t *r, int unlink) {
+    if (!r->hdr) return;
+    munmap(r->hdr, r->size);
+    r->hdr = NULL;
+    if (unlink) shm_unlink(r->name);
+}
+
+uint32_t csi_ring_begin(csi_ring_t *r, int kind) {
+    csi_ring_desc_t *d = &r->hdr->ring[kind];
+    uint64_t n = d->head;
+    uint32_t slot = (uint32_t)n & (d->cap - 1);
+    uint32_t *lock = csi_ring_field(r, kind, 0);
+
+    __atomic_store_n(&lock[slot], (uint32_t)(2 * n + 1), __ATOMIC_RELAXED);
+    // The odd lock is visible before any field changes
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    return slot;
+}
+
+void csi_ring_commit(csi_ring_t *r, int kind, uint32_t slot) {
+    csi_ring_desc_t *d = &r->hdr->ring[kind];
+    uint64_t n = d->head;
+    uint32_t *lock = csi_ring_field(r, kind, 0);
+
+    __atomic_store_n(&lock[slot], (uint32_t)(2 * n + 2), __ATOMIC_RELEASE);
+    __atomic_store_n(&d->head, n + 1, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,124 @@
+/* csi_ring.h
+   Shared-memory ring of decoded CSI records for the host-side monitors.
+
+   csi_ringd runs on the monitoring host in place of the Python socket
+   reader: it takes csi_analyzer's CSV stream, parses each line once in C
+   and stores the record in a POSIX shared-memory segment (/dev/shm/<name>).
+   The monitors map the segment and view every field as a NumPy array
+   (live_monitoring/csi_ring.py), so a batch of frames costs no parsing and
+   no copies.
+
+   The segment holds one ring per record type: CSI frames, "V" window
+   variance and "Q" queue samples. Each ring is struct-of-arrays, one
+   array of cap entries per field, every array CSI_RING_ALIGN aligned, so a
+   field over a batch is one contiguous slice. The header gives each
+   array's offset; field order and types are fixed by the version.
+
+   Record n (counting from 0) of a ring goes to slot n % cap:
+
+     lock[slot] = 2n + 1, fields, lock[slot] = 2n + 2, head = n + 1
+
+   (locks are 32 bits and wrap). A reader takes head, uses slots whose
+   lock is 2n + 2, and checks the locks again when done with them: a
+   changed lock means the writer lapped it and that record is dropped.
+   All fields are in host byte order.
+*/
+
+#ifndef CSI_RING_H
+#define CSI_RING_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "csi_kernels.h"
+
+#define CSI_RING_MAGIC      0x52495343u     // "CSIR" on a little-endian host
+#define CSI_RING_VERSION    1
+#define CSI_RING_ALIGN      64
+#define CSI_RING_MAX_FIELDS 10
+#define CSI_RING_CAP_MAX    (1 << 20)
+
+enum {
+    CSI_RING_FRAMES = 0,        // seq,core,stream,re0,im0,...,ts_us
+    CSI_RING_VAR,               // V,seq,core,n,ampl_var_mean,phase_var_mean
+    CSI_RING_QUEUE,             // Q,ts_us,backlog,qlen,drops,rssi,noise,snr
+    CSI_RING_KINDS
+};
+
+// Field arrays of each ring, in header order. rx_us is CLOCK_REALTIME on
+// the host when the line arrived (what the monitors plot against); ts_us
+// is the router's csi_clock_us().
+enum {                          // CSI_RING_FRAMES
+    CSI_F_LOCK = 0,             // uint32
+    CSI_F_RX_US,                // uint64
+    CSI_F_TS_US,                // uint64
+    CSI_F_SEQ,                  // uint16
+    CSI_F_CORE,                 // uint8
+    CSI_F_STREAM,               // uint8
+    CSI_F_CSI,                  // float32[NFFT * 2], interleaved re/im (a complex64 row)
+    CSI_F_FIELDS
+};
+enum {                          // CSI_RING_VAR
+    VAR_F_LOCK = 0,             // uint32
+    VAR_F_RX_US,                // uint64
+    VAR_F_SEQ,                  // uint16
+    VAR_F_CORE,                 // uint8
+    VAR_F_N,                    // uint16
+    VAR_F_AMPL,                 // float32
+    VAR_F_PHASE,                // float32
+    VAR_F_FIELDS
+};
+enum {                          // CSI_RING_QUEUE
+    Q_F_LOCK = 0,               // uint32
+    Q_F_RX_US,                  // uint64
+    Q_F_TS_US,                  // uint64
+    Q_F_BACKLOG,                // uint32
+    Q_F_QLEN,                   // uint32
+    Q_F_DROPS,                  // uint32
+    Q_F_RSSI,                   // int16, dBm
+    Q_F_NOISE,                  // int16, dBm
+    Q_F_RADIO,                  // uint8, rssi/noise valid
+    Q_F_FIELDS
+};
+
+typedef struct {
+    uint64_t head;              // records written
+    uint32_t cap;               // slots, power of two
+    uint32_t n_fields;
+    uint64_t off[CSI_RING_MAX_FIELDS];  // field arrays, from the start of the segment
+} csi_ring_desc_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t nfft;
+    uint32_t writer_pid;
+    uint64_t size;              // bytes in the segment
+    uint64_t started_us;        // CLOCK_REALTIME at creation; readers resync when it changes
+    csi_ring_desc_t ring[CSI_RING_KINDS];
+} csi_ring_header_t;
+
+typedef struct {
+    csi_ring_header_t *hdr;
+    size_t size;
+    char name[64];
+} csi_ring_t;
+
+// Create (or replace) /dev/shm/<name> with cap slots per ring. Returns 0,
+// or -1 with a message on stderr.
+int csi_ring_create(csi_ring_t *r, const char *name, uint32_t cap);
+
+// Unmap, and remove the segment if unlink is set
+void csi_ring_close(csi_ring_t *r, int unlink);
+
+// Field array of a ring
+static inline void *csi_ring_field(const csi_ring_t *r, int kind, int field) {
+    return (char *)r->hdr + r->hdr->ring[kind].off[field];
+}
+
+// Claim the next slot of a ring (its lock goes odd); fill the fields at
+// the returned index, then publish with csi_ring_commit
+uint32_t csi_ring_begin(csi_ring_t *r, int kind);
+void csi_ring_commit(csi_ring_t *r, int kind, uint32_t slot);
+
+#endif
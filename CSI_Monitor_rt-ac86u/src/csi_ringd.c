@@ -0,0 +1,352 @@
+/* csi_ringd.c
+   Host-side ingestion daemon: receives csi_analyzer's CSV stream (TCP, as
+   csi_analyzer sends it, or UDP datagrams) and writes every CSI frame, "V"
+   variance and "Q" queue sample into the shared-memory ring of csi_ring.h
+   for the Python monitors. Lines are parsed once, here; "M" lines and
+   anything else are counted and skipped. With -r the same records also go
+   to a session file (csi_rec.h), whether or not a monitor is reading.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <math.h>
+#include <errno.h>
+#include <signal.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include "csi_kernels.h"
+#include "csi_ring.h"
+#include "csi_rec.h"
+
+#define DATA_PORT 12346         // csi_analyzer's DATA_PORT
+#define LINE_BUF  16384         // longest CSV line is about 2 KB
+
+static volatile sig_atomic_t running = 1;
+static csi_rec_t *rec;          // -r session file, or NULL
+
+static unsigned long records[CSI_RING_KINDS];
+static unsigned long skipped;   // "M" and unknown lines
+static unsigned long bad;       // lines that did not parse
+
+static void handle_signal(int sig) {
+    (void)sig;
+    running = 0;
+}
+
+static uint64_t realtime_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ull + (uint64_t)ts.tv_nsec / 1000;
+}
+
+// Next comma-separated number; *s moves past it and its comma. An empty
+// field leaves *ok set to 0 (Q lines without radio fields).
+static long next_long(char **s, int *ok) {
+    char *end;
+    long v = strtol(*s, &end, 10);
+    if (end == *s || (*end != ',' && *end != '\0')) *ok = 0;
+    *s = *end == ',' ? end + 1 : end;
+    return v;
+}
+
+static float next_float(char **s, int *ok) {
+    char *end;
+    float v = strtof(*s, &end);
+    if (end == *s || (*end != ',' && *end != '\0')) *ok = 0;
+    *s = *end == ',' ? end + 1 : end;
+    return v;
+}
+
+// seq,core,stream,re0,im0,...,re63,im63,ts_us
+static int put_frame(csi_ring_t *r, char *s, uint64_t rx_us) {
+    float csi[NFFT * 2];
+    int ok = 1;
+    long seq = next_long(&s, &ok);
+    long core = next_long(&s, &ok);
+    long stream = next_long(&s, &ok);
+    for (int i = 0; i < NFFT * 2 && ok; i++) {
+        csi[i] = next_float(&s, &ok);
+    }
+    uint64_t ts_us = ok ? strtoull(s, NULL, 10) : 0;
+    if (!ok || core < 0 || core > 7 || stream < 0 || stream > 7) return -1;
+
+    uint32_t i = csi_ring_begin(r, CSI_RING_FRAMES);
+    ((uint64_t *)csi_ring_field(r, CSI_RING_FRAMES, CSI_F_RX_US))[i] = rx_us;
+    ((uint64_t *)csi_ring_field(r, CSI_RING_FRAMES, CSI_F_TS_US))[i] = ts_us;
+    ((uint16_t *)csi_ring_field(r, CSI_RING_FRAMES, CSI_F_SEQ))[i] = (uint16_t)seq;
+    ((uint8_t *)csi_ring_field(r, CSI_RING_FRAMES, CSI_F_CORE))[i] = (uint8_t)core;
+    ((uint8_t *)csi_ring_field(r, CSI_RING_FRAMES, CSI_F_STREAM))[i] = (uint8_t)stream;
+    memcpy((float *)csi_ring_field(r, CSI_RING_FRAMES, CSI_F_CSI) + (size_t)i * NFFT * 2,
+           csi, sizeof(csi));
+    csi_ring_commit(r, CSI_RING_FRAMES, i);
+
+    if (rec) {
+        uint16_t seq16 = (uint16_t)seq;
+        uint8_t core8 = (uint8_t)core, stream8 = (uint8_t)stream;
+        const void *col[] = { &rx_us, &ts_us, &seq16, &core8, &stream8, csi };
+        csi_rec_append(rec, CSI_REC_FRAMES, 1, col);
+    }
+    return 0;
+}
+
+// V,seq,core,n,ampl_var_mean,phase_var_mean
+static int put_var(csi_ring_t *r, char *s, uint64_t rx_us) {
+    int ok = 1;
+    long seq = next_long(&s, &ok);
+    long core = next_long(&s, &ok);
+    long n = next_long(&s, &ok);
+    float ampl = next_float(&s, &ok);
+    float phase = next_float(&s, &ok);
+    if (!ok) return -1;
+
+    uint32_t i = csi_ring_begin(r, CSI_RING_VAR);
+    ((uint64_t *)csi_ring_field(r, CSI_RING_VAR, VAR_F_RX_US))[i] = rx_us;
+    ((uint16_t *)csi_ring_field(r, CSI_RING_VAR, VAR_F_SEQ))[i] = (uint16_t)seq;
+    ((uint8_t *)csi_ring_field(r, CSI_RING_VAR, VAR_F_CORE))[i] = (uint8_t)core;
+    ((uint16_t *)csi_ring_field(r, CSI_RING_VAR, VAR_F_N))[i] = (uint16_t)n;
+    ((float *)csi_ring_field(r, CSI_RING_VAR, VAR_F_AMPL))[i] = ampl;
+    ((float *)csi_ring_field(r, CSI_RING_VAR, VAR_F_PHASE))[i] = phase;
+    csi_ring_commit(r, CSI_RING_VAR, i);
+
+    if (rec) {
+        uint16_t seq16 = (uint16_t)seq, n16 = (uint16_t)n;
+        uint8_t core8 = (uint8_t)core;
+        const void *col[] = { &rx_us, &seq16, &core8, &n16, &ampl, &phase };
+        csi_rec_append(rec, CSI_REC_VARIANCE, 1, col);
+    }
+    return 0;
+}
+
+// Q,ts_us,backlog,qlen,drops,rssi,noise,snr (radio fields may be empty)
+static int put_queue(csi_ring_t *r, char *s, uint64_t rx_us) {
+    int ok = 1, radio = 1;
+    uint64_t ts_us = strtoull(s, &s, 10);
+    if (*s++ != ',') return -1;
+    long backlog = next_long(&s, &ok);
+    long qlen = next_long(&s, &ok);
+    long drops = next_long(&s, &ok);
+    if (!ok) return -1;
+    long rssi = next_long(&s, &radio);
+    long noise = next_long(&s, &radio);
+
+    uint32_t i = csi_ring_begin(r, CSI_RING_QUEUE);
+    ((uint64_t *)csi_ring_field(r, CSI_RING_QUEUE, Q_F_RX_US))[i] = rx_us;
+    ((uint64_t *)csi_ring_field(r, CSI_RING_QUEUE, Q_F_TS_US))[i] = ts_us;
+    ((uint32_t *)csi_ring_field(r, CSI_RING_QUEUE, Q_F_BACKLOG))[i] = (uint32_t)backlog;
+    ((uint32_t *)csi_ring_field(r, CSI_RING_QUEUE, Q_F_QLEN))[i] = (uint32_t)qlen;
+    ((uint32_t *)csi_ring_field(r, CSI_RING_QUEUE, Q_F_DROPS))[i] = (uint32_t)drops;
+    ((int16_t *)csi_ring_field(r, CSI_RING_QUEUE, Q_F_RSSI))[i] = radio ? (int16_t)rssi : 0;
+    ((int16_t *)csi_ring_field(r, CSI_RING_QUEUE, Q_F_NOISE))[i] = radio ? (int16_t)noise : 0;
+    ((uint8_t *)csi_ring_field(r, CSI_RING_QUEUE, Q_F_RADIO))[i] = (uint8_t)radio;
+    csi_ring_commit(r, CSI_RING_QUEUE, i);
+
+    if (rec) {
+        uint32_t b = (uint32_t)backlog, q = (uint32_t)qlen, d = (uint32_t)drops;
+        int16_t rs = radio ? (int16_t)rssi : 0, nf = radio ? (int16_t)noise : 0;
+        float snr = radio ? (float)(rssi - noise) : NAN;
+        const void *col[] = { &rx_us, &ts_us, &b, &q, &d, &rs, &nf, &snr };
+        csi_rec_append(rec, CSI_REC_QUEUE, 1, col);
+    }
+    return 0;
+}
+
+static void put_line(csi_ring_t *r, char *s, uint64_t rx_us) {
+    int rv, kind;
+
+    if (s[0] == '\0') return;
+    if (s[0] >= '0' && s[0] <= '9') {
+        kind = CSI_RING_FRAMES;
+        rv = put_frame(r, s, rx_us);
+    } else if (s[0] == 'V' && s[1] == ',') {
+        kind = CSI_RING_VAR;
+        rv = put_var(r, s + 2, rx_us);
+    } else if (s[0] == 'Q' && s[1] == ',') {
+        kind = CSI_RING_QUEUE;
+        rv = put_queue(r, s + 2, rx_us);
+    } else {
+        skipped++;
+        return;
+    }
+    if (rv < 0) bad++;
+    else records[kind]++;
+}
+
+// Hand every complete line of buf[0..len) to the ring. Returns the bytes
+// of the trailing partial line, moved to the front of buf.
+static size_t put_lines(csi_ring_t *r, char *buf, size_t len, uint64_t rx_us) {
+    char *line = buf, *end = buf + len, *nl;
+
+    while ((nl = memchr(line, '\n', end - line)) != NULL) {
+        *nl = '\0';
+        if (nl > line && nl[-1] == '\r') nl[-1] = '\0';
+        put_line(r, line, rx_us);
+        line = nl + 1;
+    }
+    memmove(buf, line, end - line);
+    return end - line;
+}
+
+static void print_usage(const char *program_name) {
+    printf("Usage: %s [options]\n", program_name);
+    printf("Options:\n");
+    printf("  -p port        TCP and UDP port to receive csi_analyzer output on (default: %d)\n", DATA_PORT);
+    printf("  -n name        Shared-memory segment, /dev/shm/<name> (default: csi_ring)\n");
+    printf("  -s slots       Records per ring, power of two (default: 4096)\n");
+    printf("  -k             Keep the segment when exiting\n");
+    printf("  -r file        Also record every frame, variance and queue sample to a session file\n");
+    printf("  -h             Show this help\n");
+}
+
+int main(int argc, char **argv) {
+    int port = DATA_PORT;
+    const char *name = "csi_ring";
+    long slots = 4096;
+    int keep = 0;
+    const char *rec_path = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "p:n:s:kr:h")) != -1) {
+        switch (opt) {
+            case 'p':
+                port = atoi(optarg);
+                if (port < 1 || port > 65535) {
+                    fprintf(stderr, "Error: Port must be 1-65535\n");
+                    return 1;
+                }
+                break;
+            case 'n':
+                name = optarg;
+                break;
+            case 's':
+                slots = atol(optarg);
+                break;
+            case 'k':
+                keep = 1;
+                break;
+            case 'r':
+                rec_path = optarg;
+                break;
+            case 'h':
+                print_usage(argv[0]);
+                return 0;
+            default:
+                print_usage(argv[0]);
+                return 1;
+        }
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = INADDR_ANY;
+    addr.sin_port = htons(port);
+    int one = 1;
+
+    int listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+    int udp_fd = socket(AF_INET, SOCK_DGRAM, 0);
+    if (listen_fd < 0 || udp_fd < 0) { perror("socket"); return 1; }
+    setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    setsockopt(udp_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    if (bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0 ||
+        bind(udp_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("bind");
+        return 1;
+    }
+    if (listen(listen_fd, 1) < 0) { perror("listen"); return 1; }
+
+    static csi_ring_t ring;
+    if (csi_ring_create(&ring, name, (uint32_t)(slots > 0 ? slots : 0)) < 0) return 1;
+    if (rec_path && (rec = csi_rec_open(rec_path)) == NULL) {
+        csi_ring_close(&ring, 1);
+        return 1;
+    }
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = handle_signal;
+    sigaction(SIGINT, &sa, NULL);
+    sigaction(SIGTERM, &sa, NULL);
+
+    printf("Receiving csi_analyzer output on TCP/UDP port %d\n", port);
+    printf("Writing /dev/shm%s: %ld records per ring, %zu bytes\n", ring.name, slots, ring.size);
+    if (rec) printf("Recording to %s\n", rec_path);
+
+    static char buf[LINE_BUF];
+    size_t buf_len = 0;
+    int conn_fd = -1;
+
+    while (running) {
+        struct pollfd pfd[3] = {
+            { .fd = listen_fd, .events = POLLIN },
+            { .fd = udp_fd,    .events = POLLIN },
+            { .fd = conn_fd,   .events = POLLIN },
+        };
+        if (poll(pfd, conn_fd >= 0 ? 3 : 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            perror("poll");
+            break;
+        }
+
+        // A new csi_analyzer connection replaces the old one
+        if (pfd[0].revents & POLLIN) {
+            struct sockaddr_in peer;
+            socklen_t peer_len = sizeof(peer);
+            int fd = accept(listen_fd, (struct sockaddr *)&peer, &peer_len);
+            if (fd >= 0) {
+                if (conn_fd >= 0) close(conn_fd);
+                conn_fd = fd;
+                buf_len = 0;
+                printf("Connected: %s\n", inet_ntoa(peer.sin_addr));
+            }
+            continue;
+        }
+
+        if (pfd[1].revents & POLLIN) {
+            static char dgram[LINE_BUF];
+            ssize_t n = recv(udp_fd, dgram, sizeof(dgram) - 1, 0);
+            if (n > 0) {
+                // A datagram is whole lines; the last may lack its newline
+                if (dgram[n - 1] != '\n') dgram[n++] = '\n';
+                put_lines(&ring, dgram, n, realtime_us());
+            }
+        }
+
+        if (conn_fd >= 0 && (pfd[2].revents & (POLLIN | POLLHUP | POLLERR))) {
+            ssize_t n = recv(conn_fd, buf + buf_len, sizeof(buf) - buf_len, 0);
+            if (n <= 0) {
+                if (n < 0 && errno == EINTR) continue;
+                printf("Disconnected\n");
+                close(conn_fd);
+                conn_fd = -1;
+                buf_len = 0;
+                continue;
+            }
+            buf_len = put_lines(&ring, buf, buf_len + n, realtime_us());
+            // No newline in a full buffer: not our stream, start over
+            if (buf_len == sizeof(buf)) {
+                bad++;
+                buf_len = 0;
+            }
+        }
+    }
+
+    printf("\nRecords: %lu CSI frames, %lu variance, %lu queue; %lu skipped, %lu bad lines\n",
+           records[CSI_RING_FRAMES], records[CSI_RING_VAR], records[CSI_RING_QUEUE],
+           skipped, bad);
+    if (rec) {
+        unsigned long frames = rec->rows[CSI_REC_FRAMES];
+        if (csi_rec_close(rec) < 0) fprintf(stderr, "Error: %s is incomplete\n", rec_path);
+        else printf("Recorded %lu CSI frames to %s\n", frames, rec_path);
+    }
+    if (conn_fd >= 0) close(conn_fd);
+    close(listen_fd);
+    close(udp_fd);
+    csi_ring_close(&ring, !keep);
+    return 0;
+}
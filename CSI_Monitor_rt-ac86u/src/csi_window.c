@@ -0,0 +1,117 @@
+/* csi_window.c
+   Sliding-window amplitude / residual-phase variance (see csi_window.h).
+
+   Residual phase follows live_monitoring: subcarriers in fftshift order,
+   phase unwrapped across them and a least-squares line (CFO/SFO slope and
+   offset) removed. Guard subcarriers (zero channel) are left out of the fit
+   and out of the per-frame means.
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "csi_window.h"
+
+void csi_window_init(csi_window_t *w, int len) {
+    memset(w, 0, sizeof(*w));
+    w->len = len;
+}
+
+// amplitude and linear-detrended unwrapped phase; returns a mask of data subcarriers
+static void ampl_resid_phase(const int32_t *Hout, float *ampl, float *phase, uint8_t *data) {
+    double sk = 0, sp = 0, skk = 0, skp = 0;
+    int n = 0;
+    double prev = 0, offset = 0;
+    int have_prev = 0;
+
+    for (int k = 0; k < NFFT; k++) {
+        int i = (k + NFFT / 2) % NFFT;          // fftshift
+        double re = Hout[2*i], im = Hout[2*i+1];
+        ampl[i] = (float)sqrt(re * re + im * im);
+        data[i] = (re != 0 || im != 0);
+        if (!data[i]) { phase[i] = 0; continue; }
+
+        double p = atan2(im, re) + offset;
+        if (have_prev) {
+            while (p - prev > M_PI)  { p -= 2 * M_PI; offset -= 2 * M_PI; }
+            while (p - prev < -M_PI) { p += 2 * M_PI; offset += 2 * M_PI; }
+        }
+        prev = p;
+        have_prev = 1;
+        phase[i] = (float)p;
+
+        sk += k; sp += p; skk += (double)k * k; skp += k * p;
+        n++;
+    }
+
+    double slope = 0, icept = n ? sp / n : 0;
+    double den = n * skk - sk * sk;
+    if (n > 1 && den != 0) {
+        slope = (n * skp - sk * sp) / den;
+        icept = (sp - slope * sk) / n;
+    }
+    for (int k = 0; k < NFFT; k++) {
+        int i = (k + NFFT / 2) % NFFT;
+        if (data[i]) phase[i] -= (float)(slope * k + icept);
+    }
+}
+
+// Welford update of one (mean, m2) pair: add x, and drop y when the window is full
+static inline void welford_step(double *mean, double *m2, int n, int full, float x, float y) {
+    if (!full) {
+        double d = x - *mean;
+        *mean += d / n;
+        *m2 += d * (x - *mean);
+    } else {
+        double old_mean = *mean;
+        *mean += ((double)x - y) / n;
+        *m2 += ((double)x - y) * (x - *mean + y - old_mean);
+        if (*m2 < 0) *m2 = 0;
+    }
+}
+
+int csi_window_add(csi_window_t *w, uint16_t seq, int core, const int32_t *Hout,
+                   csi_window_stats_t *out) {
+    if (core < 0 || core >= CSI_WIN_CORES)
+        return 0;
+    csi_core_window_t *cw = &w->core[core];
+
+    float ampl[NFFT], phase[NFFT];
+    uint8_t data[NFFT];
+    ampl_resid_phase(Hout, ampl, phase, data);
+
+    int full = (cw->n == w->len);
+    if (!full) cw->n++;
+    float *old_a = cw->ampl_ring[cw->head];
+    float *old_p = cw->phase_ring[cw->head];
+
+    double ampl_var = 0, phase_var = 0;
+    int n_data = 0;
+    for (int i = 0; i < NFFT; i++) {
+        welford_step(&cw->ampl_mean[i], &cw->ampl_m2[i], cw->n, full, ampl[i], old_a[i]);
+        welford_step(&cw->phase_mean[i], &cw->phase_m2[i], cw->n, full, phase[i], old_p[i]);
+        old_a[i] = ampl[i];
+        old_p[i] = phase[i];
+        if (data[i]) {
+            ampl_var += cw->ampl_m2[i] / cw->n;
+            phase_var += cw->phase_m2[i] / cw->n;
+            n_data++;
+        }
+    }
+    cw->head = (cw->head + 1) % w->len;
+
+    if (cw->n < 2)
+        return 0;
+    out->seq = seq;
+    out->core = core;
+    out->n = cw->n;
+    out->ampl_var_mean = n_data ? (float)(ampl_var / n_data) : 0;
+    out->phase_var_mean = n_data ? (float)(phase_var / n_data) : 0;
+    return 1;
+}
+
+int csi_window_format_csv(char *msg, size_t cap, const csi_window_stats_t *s) {
+    return snprintf(msg, cap, "V,%u,%d,%d,%.6f,%.6f\n",
+                    s->seq, s->core, s->n, s->ampl_var_mean, s->phase_var_mean);
+}
@@ -0,0 +1,50 @@
+/* csi_window.h
+   Sliding-window per-subcarrier statistics of amplitude and residual phase,
+   one window per RX core. Each report updates the window in O(1) per
+   subcarrier (Welford update with ring-buffer removal of the oldest frame).
+*/
+
+#ifndef CSI_WINDOW_H
+#define CSI_WINDOW_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "csi_kernels.h"
+
+#define CSI_WIN_MAX   512       // maximum window length (frames)
+#define CSI_WIN_CORES 4
+
+typedef struct {
+    int n;                      // frames currently in the window
+    int head;                   // ring slot of the next frame
+    double ampl_mean[NFFT], ampl_m2[NFFT];
+    double phase_mean[NFFT], phase_m2[NFFT];
+    float ampl_ring[CSI_WIN_MAX][NFFT];
+    float phase_ring[CSI_WIN_MAX][NFFT];
+} csi_core_window_t;
+
+typedef struct {
+    int len;                    // configured window length
+    csi_core_window_t core[CSI_WIN_CORES];
+} csi_window_t;
+
+typedef struct {
+    uint16_t seq;
+    int core;
+    int n;                      // frames in the window
+    float ampl_var_mean;        // mean over data subcarriers of the window variance
+    float phase_var_mean;
+} csi_window_stats_t;
+
+void csi_window_init(csi_window_t *w, int len);
+
+// Push one decoded report (guards zeroed). Returns 1 and fills *out once the
+// core's window holds at least two frames.
+int csi_window_add(csi_window_t *w, uint16_t seq, int core, const int32_t *Hout,
+                   csi_window_stats_t *out);
+
+// V,seq,core,n,ampl_var_mean,phase_var_mean\n
+int csi_window_format_csv(char *msg, size_t cap, const csi_window_stats_t *s);
+
+#endif
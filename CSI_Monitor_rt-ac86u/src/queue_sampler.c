@@ -0,0 +1,207 @@
+/* queue_sampler.c
+   Queue backlog / SNR sampler (see queue_sampler.h).
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/pkt_sched.h>
+#include <linux/gen_stats.h>
+#include <linux/sockios.h>
+
+#include "csi_kernels.h"
+#include "queue_sampler.h"
+
+// Broadcom wl driver ioctl interface (wlioctl.h)
+#define WLC_GET_RSSI      127
+#define WLC_GET_PHY_NOISE 135
+
+typedef struct {
+    unsigned int cmd;
+    void *buf;
+    unsigned int len;
+    uint8_t set;
+    unsigned int used;
+    unsigned int needed;
+} wl_ioctl_t;
+
+typedef struct __attribute__((__packed__)) {
+    int32_t val;
+    uint8_t ea[6];
+} scb_val_t;
+
+int queue_sampler_open(queue_sampler_t *q, const char *ifname) {
+    memset(q, 0, sizeof(*q));
+    q->nl_fd = -1;
+    q->ioctl_fd = -1;
+    snprintf(q->ifname, sizeof(q->ifname), "%s", ifname);
+
+    q->ifindex = if_nametoindex(ifname);
+    if (!q->ifindex) { perror("if_nametoindex"); return -1; }
+
+    q->nl_fd = socket(AF_NETLINK, SOCK_RAW | SOCK_CLOEXEC, NETLINK_ROUTE);
+    if (q->nl_fd < 0) { perror("netlink socket"); return -1; }
+    struct sockaddr_nl sa = { .nl_family = AF_NETLINK };
+    if (bind(q->nl_fd, (struct sockaddr *)&sa, sizeof(sa)) < 0) {
+        perror("netlink bind");
+        queue_sampler_close(q);
+        return -1;
+    }
+
+    q->ioctl_fd = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (q->ioctl_fd < 0) {
+        perror("ioctl socket");
+        queue_sampler_close(q);
+        return -1;
+    }
+    return 0;
+}
+
+void queue_sampler_close(queue_sampler_t *q) {
+    if (q->nl_fd >= 0) close(q->nl_fd);
+    if (q->ioctl_fd >= 0) close(q->ioctl_fd);
+    q->nl_fd = q->ioctl_fd = -1;
+}
+
+void queue_sampler_set_station(queue_sampler_t *q, const uint8_t mac[6]) {
+    memcpy(q->sta_mac, mac, 6);
+    q->have_mac = 1;
+}
+
+// Queue stats from a batch of netlink replies: 0, -1 if our request
+// failed, or 1 if the batch holds no reply to it
+static int parse_qdisc(queue_sampler_t *q, char *buf, ssize_t len, queue_sample_t *out) {
+    int ours = 0;
+
+    for (struct nlmsghdr *nh = (struct nlmsghdr *)buf; NLMSG_OK(nh, (size_t)len);
+         nh = NLMSG_NEXT(nh, len)) {
+        if (nh->nlmsg_seq != q->nl_seq)
+            continue;
+        ours = 1;
+        if (nh->nlmsg_type == NLMSG_ERROR)
+            return -1;
+        if (nh->nlmsg_type != RTM_NEWQDISC)
+            continue;
+        struct tcmsg *tc = NLMSG_DATA(nh);
+        int alen = nh->nlmsg_len - NLMSG_LENGTH(sizeof(*tc));
+        for (struct rtattr *a = (struct rtattr *)((char *)tc + NLMSG_ALIGN(sizeof(*tc)));
+             RTA_OK(a, alen); a = RTA_NEXT(a, alen)) {
+            if (a->rta_type != TCA_STATS2)
+                continue;
+            int slen = RTA_PAYLOAD(a);
+            for (struct rtattr *s = RTA_DATA(a); RTA_OK(s, slen); s = RTA_NEXT(s, slen)) {
+                if (s->rta_type == TCA_STATS_QUEUE &&
+                    RTA_PAYLOAD(s) >= sizeof(struct gnet_stats_queue)) {
+                    struct gnet_stats_queue qs;
+                    memcpy(&qs, RTA_DATA(s), sizeof(qs));
+                    out->backlog = qs.backlog;
+                    out->qlen = qs.qlen;
+                    out->drops = qs.drops;
+                    return 0;
+                }
+            }
+        }
+    }
+    // Our reply without queue stats
+    return ours ? -1 : 1;
+}
+
+// Root qdisc of the interface: a single RTM_GETQDISC get (not a dump)
+static int read_qdisc(queue_sampler_t *q, queue_sample_t *out) {
+    struct {
+        struct nlmsghdr nh;
+        struct tcmsg tc;
+    } req;
+    memset(&req, 0, sizeof(req));
+    req.nh.nlmsg_len = NLMSG_LENGTH(sizeof(struct tcmsg));
+    req.nh.nlmsg_type = RTM_GETQDISC;
+    req.nh.nlmsg_flags = NLM_F_REQUEST | NLM_F_ECHO;     // get replies only with ECHO
+    req.nh.nlmsg_seq = ++q->nl_seq;
+    req.tc.tcm_family = AF_UNSPEC;
+    req.tc.tcm_ifindex = q->ifindex;
+    req.tc.tcm_parent = TC_H_ROOT;
+
+    // Replies that missed an earlier deadline would otherwise be read as
+    // this request's
+    char buf[8192];
+    while (recv(q->nl_fd, buf, sizeof(buf), MSG_DONTWAIT) > 0)
+        ;
+
+    if (send(q->nl_fd, &req, req.nh.nlmsg_len, 0) < 0)
+        return -1;
+
+    // Wait for our reply, skipping stale ones, for at most the deadline;
+    // a missing reply must not stall the CSI loop
+    uint64_t deadline = csi_clock_us() + QUEUE_SAMPLER_NL_TIMEOUT_US;
+    for (;;) {
+        uint64_t now = csi_clock_us();
+        if (now >= deadline)
+            return -1;
+        struct pollfd pfd = { .fd = q->nl_fd, .events = POLLIN };
+        int rv = poll(&pfd, 1, (int)((deadline - now + 999) / 1000));
+        if (rv < 0 && errno != EINTR)
+            return -1;
+        if (rv <= 0)
+            continue;
+
+        ssize_t len = recv(q->nl_fd, buf, sizeof(buf), MSG_DONTWAIT);
+        if (len < 0) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)
+                continue;
+            return -1;
+        }
+        rv = parse_qdisc(q, buf, len, out);
+        if (rv != 1)
+            return rv;
+    }
+}
+
+static int wl_ioctl(queue_sampler_t *q, unsigned int cmd, void *buf, unsigned int len) {
+    wl_ioctl_t ioc = { .cmd = cmd, .buf = buf, .len = len, .set = 0 };
+    struct ifreq ifr;
+    memset(&ifr, 0, sizeof(ifr));
+    snprintf(ifr.ifr_name, sizeof(ifr.ifr_name), "%s", q->ifname);
+    ifr.ifr_data = (void *)&ioc;
+    return ioctl(q->ioctl_fd, SIOCDEVPRIVATE, &ifr);
+}
+
+int queue_sampler_read(queue_sampler_t *q, queue_sample_t *out) {
+    memset(out, 0, sizeof(*out));
+    out->ts_us = csi_clock_us();
+
+    if (read_qdisc(q, out) < 0) {
+        q->errors++;
+        return -1;
+    }
+
+    if (q->have_mac) {
+        scb_val_t scb;
+        int32_t noise = 0;
+        memset(&scb, 0, sizeof(scb));
+        memcpy(scb.ea, q->sta_mac, 6);
+        if (wl_ioctl(q, WLC_GET_RSSI, &scb, sizeof(scb)) == 0 &&
+            wl_ioctl(q, WLC_GET_PHY_NOISE, &noise, sizeof(noise)) == 0) {
+            out->rssi = scb.val;
+            out->noise = noise;
+            out->have_radio = 1;
+        }
+    }
+
+    q->samples++;
+    return 0;
+}
+
+int queue_sample_format_csv(char *msg, size_t cap, const queue_sample_t *s) {
+    if (s->have_radio)
+        return snprintf(msg, cap, "Q,%llu,%u,%u,%u,%d,%d,%d\n",
+                        (unsigned long long)s->ts_us, s->backlog, s->qlen, s->drops,
+                        s->rssi, s->noise, s->rssi - s->noise);
+    return snprintf(msg, cap, "Q,%llu,%u,%u,%u,,,\n",
+                    (unsigned long long)s->ts_us, s->backlog, s->qlen, s->drops);
+}
@@ -0,0 +1,55 @@
+/* queue_sampler.h
+   Samples the Wi-Fi interface's queue backlog (root qdisc stats over
+   rtnetlink) and the station's RSSI / noise floor (Broadcom wl ioctls).
+   One sample is a single netlink request/response plus two ioctls, cheap
+   enough to run from a timerfd at up to 1 kHz in the csi_analyzer loop.
+   The read waits for the netlink reply in that loop, so a stalled reply
+   delays CSI by up to QUEUE_SAMPLER_NL_TIMEOUT_US; the sample is then
+   dropped, and a reply that arrives late is discarded by the next one.
+*/
+
+#ifndef QUEUE_SAMPLER_H
+#define QUEUE_SAMPLER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <net/if.h>
+
+#define QUEUE_SAMPLER_MAX_HZ 1000
+#define QUEUE_SAMPLER_NL_TIMEOUT_US 10000
+
+typedef struct {
+    int nl_fd;
+    int ioctl_fd;
+    int ifindex;
+    char ifname[IFNAMSIZ];
+    uint32_t nl_seq;
+    uint8_t sta_mac[6];         // station for RSSI (last CSI transmitter)
+    int have_mac;
+    unsigned long samples;
+    unsigned long errors;
+} queue_sampler_t;
+
+typedef struct {
+    uint64_t ts_us;             // csi_clock_us(), same clock as CSI frames
+    uint32_t backlog;           // bytes queued in the root qdisc
+    uint32_t qlen;              // packets queued
+    uint32_t drops;
+    int32_t rssi;               // dBm, valid if have_radio
+    int32_t noise;              // dBm
+    int have_radio;
+} queue_sample_t;
+
+int queue_sampler_open(queue_sampler_t *q, const char *ifname);
+void queue_sampler_close(queue_sampler_t *q);
+
+// Station whose RSSI is reported
+void queue_sampler_set_station(queue_sampler_t *q, const uint8_t mac[6]);
+
+// Take one sample; returns 0, or -1 if the qdisc stats could not be read
+int queue_sampler_read(queue_sampler_t *q, queue_sample_t *out);
+
+// Q,ts_us,backlog,qlen,drops,rssi,noise,snr\n (radio fields empty if unavailable)
+int queue_sample_format_csv(char *msg, size_t cap, const queue_sample_t *s);
+
+#endif
@@ -0,0 +1,19 @@
+#!/bin/bash
+# Build and run the packet path benchmark on a pcap trace.
+#   ./bench.sh trace.pcap [options]   build for this host and run
+#   ./bench.sh mips                   build nfq_bench_mips with the OpenWrt SDK (run it on the router)
+# Options are passed to nfq_bench (see -h); the commit id is the default tag.
+
+SRC="nfq_bench.c nfq_pkt.c nfq_sched.c nfq_rtp.c nfq_profile.c nfq_rtt.c nfq_log.c nfq_filter.c nfq_flow.c nfq_policy.c rtcp.c"
+TAG=$(git rev-parse --short HEAD 2>/dev/null || echo none)
+
+if [ "$1" = "mips" ]; then
+    STAGING_DIR=~/openwrt-build/openwrt-sdk-24.10.3-ath79-generic_gcc-13.3.0_musl.Linux-x86_64/staging_dir
+    CC=$STAGING_DIR/toolchain-mips_24kc_gcc-13.3.0_musl/bin/mips-openwrt-linux-gcc
+    STAGING_DIR=$STAGING_DIR $CC $SRC -o nfq_bench_mips -O2 -lpthread || exit 1
+    echo "Built nfq_bench_mips; run on the router with: ./nfq_bench_mips -t $TAG trace.pcap"
+    exit 0
+fi
+
+gcc $SRC -o nfq_bench -O2 -Wall -lpthread || exit 1
+./nfq_bench -t "$TAG" "$@"
@@ -18,11 +18,12 @@ echo "Compiling nfq_dummy..."
 $CC \
     -I$TARGET/usr/include \
     -I$TARGET/include \
-    -o nfq_dummy nfq_dummy.c \
+    -o nfq_dummy nfq_dummy.c nfq_log.c nfq_filter.c nfq_flow.c nfq_policy.c nfq_ctl.c nfq_hist.c nfq_pkt.c nfq_sched.c nfq_rtp.c nfq_profile.c nfq_rtt.c rtcp.c \
     -L$TARGET/usr/lib \
     -lnetfilter_queue \
     -lnfnetlink \
-    -lmnl
+    -lmnl \
+    -lpthread
 
 if [ $? -eq 0 ]; then
     echo "Success! Binary created: nfq_dummy"
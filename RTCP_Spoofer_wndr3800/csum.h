@@ -0,0 +1,53 @@
+/* csum.h
+   Incremental Internet checksum update (RFC 1624, eqn. 3):
+   HC' = ~(~HC + ~m + m'). The one's complement sum is byte-order
+   independent, so the words are used exactly as they sit in the packet.
+*/
+
+#ifndef CSUM_H
+#define CSUM_H
+
+#include <stdint.h>
+
+static inline uint16_t csum_fold(uint32_t sum) {
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return (uint16_t)sum;
+}
+
+static inline void csum_replace4(uint16_t *check, uint32_t old_word, uint32_t new_word) {
+    uint32_t sum = (uint16_t)~*check;
+    sum += (uint16_t)~(old_word >> 16) + (uint16_t)~(old_word & 0xFFFF);
+    sum += (new_word >> 16) + (new_word & 0xFFFF);
+    *check = (uint16_t)~csum_fold(sum);
+}
+
+// Same for the UDP checksum, which may be absent (0) and must never become 0
+static inline void udp_csum_replace4(uint16_t *check, uint32_t old_word, uint32_t new_word) {
+    if (*check == 0) {
+        return;
+    }
+    csum_replace4(check, old_word, new_word);
+    if (*check == 0) {
+        *check = 0xFFFF;
+    }
+}
+
+static inline void csum_replace2(uint16_t *check, uint16_t old_word, uint16_t new_word) {
+    uint32_t sum = (uint16_t)~*check;
+    sum += (uint16_t)~old_word + new_word;
+    *check = (uint16_t)~csum_fold(sum);
+}
+
+static inline void udp_csum_replace2(uint16_t *check, uint16_t old_word, uint16_t new_word) {
+    if (*check == 0) {
+        return;
+    }
+    csum_replace2(check, old_word, new_word);
+    if (*check == 0) {
+        *check = 0xFFFF;
+    }
+}
+
+#endif
@@ -2,4 +2,24 @@
 iptables -t mangle -I PREROUTING -i wlan0 -j NFQUEUE --queue-num 0
 
 #remove rule
-iptables -t mangle -D PREROUTING -i wlan0 -j NFQUEUE --queue-num 0
\ No newline at end of file
+iptables -t mangle -D PREROUTING -i wlan0 -j NFQUEUE --queue-num 0
+
+# multi-queue: spread flows over queues 0-1, one nfq_dummy worker each
+# (run as: nfq_dummy -P 0:1); --queue-bypass accepts if nobody is listening
+#iptables -t mangle -I PREROUTING -i wlan0 -j NFQUEUE --queue-balance 0:1 --queue-bypass
+#iptables -t mangle -D PREROUTING -i wlan0 -j NFQUEUE --queue-balance 0:1 --queue-bypass
+
+# RTCP only (what nfq_dummy -I wlan0 installs by itself): UDP whose first
+# payload word has version 2 and packet type 200-206
+#iptables -t mangle -I PREROUTING -i wlan0 -p udp -m u32 --u32 "6&0xFF=0x11 && 4&0x1FFF=0 && 0>>22&0x3C@8>>16&0xC0FF=0x80C8:0x80CE" -j NFQUEUE --queue-num 0 --queue-bypass
+
+# RTT from LSR/DLSR needs the SRs that the RRs answer, which come in from
+# the WAN side: queue RTCP arriving there too (eth1 is the WNDR3800's WAN port)
+#iptables -t mangle -I PREROUTING -i eth1 -p udp -m u32 --u32 "6&0xFF=0x11 && 4&0x1FFF=0 && 0>>22&0x3C@8>>16&0xC0FF=0x80C8:0x80CE" -j NFQUEUE --queue-num 0 --queue-bypass
+
+# flow bypass (nfq_dummy -B N): restore the connmark before the queue rule,
+# skip the queue for marked flows, and save the mark set by the verdict
+#iptables -t mangle -I PREROUTING 1 -i wlan0 -j CONNMARK --restore-mark --nfmask 0x100000 --ctmask 0x100000
+#iptables -t mangle -I PREROUTING 2 -i wlan0 -m mark --mark 0x100000/0x100000 -j RETURN
+#iptables -t mangle -A FORWARD -m mark --mark 0x100000/0x100000 -j CONNMARK --save-mark --nfmask 0x100000 --ctmask 0x100000
+#iptables -t mangle -A INPUT -m mark --mark 0x100000/0x100000 -j CONNMARK --save-mark --nfmask 0x100000 --ctmask 0x100000
@@ -0,0 +1,94 @@
+#!/usr/bin/env python3
+# mkprofile.py
+# Build an impairment profile for nfq_dummy -F from CSV (format in nfq_profile.h).
+#
+# Input lines: time_ms,ssrc,jitter,fraction_lost
+#   ssrc is decimal, 0x hex or * (every stream without its own entry)
+#   jitter "-" releases the selector back to the policy rules
+#   blank lines and lines starting with # are ignored
+# Only changes need to be listed: every step the file gets repeats the
+# values still in force for each selector.
+#
+# Usage: mkprofile.py [--loop MS] profile.csv profile.bin
+
+import argparse
+import struct
+import sys
+
+ANY_SSRC = 0x01
+PASS = 0x02
+
+
+def parse(path):
+    rows = []
+    with open(path) as f:
+        for n, line in enumerate(f, 1):
+            line = line.strip()
+            if not line or line.startswith('#'):
+                continue
+            fields = [x.strip() for x in line.split(',')]
+            if len(fields) != 4:
+                sys.exit(f"{path}:{n}: expected time_ms,ssrc,jitter,fraction_lost")
+            t = int(fields[0])
+            sel = None if fields[1] == '*' else int(fields[1], 0)
+            if fields[2] == '-':
+                rows.append((t, sel, None))
+                continue
+            jitter, fraction = int(fields[2]), int(fields[3])
+            if t < 0 or not 0 <= jitter < 2**32 or not 0 <= fraction <= 255:
+                sys.exit(f"{path}:{n}: value out of range")
+            rows.append((t, sel, (jitter, fraction)))
+    # Stable: later lines win within one time
+    rows.sort(key=lambda r: r[0])
+    return rows
+
+
+def steps(rows):
+    state = {}
+    out = []
+    i = 0
+    while i < len(rows):
+        t = rows[i][0]
+        while i < len(rows) and rows[i][0] == t:
+            _, sel, val = rows[i]
+            if val is None:
+                state.pop(sel, None)
+            else:
+                state[sel] = val
+            i += 1
+        # Exact SSRCs first; lookup takes the first wildcard it meets
+        for sel in sorted(state, key=lambda s: (s is None, s or 0)):
+            jitter, fraction = state[sel]
+            out.append((t, sel, jitter, fraction))
+        if not state:
+            # A step cannot be empty: everything back to the rules
+            out.append((t, None, None, None))
+    return out
+
+
+def main():
+    ap = argparse.ArgumentParser(description=__doc__)
+    ap.add_argument('--loop', type=int, default=0, metavar='MS',
+                    help='loop with this period (default: hold the last step)')
+    ap.add_argument('csv')
+    ap.add_argument('out')
+    args = ap.parse_args()
+
+    entries = steps(parse(args.csv))
+    if not entries:
+        sys.exit("no entries")
+    if args.loop and args.loop <= entries[-1][0]:
+        sys.exit("--loop must be longer than the last step's time")
+
+    with open(args.out, 'wb') as f:
+        f.write(b'RRPF' + struct.pack('!HHII', 1, 16, len(entries), args.loop))
+        for t, sel, jitter, fraction in entries:
+            flags = (ANY_SSRC if sel is None else 0) | (PASS if jitter is None else 0)
+            f.write(struct.pack('!IIIBBH', t, sel or 0, jitter or 0, fraction or 0, flags, 0))
+    print(f"{args.out}: {len(entries)} entries, "
+          f"{len(set(e[0] for e in entries))} steps, "
+          f"{'loop ' + str(args.loop) + ' ms' if args.loop else 'holds last step'}")
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,554 @@
+/* nfq_bench.c
+   Offline benchmark for the packet path (nfq_pkt.c) on a pcap trace.
+
+   Loads the IPv4 packets of a capture, runs each once through pkt_process
+   to classify it and to check every rewritten or injected packet's IP and
+   UDP checksums against a from-scratch reference, then replays each packet
+   class with warmup and repetitions and prints ns/packet and packets/sec,
+   appending one CSV row per class so runs can be compared across commits.
+
+   Needs neither root nor libnetfilter_queue; build and run with bench.sh.
+   Classic pcap only (convert pcapng with: editcap -F pcap in.pcapng out.pcap).
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+
+#include "nfq_pkt.h"
+#include "nfq_log.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define BENCH_ARCH "x86"
+#elif defined(__aarch64__)
+#define BENCH_ARCH "aarch64"
+#elif defined(__mips__)
+#define BENCH_ARCH "mips"
+#else
+#define BENCH_ARCH "other"
+#endif
+
+#define MAX_REPS 1000
+
+// pcap link types handled
+#define LINKTYPE_ETHERNET  1
+#define LINKTYPE_RAW       101
+#define LINKTYPE_LINUX_SLL 113
+#define LINKTYPE_IPV4      228
+#define LINKTYPE_LINUX_SLL2 276
+
+// IPv4 packets of the trace, back to back in one buffer
+struct trace {
+    unsigned char *data;
+    size_t size;
+    size_t *off;
+    int *len;
+    uint64_t *ts_ns;                // capture time
+    uint32_t *sec;                  // its seconds, the path's table clock
+    uint8_t *cls;                   // class from the verification pass
+    int n;
+    unsigned long skipped;          // not IPv4, or link type headers cut off
+};
+
+// pkt_source for the benchmark: counts verdicts and, in the verification
+// pass, checks checksums instead of sending anything
+struct bench_source {
+    struct pkt_source src;
+    int verify;
+    int orig_udp_ok;                // the packet's UDP checksum was right before the path ran
+    unsigned long verdicts[PKT_DROP + 1];
+    unsigned long checked;
+    unsigned long mismatches;
+    unsigned long unverifiable;     // bad checksum in the capture (TX offload)
+};
+
+// --- clocks ---
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// --- pcap ---
+static uint32_t rd32(const unsigned char *p, int swap) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return swap ? __builtin_bswap32(v) : v;
+}
+
+// Offset of the IPv4 header in a frame of the given link type, -1 if none
+static int ipv4_offset(const unsigned char *f, int len, uint32_t linktype) {
+    int off;
+    uint16_t proto;
+
+    switch (linktype) {
+        case LINKTYPE_ETHERNET:
+            off = 14;
+            if (len < off) return -1;
+            proto = (f[12] << 8) | f[13];
+            // 802.1Q / 802.1ad tags
+            while ((proto == 0x8100 || proto == 0x88A8) && len >= off + 4) {
+                proto = (f[off + 2] << 8) | f[off + 3];
+                off += 4;
+            }
+            break;
+        case LINKTYPE_LINUX_SLL:
+            off = 16;
+            if (len < off) return -1;
+            proto = (f[14] << 8) | f[15];
+            break;
+        case LINKTYPE_LINUX_SLL2:
+            off = 20;
+            if (len < off) return -1;
+            proto = (f[0] << 8) | f[1];
+            break;
+        case LINKTYPE_RAW:
+        case LINKTYPE_IPV4:
+            off = 0;
+            proto = 0x0800;
+            break;
+        default:
+            return -1;
+    }
+    if (proto != 0x0800 || len < off + 20 || (f[off] >> 4) != 4) {
+        return -1;
+    }
+    return off;
+}
+
+static int load_pcap(const char *path, struct trace *t) {
+    FILE *f = fopen(path, "rb");
+    unsigned char gh[24], rh[16];
+    int swap, nano;
+
+    if (!f) {
+        perror(path);
+        return -1;
+    }
+    if (fread(gh, 1, sizeof(gh), f) != sizeof(gh)) {
+        fprintf(stderr, "Error: %s: too short for a pcap header\n", path);
+        fclose(f);
+        return -1;
+    }
+    uint32_t magic = rd32(gh, 0);
+    if (magic == 0xA1B2C3D4 || magic == 0xA1B23C4D) {
+        swap = 0;
+        nano = magic == 0xA1B23C4D;
+    } else if (magic == 0xD4C3B2A1 || magic == 0x4D3CB2A1) {
+        swap = 1;
+        nano = magic == 0x4D3CB2A1;
+    } else {
+        fprintf(stderr, "Error: %s: not a classic pcap file (pcapng? convert with editcap -F pcap)\n",
+                path);
+        fclose(f);
+        return -1;
+    }
+    uint32_t linktype = rd32(gh + 20, swap) & 0xFFFF;
+
+    fseek(f, 0, SEEK_END);
+    long fsize = ftell(f);
+    fseek(f, sizeof(gh), SEEK_SET);
+
+    // Every record has a 16-byte header, so this bounds the packet count
+    int max_pkts = fsize / 16 + 1;
+    t->data = malloc(fsize);
+    t->off = malloc(max_pkts * sizeof(*t->off));
+    t->len = malloc(max_pkts * sizeof(*t->len));
+    t->ts_ns = malloc(max_pkts * sizeof(*t->ts_ns));
+    t->sec = malloc(max_pkts * sizeof(*t->sec));
+    t->cls = calloc(max_pkts, 1);
+    if (!t->data || !t->off || !t->len || !t->ts_ns || !t->sec || !t->cls) {
+        perror("malloc");
+        fclose(f);
+        return -1;
+    }
+
+    static unsigned char frame[262144];
+    while (fread(rh, 1, sizeof(rh), f) == sizeof(rh)) {
+        uint32_t caplen = rd32(rh + 8, swap);
+        if (caplen > sizeof(frame) || fread(frame, 1, caplen, f) != caplen) {
+            fprintf(stderr, "Warning: %s: truncated record, stopping\n", path);
+            break;
+        }
+        int off = ipv4_offset(frame, caplen, linktype);
+        int len = (int)caplen - off;
+        if (off < 0 || len > MAX_PACKET_SIZE) {
+            t->skipped++;
+            continue;
+        }
+        // Trailing Ethernet padding is not part of the IP packet
+        int tot_len = (frame[off + 2] << 8) | frame[off + 3];
+        if (tot_len >= 20 && tot_len < len) {
+            len = tot_len;
+        }
+        memcpy(t->data + t->size, frame + off, len);
+        t->off[t->n] = t->size;
+        t->len[t->n] = len;
+        t->ts_ns[t->n] = (uint64_t)rd32(rh, swap) * 1000000000u +
+                         (uint64_t)rd32(rh + 4, swap) * (nano ? 1 : 1000);
+        t->sec[t->n] = rd32(rh, swap);
+        t->size += len;
+        t->n++;
+    }
+    fclose(f);
+    return 0;
+}
+
+// --- checksum reference ---
+// RFC 1071 one's complement sum, written apart from csum.h so a bug there
+// cannot hide itself. Big-endian 16-bit words, byte by byte; an odd
+// trailing byte is padded with zero.
+static uint32_t ref_sum(uint32_t sum, const unsigned char *p, int len) {
+    for (int i = 0; i + 1 < len; i += 2) {
+        sum += (uint32_t)p[i] << 8 | p[i + 1];
+    }
+    if (len & 1) {
+        sum += (uint32_t)p[len - 1] << 8;
+    }
+    return sum;
+}
+
+static uint16_t ref_fold(uint32_t sum) {
+    while (sum >> 16) {
+        sum = (sum & 0xFFFF) + (sum >> 16);
+    }
+    return (uint16_t)sum;
+}
+
+// A correct checksum makes the sum over the covered bytes, checksum field
+// included, all ones
+static int ip_csum_ok(const unsigned char *packet, int len) {
+    int ihl = (packet[0] & 0x0F) * 4;
+
+    if (ihl < 20 || ihl > len) {
+        return 0;
+    }
+    return ref_fold(ref_sum(0, packet, ihl)) == 0xFFFF;
+}
+
+static int udp_csum_ok(const unsigned char *packet, int len) {
+    int ihl = (packet[0] & 0x0F) * 4;
+    const unsigned char *udp = packet + ihl;
+    int udp_len;
+
+    if (ihl < 20 || ihl + 8 > len) {
+        return 0;
+    }
+    udp_len = udp[4] << 8 | udp[5];
+    if (udp[6] == 0 && udp[7] == 0) {
+        return 1;               // sender did not checksum
+    }
+    if (udp_len < 8 || ihl + udp_len > len) {
+        return 0;
+    }
+    // Pseudo-header: source and destination address, zero, protocol, UDP length
+    uint32_t sum = ref_sum(0, packet + 12, 8);
+    sum += packet[9];
+    sum += (uint32_t)udp_len;
+    return ref_fold(ref_sum(sum, udp, udp_len)) == 0xFFFF;
+}
+
+static void check_packet(struct bench_source *b, unsigned char *packet, int len) {
+    if (!b->orig_udp_ok) {
+        b->unverifiable++;
+        return;
+    }
+    b->checked++;
+    if (!ip_csum_ok(packet, len) || !udp_csum_ok(packet, len)) {
+        b->mismatches++;
+    }
+}
+
+static int bench_verdict(struct pkt_source *src, const struct pkt *p, pkt_verdict_t v) {
+    struct bench_source *b = (struct bench_source *)src;
+
+    b->verdicts[v]++;
+    if (b->verify && v == PKT_ACCEPT_MODIFIED) {
+        check_packet(b, p->data, p->len);
+    }
+    return 0;
+}
+
+static int bench_inject(struct pkt_source *src, const unsigned char *packet, int len) {
+    struct bench_source *b = (struct bench_source *)src;
+
+    if (b->verify) {
+        check_packet(b, (unsigned char *)packet, len);
+    }
+    return len;
+}
+
+// --- runs ---
+static unsigned char work[MAX_PACKET_SIZE] __attribute__((aligned(8)));
+
+static void run_one(struct pkt_path *pp, const struct live_config *cfg,
+                    const struct trace *t, int i) {
+    struct pkt p = { .data = work, .len = t->len[i], .id = i, .ts_ns = t->ts_ns[i],
+                  .now_sec = t->sec[i] };
+
+    // Like the netlink buffer on the router, the path gets its own copy
+    memcpy(work, t->data + t->off[i], p.len);
+    pkt_process(pp, cfg, &p);
+}
+
+// ns/packet of one pass over the packets of class cls (-1 = all, in order)
+static double timed_pass(struct pkt_path *pp, const struct live_config *cfg,
+                         const struct trace *t, int cls) {
+    int count = 0;
+    uint64_t t0 = now_ns();
+    for (int i = 0; i < t->n; i++) {
+        if (cls < 0 || t->cls[i] == cls) {
+            run_one(pp, cfg, t, i);
+            count++;
+        }
+    }
+    return count ? (double)(now_ns() - t0) / count : 0;
+}
+
+static int cmp_double(const void *a, const void *b) {
+    double x = *(const double *)a, y = *(const double *)b;
+    return (x > y) - (x < y);
+}
+
+void print_usage(const char *program_name) {
+    printf("Usage: %s [options] trace.pcap\n", program_name);
+    printf("Packet path options (as for nfq_dummy):\n");
+    printf("  -m mode        0=ACCEPT_ALL, 1=REPLACE, 2=BOTH, 3=REWRITE (default: 3)\n");
+    printf("  -j jitter      Fixed jitter for the default rule (default: 100)\n");
+    printf("  -l fraction    Fixed fraction lost for the default rule (default: 10)\n");
+    printf("  -p rule        Per-SSRC policy, repeatable (see nfq_dummy -h)\n");
+    printf("  -F file        Impairment profile (see nfq_dummy -h)\n");
+    printf("  -r op:bps      REMB rewrite: clamp:BPS or set:BPS\n");
+    printf("  -w op:value    TWCC rewrite: scale:PERCENT or add:TICKS\n");
+    printf("  -B packets     Flow bypass threshold (default: off)\n");
+    printf("  -M             Track RTP media streams; their statistics are printed\n");
+    printf("Benchmark options:\n");
+    printf("  -n reps        Timed repetitions per class (default: 15)\n");
+    printf("  -W warmup      Warmup passes per class (default: 2)\n");
+    printf("  -o file        Append CSV results to file (default: nfq_bench_results.csv)\n");
+    printf("  -t tag         Label stored with each row, e.g. a commit id (default: none)\n");
+    printf("  -h             Show this help\n");
+}
+
+int main(int argc, char **argv) {
+    static struct live_config cfg;
+    static struct trace trace;
+    struct bench_source bs = { .src = { bench_verdict, bench_inject } };
+    struct pkt_path path = { .src = &bs.src };
+    const char *policy_specs[POLICY_MAX_RULES];
+    int n_specs = 0;
+    uint32_t jitter = 100, fraction = 10;
+    int reps = 15, warmup = 2, track_rtp = 0;
+    const char *out_path = "nfq_bench_results.csv";
+    const char *tag = "none";
+    const char *profile_path = NULL;
+    int opt;
+
+    cfg.mode = MODE_REWRITE;
+    while ((opt = getopt(argc, argv, "m:j:l:p:F:r:w:B:Mn:W:o:t:h")) != -1) {
+        switch (opt) {
+            case 'm':
+                cfg.mode = atoi(optarg);
+                if (cfg.mode < 0 || cfg.mode > 3) {
+                    fprintf(stderr, "Error: Mode must be 0, 1, 2, or 3\n");
+                    return 1;
+                }
+                break;
+            case 'j':
+                jitter = atoi(optarg);
+                break;
+            case 'l':
+                fraction = atoi(optarg);
+                if (fraction > 255) {
+                    fprintf(stderr, "Error: Fraction lost must be 0-255\n");
+                    return 1;
+                }
+                break;
+            case 'p':
+                if (n_specs == POLICY_MAX_RULES) {
+                    fprintf(stderr, "Error: At most %d policy rules\n", POLICY_MAX_RULES);
+                    return 1;
+                }
+                policy_specs[n_specs++] = optarg;
+                break;
+            case 'F':
+                profile_path = optarg;
+                break;
+            case 'r':
+                if (feedback_parse_remb(&cfg.fb, optarg) < 0) {
+                    return 1;
+                }
+                break;
+            case 'w':
+                if (feedback_parse_twcc(&cfg.fb, optarg) < 0) {
+                    return 1;
+                }
+                break;
+            case 'B':
+                path.bypass_after = atoi(optarg);
+                if (path.bypass_after < 1 || path.bypass_after > 65535) {
+                    fprintf(stderr, "Error: Bypass threshold must be 1-65535\n");
+                    return 1;
+                }
+                break;
+            case 'M':
+                track_rtp = 1;
+                break;
+            case 'n':
+                reps = atoi(optarg);
+                break;
+            case 'W':
+                warmup = atoi(optarg);
+                break;
+            case 'o':
+                out_path = optarg;
+                break;
+            case 't':
+                tag = optarg;
+                break;
+            case 'h':
+                print_usage(argv[0]);
+                return 0;
+            default:
+                print_usage(argv[0]);
+                return 1;
+        }
+    }
+    if (optind != argc - 1) {
+        print_usage(argv[0]);
+        return 1;
+    }
+    if (reps < 1 || reps > MAX_REPS || warmup < 0) {
+        fprintf(stderr, "Error: reps must be 1-%d, warmup >= 0\n", MAX_REPS);
+        return 1;
+    }
+
+    struct policy_rule def = { .any_ssrc = 1, .mode = POLICY_FIXED,
+                               .jitter = jitter, .fraction_lost = fraction };
+    policy_set_rule(&cfg.rules, &def);
+    for (int i = 0; i < n_specs; i++) {
+        if (policy_add_rule(&cfg.rules, policy_specs[i]) < 0) {
+            return 1;
+        }
+    }
+
+    if (profile_path && !(cfg.rules.profile = profile_open(profile_path))) {
+        return 1;
+    }
+
+    // The path logs nothing below error level here, so its cost is not measured
+    log_level = LOG_LVL_ERROR;
+    path.policies = policy_table_create();
+    path.flows = flow_table_create();
+    if (track_rtp) {
+        path.rtp = rtp_table_create();
+    }
+    path.rtt = rtt_table_create();
+    if (!path.policies || !path.rtt || !path.flows ||
+        (track_rtp && !path.rtp)) {
+        perror("calloc");
+        return 1;
+    }
+
+    if (load_pcap(argv[optind], &trace) < 0) {
+        return 1;
+    }
+    if (trace.n == 0) {
+        fprintf(stderr, "Error: no IPv4 packets in %s\n", argv[optind]);
+        return 1;
+    }
+
+    // Verification pass: classify every packet and check what it produced
+    bs.verify = 1;
+    unsigned long per_class[PKT_CLASSES] = { 0 };
+    for (int i = 0; i < trace.n; i++) {
+        unsigned char *orig = trace.data + trace.off[i];
+        bs.orig_udp_ok = ((struct iphdr *)orig)->protocol == IPPROTO_UDP &&
+                         udp_csum_ok(orig, trace.len[i]);
+        run_one(&path, &cfg, &trace, i);
+        trace.cls[i] = path.pkt_class;
+        per_class[path.pkt_class]++;
+    }
+    bs.verify = 0;
+
+    printf("RTCP packet path benchmark (%s, mode %d, %d packets, %d reps, tag %s)\n",
+           BENCH_ARCH, cfg.mode, trace.n, reps, tag);
+    printf("Trace: %s (%lu frames skipped: not IPv4)\n", argv[optind], trace.skipped);
+    printf("Checksums: %lu rewritten/injected packets checked, %lu mismatches",
+           bs.checked, bs.mismatches);
+    if (bs.unverifiable) {
+        printf(", %lu not checked (bad checksum in the capture, e.g. TX offload)", bs.unverifiable);
+    }
+    printf("\n");
+    printf("Flow cache: %lu hits, %lu misses, %lu uncached, %lu flows (%lu uninteresting)\n",
+           path.flows->hits, path.flows->misses, path.flows->uncached,
+           path.flows->tracked, path.flows->settled);
+    if (path.stats.rtt_samples) {
+        static char rtt_text[8192];
+        const struct rtt_table *tables[1] = { path.rtt };
+        rtt_format(rtt_text, sizeof(rtt_text), tables, 1);
+        printf("RTT: %lu samples\n%s", path.stats.rtt_samples, rtt_text);
+    }
+    // Media statistics as of the end of the trace, before the timed passes
+    // replay it
+    if (path.rtp) {
+        static char rtp_text[16384];
+        const struct rtp_table *tables[1] = { path.rtp };
+        printf("RTP: %lu packets in %d streams\n", path.stats.rtp_packets, rtp_streams(path.rtp));
+        rtp_format(rtp_text, sizeof(rtp_text), tables, 1);
+        fputs(rtp_text, stdout);
+    }
+    printf("\n");
+
+    FILE *out = fopen(out_path, "a");
+    if (!out) {
+        perror(out_path);
+        return 1;
+    }
+    if (ftell(out) == 0) {
+        fprintf(out, "tag,arch,mode,class,packets,reps,ns_per_pkt_med,ns_per_pkt_min,mpps_med\n");
+    }
+
+    printf("%-10s | %9s | %12s | %12s | %10s\n",
+           "class", "packets", "ns/pkt med", "ns/pkt min", "Mpps med");
+    printf("------------------------------------------------------------------\n");
+    static double samples[MAX_REPS];
+    for (int c = -1; c < PKT_CLASSES; c++) {
+        unsigned long count = c < 0 ? (unsigned long)trace.n : per_class[c];
+        if (count == 0) {
+            continue;
+        }
+        for (int r = 0; r < warmup; r++) {
+            timed_pass(&path, &cfg, &trace, c);
+        }
+        for (int r = 0; r < reps; r++) {
+            samples[r] = timed_pass(&path, &cfg, &trace, c);
+        }
+        qsort(samples, reps, sizeof(samples[0]), cmp_double);
+        double med = samples[reps / 2], min = samples[0];
+        const char *name = c < 0 ? "all" : pkt_class_names[c];
+
+        printf("%-10s | %9lu | %12.1f | %12.1f | %10.3f\n", name, count, med, min, 1e3 / med);
+        fprintf(out, "%s,%s,%d,%s,%lu,%d,%.1f,%.1f,%.4f\n",
+                tag, BENCH_ARCH, cfg.mode, name, count, reps, med, min, 1e3 / med);
+    }
+    fclose(out);
+    printf("\nResults appended to %s\n", out_path);
+
+    free(trace.data);
+    free(trace.off);
+    free(trace.len);
+    free(trace.ts_ns);
+    free(trace.sec);
+    free(trace.cls);
+    free(path.policies);
+    free(path.flows);
+    free(path.rtp);
+    free(path.rtt);
+    profile_close(cfg.rules.profile);
+    return bs.mismatches ? 1 : 0;
+}
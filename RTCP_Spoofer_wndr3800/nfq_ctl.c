@@ -0,0 +1,282 @@
+/* nfq_ctl.c
+   Runtime control socket (see nfq_ctl.h).
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <arpa/inet.h>
+
+#include "nfq_ctl.h"
+
+#define CTL_POLL_MS 250             // the thread checks for shutdown this often
+
+static int ctl_fd = -1;
+static char ctl_path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+static ctl_apply_fn ctl_apply;
+static ctl_stats_fn ctl_stats;
+static pthread_t ctl_thread;
+static volatile int ctl_running;
+
+static const char *const status_names[] = {
+    "ok", "protocol version mismatch", "invalid command", "no such rule",
+    "rule set full", "cannot apply"
+};
+
+// Reply header plus the CTL_GET_STATS text
+struct ctl_stats_reply {
+    struct ctl_reply r;
+    char text[CTL_STATS_MAX];
+};
+
+static void *ctl_main(void *arg) {
+    static struct ctl_stats_reply reply;
+    (void)arg;
+
+    while (ctl_running) {
+        struct ctl_msg m;
+        struct sockaddr_un from;
+        socklen_t from_len = sizeof(from);
+        ssize_t n = recvfrom(ctl_fd, &m, sizeof(m), 0, (struct sockaddr *)&from, &from_len);
+        if (n < 0) {
+            continue;                   // timeout or EINTR
+        }
+
+        struct ctl_reply *r = &reply.r;
+        size_t len = sizeof(*r);
+        memset(r, 0, sizeof(*r));
+        r->version = CTL_VERSION;
+        if (n != sizeof(m)) {
+            r->status = CTL_EINVAL;
+        } else if (m.version != CTL_VERSION) {
+            r->status = CTL_EVERSION;
+        } else if (m.cmd == CTL_GET_STATS) {
+            int text = ctl_stats ? ctl_stats(reply.text, sizeof(reply.text)) : 0;
+            if (text >= (int)sizeof(reply.text)) {
+                text = sizeof(reply.text) - 1;
+            }
+            len += text > 0 ? text : 0;
+        } else {
+            uint32_t gen = 0;
+            m.ssrc = ntohl(m.ssrc);
+            m.a = ntohl(m.a);
+            m.b = ntohl(m.b);
+            r->status = (uint8_t)ctl_apply(&m, &gen);
+            r->gen = htonl(gen);
+        }
+        // Unbound clients get no reply
+        if (from_len > sizeof(sa_family_t)) {
+            sendto(ctl_fd, &reply, len, MSG_DONTWAIT, (struct sockaddr *)&from, from_len);
+        }
+    }
+    return NULL;
+}
+
+int ctl_start(const char *path, ctl_apply_fn apply, ctl_stats_fn stats) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Error: control socket path too long\n");
+        return -1;
+    }
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+
+    ctl_fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+    if (ctl_fd < 0) {
+        perror("socket");
+        return -1;
+    }
+    unlink(path);
+    if (bind(ctl_fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("bind control socket");
+        close(ctl_fd);
+        ctl_fd = -1;
+        return -1;
+    }
+    // Commands change what goes out on the wire: root only
+    chmod(path, 0600);
+    snprintf(ctl_path, sizeof(ctl_path), "%s", path);
+
+    struct timeval tv = { .tv_sec = 0, .tv_usec = CTL_POLL_MS * 1000 };
+    setsockopt(ctl_fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    ctl_apply = apply;
+    ctl_stats = stats;
+    ctl_running = 1;
+    if (pthread_create(&ctl_thread, NULL, ctl_main, NULL) != 0) {
+        fprintf(stderr, "Error: cannot start control thread\n");
+        ctl_running = 0;
+        ctl_stop();
+        return -1;
+    }
+    return 0;
+}
+
+void ctl_stop(void) {
+    if (ctl_running) {
+        ctl_running = 0;
+        pthread_join(ctl_thread, NULL);
+    }
+    if (ctl_fd >= 0) {
+        close(ctl_fd);
+        ctl_fd = -1;
+        unlink(ctl_path);
+    }
+}
+
+static int parse_ssrc(const char *s, struct ctl_msg *m) {
+    if (strcmp(s, "*") == 0) {
+        m->flags |= CTL_F_ANY_SSRC;
+        return 0;
+    }
+    char *end;
+    m->ssrc = strtoul(s, &end, 0);
+    return (end == s || *end) ? -1 : 0;
+}
+
+static int parse_u32(const char *s, uint32_t *v) {
+    char *end;
+    long long x = strtoll(s, &end, 0);
+    if (end == s || *end || x < INT32_MIN || x > UINT32_MAX) {
+        return -1;
+    }
+    *v = (uint32_t)x;
+    return 0;
+}
+
+// Index of word in names, -1 if absent
+static int lookup_word(const char *word, const char *const *names, int n) {
+    for (int i = 0; i < n; i++) {
+        if (strcmp(word, names[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static int parse_command(int argc, char **argv, struct ctl_msg *m) {
+    static const char *const policies[] = { "pass", "fixed", "scale", "target" };
+    static const char *const remb_ops[] = { "off", "clamp", "set" };
+    static const char *const twcc_ops[] = { "off", "scale", "add" };
+    int op;
+
+    if (argc < 1) {
+        return -1;
+    }
+    const char *cmd = argv[0];
+
+    if (strcmp(cmd, "ping") == 0 && argc == 1) {
+        m->cmd = CTL_PING;
+        return 0;
+    }
+    if (strcmp(cmd, "stats") == 0 && argc == 1) {
+        m->cmd = CTL_GET_STATS;
+        return 0;
+    }
+    if (strcmp(cmd, "mode") == 0 && argc == 2) {
+        uint32_t mode;
+        m->cmd = CTL_SET_MODE;
+        if (parse_u32(argv[1], &mode) < 0 || mode > 255) {
+            return -1;
+        }
+        m->arg = (uint8_t)mode;
+        return 0;
+    }
+    if (strcmp(cmd, "rule") == 0 && argc >= 3) {
+        m->cmd = CTL_SET_RULE;
+        op = lookup_word(argv[2], policies, 4);
+        if (parse_ssrc(argv[1], m) < 0 || op < 0 || argc != (op == 0 ? 3 : 5)) {
+            return -1;
+        }
+        m->arg = (uint8_t)op;
+        if (op != 0 && (parse_u32(argv[3], &m->a) < 0 || parse_u32(argv[4], &m->b) < 0)) {
+            return -1;
+        }
+        return 0;
+    }
+    if (strcmp(cmd, "del") == 0 && argc == 2) {
+        m->cmd = CTL_DEL_RULE;
+        return parse_ssrc(argv[1], m);
+    }
+    if (strcmp(cmd, "target") == 0 && argc == 4) {
+        m->cmd = CTL_SET_TARGET;
+        if (parse_ssrc(argv[1], m) < 0 || parse_u32(argv[2], &m->a) < 0 ||
+            parse_u32(argv[3], &m->b) < 0) {
+            return -1;
+        }
+        return 0;
+    }
+    if ((strcmp(cmd, "remb") == 0 || strcmp(cmd, "twcc") == 0) && argc >= 2) {
+        int remb = cmd[0] == 'r';
+        m->cmd = remb ? CTL_SET_REMB : CTL_SET_TWCC;
+        op = lookup_word(argv[1], remb ? remb_ops : twcc_ops, 3);
+        if (op < 0 || argc != (op == 0 ? 2 : 3)) {
+            return -1;
+        }
+        m->arg = (uint8_t)op;
+        if (op != 0 && parse_u32(argv[2], &m->a) < 0) {
+            return -1;
+        }
+        return 0;
+    }
+    return -1;
+}
+
+int ctl_client(const char *path, int argc, char **argv) {
+    struct ctl_msg m;
+    static struct ctl_stats_reply reply;
+    struct ctl_reply *r = &reply.r;
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+
+    memset(&m, 0, sizeof(m));
+    m.version = CTL_VERSION;
+    if (parse_command(argc, argv, &m) < 0) {
+        fprintf(stderr, "Error: commands are: ping | stats | mode N | rule SSRC|* pass |\n"
+                        "  rule SSRC|* fixed|scale|target J F | del SSRC|* | target SSRC|* J F |\n"
+                        "  remb off | remb clamp|set BPS | twcc off | twcc scale|add VALUE\n");
+        return 1;
+    }
+    m.ssrc = htonl(m.ssrc);
+    m.a = htonl(m.a);
+    m.b = htonl(m.b);
+
+    int fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+    if (fd < 0) {
+        perror("socket");
+        return 1;
+    }
+    // Autobind to an abstract address so the server can answer
+    struct sockaddr_un self = { .sun_family = AF_UNIX };
+    bind(fd, (struct sockaddr *)&self, sizeof(sa_family_t));
+    struct timeval tv = { .tv_sec = 1, .tv_usec = 0 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+    if (sendto(fd, &m, sizeof(m), 0, (struct sockaddr *)&addr, sizeof(addr)) != sizeof(m)) {
+        fprintf(stderr, "Error: cannot reach %s: %s\n", path, strerror(errno));
+        close(fd);
+        return 1;
+    }
+    ssize_t n = recv(fd, &reply, sizeof(reply), 0);
+    close(fd);
+    if (n < (ssize_t)sizeof(*r)) {
+        fprintf(stderr, "Error: no reply from %s\n", path);
+        return 1;
+    }
+
+    if (m.cmd == CTL_GET_STATS && r->status == CTL_OK) {
+        fwrite(reply.text, 1, n - sizeof(*r), stdout);
+        return 0;
+    }
+    const char *status = r->status < sizeof(status_names) / sizeof(status_names[0]) ?
+                         status_names[r->status] : "unknown error";
+    printf("%s (generation %u)\n", status, ntohl(r->gen));
+    return r->status == CTL_OK ? 0 : 1;
+}
@@ -0,0 +1,81 @@
+/* nfq_ctl.h
+   Runtime control socket.
+
+   A Unix datagram socket (-s path) takes fixed-size binary commands, applies
+   each through a callback and answers the sender with a status and the
+   configuration generation now active. The same binary is the client (-x),
+   so nothing else is needed on the router to drive it from a script.
+   CTL_GET_STATS answers with the reply header followed by a text report.
+*/
+
+#ifndef NFQ_CTL_H
+#define NFQ_CTL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define CTL_VERSION 1
+
+// Largest text payload after a CTL_GET_STATS reply header
+#define CTL_STATS_MAX 8192
+
+enum {
+    CTL_PING = 0,
+    CTL_SET_MODE,                   // arg = operation mode
+    CTL_SET_RULE,                   // ssrc/flags, arg = policy mode, a = jitter, b = fraction
+    CTL_DEL_RULE,                   // ssrc/flags
+    CTL_SET_TARGET,                 // ssrc/flags, a = jitter, b = fraction
+    CTL_SET_REMB,                   // arg = 0 off, 1 clamp, 2 set; a = bits/s
+    CTL_SET_TWCC,                   // arg = 0 off, 1 scale, 2 add; a = value (int32)
+    CTL_GET_STATS                   // counters and latency histograms, as text
+};
+
+#define CTL_F_ANY_SSRC 0x01         // rule/target is the wildcard, ssrc ignored
+
+// Replies
+enum {
+    CTL_OK = 0,
+    CTL_EVERSION,                   // unknown protocol version
+    CTL_EINVAL,                     // bad command or argument
+    CTL_ENOENT,                     // no such rule
+    CTL_EFULL,                      // rule set full
+    CTL_EFAIL                       // could not be applied (e.g. raw socket)
+};
+
+// Multi-byte fields are in network byte order on the wire
+struct ctl_msg {
+    uint8_t version;
+    uint8_t cmd;
+    uint8_t flags;
+    uint8_t arg;
+    uint32_t ssrc;
+    uint32_t a;
+    uint32_t b;
+};
+
+struct ctl_reply {
+    uint8_t version;
+    uint8_t status;
+    uint16_t reserved;
+    uint32_t gen;                   // configuration generation after the command
+};
+
+// Apply one command (fields in host order), set *gen, return a CTL_* status.
+// Runs on the control thread.
+typedef int (*ctl_apply_fn)(const struct ctl_msg *m, uint32_t *gen);
+
+// Write the stats report into buf (at most cap bytes, NUL-terminated) and
+// return its length. Runs on the control thread.
+typedef int (*ctl_stats_fn)(char *buf, size_t cap);
+
+// Bind path (replacing a stale socket) and serve it from its own thread
+int ctl_start(const char *path, ctl_apply_fn apply, ctl_stats_fn stats);
+
+// Stop the thread and remove the socket
+void ctl_stop(void);
+
+// Client: build a command from words ("mode 3", "rule 0x1234 fixed 200 30",
+// "stats", ...), send it to path and print the reply. Returns a process exit code.
+int ctl_client(const char *path, int argc, char **argv);
+
+#endif
@@ -1,5 +1,7 @@
+#define _GNU_SOURCE            // CPU_SET / sched_setaffinity
 #include <stdio.h>
 #include <stdlib.h>
+#include <stddef.h>
 #include <unistd.h>
 #include <string.h>
 #include <signal.h>
@@ -13,150 +15,54 @@
 #include <errno.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <linux/netlink.h>
+#include <pthread.h>
+#include <sched.h>
+#include <sys/stat.h>
 
-#define RTCP_RR   201
-#define RTCP_SR   200
-#define RTCP_SDES 202
+#include "nfq_log.h"
+#include "nfq_filter.h"
+#include "nfq_flow.h"
+#include "nfq_policy.h"
+#include "nfq_ctl.h"
+#include "nfq_hist.h"
+#include "nfq_pkt.h"
+#include "nfq_sched.h"
+#include "rtcp.h"
+
+// Room for the nfnetlink header and attributes around the copied payload
+#define NFQ_MSG_OVERHEAD 4096
+
+// Upper bound on accepted packets covered by one batch verdict
+#define VERDICT_BATCH_MAX 64
+
+// One worker thread (and nfq_handle) per queue
+#define MAX_QUEUES 16
+
+// Workers wake up this often to notice shutdown
+#define RECV_TIMEOUT_MS 250
+
+// One-line counter summary from the main loop (log level info and up)
+#define STATS_INTERVAL_SEC 10
 
 // Global flag for graceful shutdown
 static volatile int keep_running = 1;
 
-// RTCP Receiver Report structure (RFC 3550)
-struct rtcp_rr_packet {
-    uint8_t version_p_count;  // Version (2 bits) | P | RC (5 bits)
-    uint8_t packet_type;      // 201 for RR
-    uint16_t length;          // Length in 32-bit words - 1
-    uint32_t ssrc;            // SSRC of sender
-    uint32_t ssrc_1;          // SSRC of first source being reported
-    uint32_t fraction_lost;   // Fraction lost (8 bits) + Cumulative packets lost (24 bits)
-    uint32_t extended_high_seq; // Extended highest sequence number received
-    uint32_t jitter;          // Interarrival jitter
-    uint32_t lsr;             // Last SR timestamp
-    uint32_t dlsr;            // Delay since last SR
-};
-
-// Operational modes
-typedef enum {
-    MODE_ACCEPT_ALL = 0,      // Accept all real RR packets
-    MODE_REPLACE = 1,         // Drop real RR, inject fake instead
-    MODE_BOTH = 2             // Accept real RR AND inject fake (debugging)
-} operation_mode_t;
+// Raw socket for injection, opened once and reused for every fake RR
+static int raw_sockfd = -1;
 
 void signal_handler(int signum) {
     printf("\n\nReceived signal %d, shutting down gracefully...\n", signum);
     keep_running = 0;
 }
 
-// Enhanced checksum calculation with detailed debugging
-static uint16_t calculate_ip_checksum_debug(struct iphdr *iph, const char *debug_prefix) {
-    uint16_t *ip_data = (uint16_t *)iph;
-    int ip_header_len = iph->ihl * 4;
-    uint32_t sum = 0;
-    
-    printf("    %sCalculating IP checksum for %d words (%d bytes):\n", 
-           debug_prefix, ip_header_len / 2, ip_header_len);
-    
-    for (int i = 0; i < ip_header_len / 2; i++) {
-        uint16_t word = ntohs(ip_data[i]);
-        
-        // Skip the checksum field itself (word 5 in standard 20-byte header)
-        if (i == 5) {
-            printf("    %s  Word %2d: 0x%04X [checksum field - skipping]\n", debug_prefix, i, word);
-            continue;
-        }
-        
-        printf("    %s  Word %2d: 0x%04X", debug_prefix, i, word);
-        sum += word;
-        printf(" -> sum: 0x%08X", sum);
-        
-        // Handle carry
-        while (sum >> 16) {
-            sum = (sum & 0xFFFF) + (sum >> 16);
-            printf(" -> carry: 0x%08X", sum);
-        }
-        printf("\n");
-    }
-    
-    uint16_t result = ~sum;
-    printf("    %sFinal sum: 0x%08X, One's complement: 0x%04X\n", debug_prefix, sum, result);
-    return result;
-}
-
-// Calculate UDP checksum including pseudo-header
-static uint16_t calculate_udp_checksum(struct iphdr *iph, struct udphdr *udph, 
-                                      const unsigned char *payload, int payload_len) {
-    uint32_t sum = 0;
-    uint16_t *data;
-    int i;
-    
-    printf("    [UDP CHECKSUM] Calculating UDP checksum:\n");
-    
-    // Pseudo-header: source IP (2 words)
-    data = (uint16_t*)&iph->saddr;
-    sum += ntohs(data[0]);
-    sum += ntohs(data[1]);
-    printf("    [UDP CHECKSUM]   Source IP: 0x%04X + 0x%04X -> sum: 0x%08X\n", 
-           ntohs(data[0]), ntohs(data[1]), sum);
-    
-    // Pseudo-header: destination IP (2 words)
-    data = (uint16_t*)&iph->daddr;
-    sum += ntohs(data[0]);
-    sum += ntohs(data[1]);
-    printf("    [UDP CHECKSUM]   Dest IP: 0x%04X + 0x%04X -> sum: 0x%08X\n", 
-           ntohs(data[0]), ntohs(data[1]), sum);
-    
-    // Pseudo-header: protocol and UDP length
-    sum += IPPROTO_UDP;
-    sum += udph->uh_ulen;
-    printf("    [UDP CHECKSUM]   Protocol+Length: 0x%04X + 0x%04X -> sum: 0x%08X\n", 
-           IPPROTO_UDP, ntohs(udph->uh_ulen), sum);
-    
-    // UDP header (excluding checksum field)
-    sum += ntohs(udph->uh_sport);
-    sum += ntohs(udph->uh_dport);
-    sum += ntohs(udph->uh_ulen);
-    printf("    [UDP CHECKSUM]   UDP header: 0x%04X + 0x%04X + 0x%04X -> sum: 0x%08X\n", 
-           ntohs(udph->uh_sport), ntohs(udph->uh_dport), ntohs(udph->uh_ulen), sum);
-    
-    // UDP payload
-    data = (uint16_t*)payload;
-    for (i = 0; i < payload_len / 2; i++) {
-        uint16_t word = ntohs(data[i]);
-        sum += word;
-        printf("    [UDP CHECKSUM]   Payload word %d: 0x%04X -> sum: 0x%08X\n", i, word, sum);
-        
-        // Handle carry
-        while (sum >> 16) {
-            sum = (sum & 0xFFFF) + (sum >> 16);
-            printf("    [UDP CHECKSUM]     -> carry: 0x%08X\n", sum);
-        }
-    }
-    
-    // If payload length is odd, add the last byte
-    if (payload_len % 2) {
-        uint16_t last_byte = ((uint16_t)payload[payload_len - 1]) << 8;
-        sum += last_byte;
-        printf("    [UDP CHECKSUM]   Last byte: 0x%04X -> sum: 0x%08X\n", last_byte, sum);
-        
-        while (sum >> 16) {
-            sum = (sum & 0xFFFF) + (sum >> 16);
-            printf("    [UDP CHECKSUM]     -> carry: 0x%08X\n", sum);
-        }
+// Open the injection socket (no-op if already open)
+static int open_raw_socket(void) {
+    if (raw_sockfd >= 0) {
+        return 0;
     }
     
-    uint16_t result = ~sum;
-    printf("    [UDP CHECKSUM] Final sum: 0x%08X, One's complement: 0x%04X\n", sum, result);
-    return result;
-}
-
-// Send packet using raw socket
-static int send_raw_packet(const unsigned char *packet_data, int packet_len) {
-    int sockfd;
-    struct sockaddr_in dest_addr;
-    int bytes_sent;
-    
-    // Create raw socket
-    sockfd = socket(AF_INET, SOCK_RAW, IPPROTO_RAW);
+    int sockfd = socket(AF_INET, SOCK_RAW, IPPROTO_RAW);
     if (sockfd < 0) {
         perror("socket");
         return -1;
@@ -170,6 +76,26 @@ static int send_raw_packet(const unsigned char *packet_data, int packet_len) {
         return -1;
     }
     
+    raw_sockfd = sockfd;
+    return 0;
+}
+
+static void close_raw_socket(void) {
+    if (raw_sockfd >= 0) {
+        close(raw_sockfd);
+        raw_sockfd = -1;
+    }
+}
+
+// Send packet using the shared raw socket
+static int send_raw_packet(const unsigned char *packet_data, int packet_len) {
+    struct sockaddr_in dest_addr;
+    int bytes_sent;
+    
+    if (open_raw_socket() < 0) {
+        return -1;
+    }
+    
     // Set up destination address
     struct iphdr *iph = (struct iphdr *)packet_data;
     memset(&dest_addr, 0, sizeof(dest_addr));
@@ -177,457 +103,1027 @@ static int send_raw_packet(const unsigned char *packet_data, int packet_len) {
     dest_addr.sin_addr.s_addr = iph->daddr;
     
     // Send the packet
-    bytes_sent = sendto(sockfd, packet_data, packet_len, 0,
+    bytes_sent = sendto(raw_sockfd, packet_data, packet_len, 0,
                        (struct sockaddr *)&dest_addr, sizeof(dest_addr));
     
-    close(sockfd);
-    
     if (bytes_sent < 0) {
-        perror("sendto");
+        LOG_WARN("sendto failed: errno %d\n", errno);
         return -1;
     }
     
     return bytes_sent;
 }
 
-// Print detailed RTCP RR information
-static void print_rtcp_rr_details(const unsigned char *rtcp_data, int rtcp_len, const char *prefix) {
-    if (rtcp_len < 32) {
-        printf("    %s[WARN] RTCP packet too short for full RR (%d bytes)\n", prefix, rtcp_len);
-        return;
+static struct live_config *live;
+static uint32_t live_gen;
+
+// The snapshot for this packet; valid until the worker's next quiescent point
+static inline const struct live_config *live_get(void) {
+    return __atomic_load_n(&live, __ATOMIC_ACQUIRE);
+}
+
+// Per-queue worker. Everything the packet path writes lives here, so workers
+// never share a cache line; aligned to keep neighbours in the array apart.
+struct worker {
+    int queue_num;
+    int cpu;                    // CPU to pin to, -1 = no pinning
+    pthread_t thread;
+    struct nfq_handle *h;
+    struct nfq_q_handle *qh;
+    int fd;
+    char *buf;
+    size_t buf_size;
+    
+    // Accepted-but-not-yet-verdicted run (batch mode)
+    uint32_t batch_last_id;
+    int batch_pending;
+    
+    // The packet path, fed by this queue through src
+    struct pkt_source src;
+    struct pkt_path path;
+    
+    // Quiescent-state tracking for live_publish: live_gen as last seen by
+    // the worker outside any callback, and whether the thread is running
+    uint32_t qs_gen;
+    int active;
+    
+    // Latency telemetry: receive time of the message being handled and
+    // per-class (path.pkt_class) histograms of receive-to-verdict time and
+    // of time spent in the kernel queue
+    uint64_t t_recv_ns;         // CLOCK_MONOTONIC
+    uint32_t t_recv_sec;        // its seconds (flow cache aging)
+    int64_t t_recv_real_us;     // CLOCK_REALTIME, to compare with NFQA_TIMESTAMP
+    struct hist verdict_hist[PKT_CLASSES];
+    struct hist queue_hist[PKT_CLASSES];
+} __attribute__((aligned(64)));
+
+// Global configuration, written before the workers start and read-only after
+static struct {
+    uint32_t fixed_jitter;
+    uint32_t fixed_fraction_lost;
+    int batch_verdicts;         // accept non-RR runs with one batch verdict
+    uint32_t copy_range;        // bytes of each packet copied to userspace
+    uint32_t queue_maxlen;      // kernel queue length, 0 = kernel default
+    int fail_open;              // accept instead of drop when the queue is full
+    int rcvbuf_size;            // netlink socket receive buffer
+    const char *filter_iface;   // install the RTCP pre-filter for this interface
+    int bypass_after;           // mark flows after this many non-WebRTC packets, 0 = off
+    filter_backend_t filter_backend;
+    const char *target_file;    // TARGET policy values, reloaded when it changes
+    const char *ctl_path;       // control socket, NULL = none
+    int synthetic_ms;           // synthetic RR interval after changes, 0 = off
+    int track_rtp;              // passive RTP media statistics
+    const char *profile_path;   // recorded impairment profile, NULL = none
+} config = {
+    .fixed_jitter = 100,        // Default fixed jitter value
+    .fixed_fraction_lost = 10,  // Default fixed fraction lost (10/256 ≈ 3.9%)
+    .batch_verdicts = 0,
+    .copy_range = MAX_PACKET_SIZE,
+    .queue_maxlen = 0,
+    .fail_open = 1,
+    .rcvbuf_size = 1024 * 1024,
+    .filter_iface = NULL,
+    .bypass_after = 0,
+    .filter_backend = FILTER_IPTABLES,
+    .target_file = NULL,
+    .ctl_path = NULL,
+    .synthetic_ms = 0,
+    .track_rtp = 0,
+    .profile_path = NULL
+};
+
+static struct worker workers[MAX_QUEUES];
+// Every worker's RTT table; an SR and the RRs answering it may be queued
+// to different workers
+static struct rtt_table *rtt_tables[MAX_QUEUES];
+static int num_workers;
+
+// Serialises writers (control thread, -t reloads); readers never take it
+static pthread_mutex_t live_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Replaced snapshots waiting for every worker to pass a quiescent point
+#define LIVE_RETIRED_MAX 16
+static struct live_config *retired[LIVE_RETIRED_MAX];
+static int n_retired;
+
+// Has every running worker seen generation gen at a quiescent point?
+static int live_quiescent(uint32_t gen) {
+    for (int i = 0; i < num_workers; i++) {
+        if (__atomic_load_n(&workers[i].active, __ATOMIC_ACQUIRE) &&
+            (int32_t)(__atomic_load_n(&workers[i].qs_gen, __ATOMIC_ACQUIRE) - gen) < 0) {
+            return 0;
+        }
     }
-    
-    struct rtcp_rr_packet *rr = (struct rtcp_rr_packet *)rtcp_data;
-    
-    uint8_t version = (rr->version_p_count >> 6) & 0x03;
-    uint8_t padding = (rr->version_p_count >> 5) & 0x01;
-    uint8_t rc = rr->version_p_count & 0x1F;
-    uint16_t length = ntohs(rr->length);
-    
-    // Convert network byte order to host byte order for decimal display
-    uint32_t sender_ssrc = ntohl(rr->ssrc);
-    uint32_t source_ssrc = ntohl(rr->ssrc_1);
-    uint32_t extended_seq = ntohl(rr->extended_high_seq);
-    uint32_t jitter = ntohl(rr->jitter);
-    uint32_t lsr = ntohl(rr->lsr);
-    uint32_t dlsr = ntohl(rr->dlsr);
-    
-    printf("    %sRTCP RR Details:\n", prefix);
-    printf("    %s  Version: %u, Padding: %u, Report Count: %u\n", prefix, version, padding, rc);
-    printf("    %s  Packet Type: %u (Receiver Report)\n", prefix, rr->packet_type);
-    printf("    %s  Length: %u (in 32-bit words - 1)\n", prefix, length);
-    printf("    %s  Sender SSRC: %u (0x%08X)\n", prefix, sender_ssrc, sender_ssrc);
-    printf("    %s  Source SSRC: %u (0x%08X)\n", prefix, source_ssrc, source_ssrc);
-    
-    // Parse fraction lost and cumulative lost
-    uint32_t fraction_lost = ntohl(rr->fraction_lost);
-    uint8_t fraction = (fraction_lost >> 24) & 0xFF;
-    uint32_t cumulative_lost = fraction_lost & 0xFFFFFF;
-    // Convert from 24-bit signed to 32-bit signed
-    if (cumulative_lost & 0x800000) {
-        cumulative_lost |= 0xFF000000;
-    }
-    
-    printf("    %s  Fraction Lost: %u/256 (%u%%)\n", prefix, fraction, (fraction * 100) / 256);
-    printf("    %s  Cumulative Packets Lost: %d\n", prefix, (int32_t)cumulative_lost);
-    printf("    %s  Extended Highest Seq: %u\n", prefix, extended_seq);
-    printf("    %s  Jitter: %u\n", prefix, jitter);
-    printf("    %s  Last SR Timestamp: %u (0x%08X)\n", prefix, lsr, lsr);
-    printf("    %s  Delay Since Last SR: %u units\n", prefix, dlsr);
-}
-
-// Test function to verify packet integrity
-static void verify_packet_integrity(const unsigned char *packet, int len, const char *label) {
-    struct iphdr *iph = (struct iphdr *)packet;
-    int ip_header_len = iph->ihl * 4;
-    
-    printf("    [VERIFY %s]\n", label);
-    printf("    IP Version: %d, IHL: %d, Total Length: %d\n", 
-           iph->version, iph->ihl, ntohs(iph->tot_len));
-    printf("    Protocol: %d, Checksum: 0x%04X\n", iph->protocol, ntohs(iph->check));
-    printf("    Source: %s\n", inet_ntoa(*(struct in_addr*)&iph->saddr));
-    printf("    Dest: %s\n", inet_ntoa(*(struct in_addr*)&iph->daddr));
-    
-    // Verify IP checksum
-    uint16_t calculated = calculate_ip_checksum_debug((struct iphdr *)packet, "[VERIFY]");
-    printf("    IP Checksum %s: calculated=0x%04X, packet=0x%04X\n",
-           (calculated == ntohs(iph->check)) ? "VALID" : "INVALID",
-           calculated, ntohs(iph->check));
-    
-    if (iph->protocol == IPPROTO_UDP) {
-        struct udphdr *udph = (struct udphdr *)(packet + ip_header_len);
-        printf("    UDP Source Port: %d, Dest Port: %d\n", 
-               ntohs(udph->uh_sport), ntohs(udph->uh_dport));
-        printf("    UDP Length: %d, Checksum: 0x%04X\n", 
-               ntohs(udph->uh_ulen), ntohs(udph->uh_sum));
-        
-        // Print some RTCP info
-        if (len >= ip_header_len + 8 + 8) {
-            const unsigned char *rtcp_data = packet + ip_header_len + 8;
-            unsigned char version = (rtcp_data[0] >> 6) & 0x03;
-            unsigned char packet_type = rtcp_data[1];
-            printf("    RTCP Version: %d, Type: %d\n", version, packet_type);
+    return 1;
+}
+
+// Free retired snapshots no worker can still hold. Caller holds live_lock.
+static void live_reclaim(void) {
+    int keep = 0;
+    for (int i = 0; i < n_retired; i++) {
+        // Replaced by gen + 1; a worker that has seen that cannot hold it
+        if (live_quiescent(retired[i]->gen + 1)) {
+            free(retired[i]);
+        } else {
+            retired[keep++] = retired[i];
         }
     }
-    printf("\n");
+    n_retired = keep;
 }
 
-// Create a fake RTCP Receiver Report with UDP checksum calculation
-static int create_fake_rr(const unsigned char *original_packet, int packet_len,
-                         unsigned char **fake_packet, int *fake_len,
-                         uint32_t fixed_jitter, uint32_t fixed_fraction_lost) {
-    
-    struct iphdr *iph = (struct iphdr *)original_packet;
-    int ip_header_len = iph->ihl * 4;
-    struct udphdr *udph = (struct udphdr *)(original_packet + ip_header_len);
-    
-    printf("    [CHECKSUM DEBUG] === START ===\n");
-    printf("    [CHECKSUM] Original IP checksum: 0x%04X\n", ntohs(iph->check));
-    printf("    [CHECKSUM] Original UDP checksum: 0x%04X\n", ntohs(udph->uh_sum));
-    
-    // Verify original checksum calculation
-    uint16_t verify_orig = calculate_ip_checksum_debug((struct iphdr *)original_packet, "[ORIGINAL]");
-    printf("    [CHECKSUM] Verified original checksum: 0x%04X (%s)\n", 
-           verify_orig, (verify_orig == ntohs(iph->check)) ? "MATCH" : "MISMATCH!");
-    
-    // Allocate memory for fake packet (same size as original)
-    *fake_len = packet_len;
-    *fake_packet = malloc(*fake_len);
-    if (!*fake_packet) {
-        return -1;
+// Make next the configuration every subsequent packet sees (RCU-style: one
+// atomic pointer store), and retire the previous snapshot. Caller holds
+// live_lock; next must not be touched afterwards.
+static void live_publish(struct live_config *next) {
+    const struct timespec tick = { .tv_sec = 0, .tv_nsec = 1000 * 1000 };
+    
+    live_reclaim();
+    while (n_retired == LIVE_RETIRED_MAX) {
+        nanosleep(&tick, NULL);
+        live_reclaim();
+    }
+    next->gen = live_gen + 1;
+    struct live_config *old = __atomic_exchange_n(&live, next, __ATOMIC_ACQ_REL);
+    __atomic_store_n(&live_gen, next->gen, __ATOMIC_RELEASE);
+    if (old) {
+        retired[n_retired++] = old;
     }
-    
-    // Copy original packet EXACTLY
-    memcpy(*fake_packet, original_packet, packet_len);
-    
-    // Get pointers to the headers in the fake packet
-    struct iphdr *fake_iph = (struct iphdr *)*fake_packet;
-    struct udphdr *fake_udph = (struct udphdr *)(*fake_packet + ip_header_len);
-    struct rtcp_rr_packet *fake_rr = (struct rtcp_rr_packet *)(*fake_packet + ip_header_len + 8);
-    
-    printf("    [MODIFY] Before modification:\n");
-    printf("    [MODIFY]   Jitter: %u (0x%08X)\n", ntohl(fake_rr->jitter), ntohl(fake_rr->jitter));
-    printf("    [MODIFY]   Fraction Lost: 0x%08X\n", ntohl(fake_rr->fraction_lost));
-    
-    // ONLY modify jitter and fraction lost - preserve everything else!
-    fake_rr->jitter = htonl(fixed_jitter);
-    
-    // Set fixed fraction lost but preserve cumulative lost from original
-    uint32_t original_fraction_lost = ntohl(fake_rr->fraction_lost);
-    uint32_t cumulative_lost = original_fraction_lost & 0xFFFFFF;
-    uint32_t new_fraction_lost = (fixed_fraction_lost << 24) | cumulative_lost;
-    fake_rr->fraction_lost = htonl(new_fraction_lost);
-    
-    printf("    [MODIFY] After modification:\n");
-    printf("    [MODIFY]   Jitter: %u (0x%08X)\n", ntohl(fake_rr->jitter), ntohl(fake_rr->jitter));
-    printf("    [MODIFY]   Fraction Lost: 0x%08X\n", ntohl(fake_rr->fraction_lost));
-    
-    // Recalculate IP checksum
-    fake_iph->check = 0;
-    uint16_t new_ip_checksum = calculate_ip_checksum_debug(fake_iph, "[NEW IP]");
-    fake_iph->check = htons(new_ip_checksum);
-    
-    printf("    [CHECKSUM] New IP checksum: 0x%04X\n", new_ip_checksum);
-    
-    // Recalculate UDP checksum properly
-    int udp_payload_len = ntohs(fake_udph->uh_ulen) - 8;
-    const unsigned char *udp_payload = (unsigned char *)fake_rr;
-    
-    fake_udph->uh_sum = 0; // Must be zero for calculation
-    uint16_t new_udp_checksum = calculate_udp_checksum(fake_iph, fake_udph, udp_payload, udp_payload_len);
-    fake_udph->uh_sum = htons(new_udp_checksum);
-    
-    printf("    [CHECKSUM] New UDP checksum: 0x%04X\n", new_udp_checksum);
-    printf("    [CHECKSUM DEBUG] === END ===\n\n");
-    return 0;
 }
 
-// Check if packet is an RTCP Receiver Report
-static int is_rtcp_receiver_report(const unsigned char *packet_data, int packet_len,
-                                   struct in_addr *src_ip, struct in_addr *dst_ip,
-                                   uint16_t *src_port, uint16_t *dst_port,
-                                   uint32_t *ssrc, uint32_t *extended_seq)
-{
-    struct iphdr *iph;
-    struct udphdr *udph;
-    const unsigned char *rtcp_data;
-    int ip_header_len;
-    int udp_payload_len;
-    
-    // Minimum size check: IP header (20) + UDP header (8) + RTCP header (8)
-    if (packet_len < 20 + 8 + 8) {
-        return 0;
+// Private copy of the current snapshot to edit and publish, NULL on OOM.
+// Caller holds live_lock.
+static struct live_config *live_copy(void) {
+    struct live_config *next = malloc(sizeof(*next));
+    if (next) {
+        *next = *live;
     }
-    
-    // Parse IP header
-    iph = (struct iphdr *)packet_data;
-    
-    // Verify IPv4
-    if (iph->version != 4) {
+    return next;
+}
+
+// Issue one verdict for every packet accepted since the last flush
+static int flush_accept_batch(struct worker *w) {
+    if (!w->batch_pending) {
         return 0;
     }
-    
-    // Verify UDP protocol
-    if (iph->protocol != IPPROTO_UDP) {
-        return 0;
+    w->batch_pending = 0;
+    w->path.stats.batch_verdicts++;
+    return nfq_set_verdict_batch(w->qh, w->batch_last_id, NF_ACCEPT);
+}
+
+// Accept an unmodified packet. In batch mode only the id is remembered; the
+// receive loop flushes the run once the socket is drained.
+static int accept_packet(struct worker *w, int id) {
+    if (!config.batch_verdicts) {
+        return nfq_set_verdict(w->qh, id, NF_ACCEPT, 0, NULL);
     }
-    
-    ip_header_len = iph->ihl * 4;
-    
-    // Check if we have enough data for UDP header
-    if (packet_len < ip_header_len + 8) {
-        return 0;
+    w->batch_last_id = id;
+    if (++w->batch_pending >= VERDICT_BATCH_MAX) {
+        return flush_accept_batch(w);
     }
+    return 0;
+}
+
+static struct worker *worker_of(struct pkt_source *src) {
+    return (struct worker *)((char *)src - offsetof(struct worker, src));
+}
+
+// pkt_source hook: turn the packet path's decision into NFQUEUE verdicts
+static int nfq_verdict(struct pkt_source *src, const struct pkt *p, pkt_verdict_t v) {
+    struct worker *w = worker_of(src);
     
-    // Parse UDP header
-    udph = (struct udphdr *)(packet_data + ip_header_len);
-    
-    // Get UDP payload length
-    udp_payload_len = ntohs(udph->uh_ulen) - 8;
-    
-    // Check if we have enough data for RTCP header (at least 8 bytes)
-    if (udp_payload_len < 8) {
-        return 0;
+    if (v == PKT_ACCEPT) {
+        return accept_packet(w, p->id);
+    }
+    // Everything accepted before this packet gets its verdict first
+    flush_accept_batch(w);
+    switch (v) {
+        case PKT_ACCEPT_MODIFIED:
+            // Hand the modified bytes back with the verdict; the packet
+            // keeps its place in the flow
+            return nfq_set_verdict(w->qh, p->id, NF_ACCEPT, p->len, p->data);
+        case PKT_ACCEPT_MARK:
+            return nfq_set_verdict2(w->qh, p->id, NF_ACCEPT, p->mark | BYPASS_MARK, 0, NULL);
+        case PKT_DROP:
+            return nfq_set_verdict(w->qh, p->id, NF_DROP, 0, NULL);
+        default:
+            return nfq_set_verdict(w->qh, p->id, NF_ACCEPT, 0, NULL);
     }
+}
+
+// pkt_source hook: fake RRs go out on the shared raw socket, after the
+// pending accepted run
+static int nfq_inject(struct pkt_source *src, const unsigned char *packet, int len) {
+    flush_accept_batch(worker_of(src));
+    return send_raw_packet(packet, len);
+}
+
+static inline uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+// Hands each queued packet to the packet path, and times it: receive to
+// verdict (to the verdict decision for a batched accept, whose syscall is
+// shared with the rest of the run), and the time it waited in the kernel
+// queue, from the NFQA timestamp the kernel stamped at arrival
+static int callback(struct nfq_q_handle *qh, struct nfgenmsg *nfmsg,
+                   struct nfq_data *nfa, void *data)
+{
+    struct worker *w = data;
+    struct nfqnl_msg_packet_hdr *ph;
+    struct pkt p = { 0 };
+    struct timeval arrived;
+    int rv;
+    (void)qh;
+    (void)nfmsg;
     
-    // Check buffer bounds
-    if (packet_len < ip_header_len + 8 + 8) {
-        return 0;
+    ph = nfq_get_msg_packet_hdr(nfa);
+    if (ph) {
+        p.id = ntohl(ph->packet_id);
     }
     
-    // Get RTCP data (after UDP header)
-    rtcp_data = packet_data + ip_header_len + 8;
+    // Arrival time for the media tracker: the kernel's stamp, or when the
+    // message was received if there is none (same clock)
+    int have_ts = nfq_get_timestamp(nfa, &arrived) == 0;
+    int64_t arrived_us = have_ts ? (int64_t)arrived.tv_sec * 1000000 + arrived.tv_usec :
+                                   w->t_recv_real_us;
+    p.ts_ns = (uint64_t)arrived_us * 1000;
+    p.now_sec = w->t_recv_sec;
+    
+    p.len = nfq_get_payload(nfa, &p.data);
+    if (p.len >= 0) {
+        p.mark = nfq_get_nfmark(nfa);
+        rv = pkt_process(&w->path, live_get(), &p);
+    } else {
+        w->path.stats.total_packets++;
+        w->path.stats.parse_errors++;
+        w->path.pkt_class = PKT_NON_UDP;
+        LOG_WARN("Warning: Failed to get packet payload (id=%u)\n", p.id);
+        rv = accept_packet(w, p.id);
+    }
     
-    // Parse RTCP header
-    unsigned char version = (rtcp_data[0] >> 6) & 0x03;
-    unsigned char packet_type = rtcp_data[1];
+    hist_add(&w->verdict_hist[w->path.pkt_class], monotonic_ns() - w->t_recv_ns);
+    if (have_ts) {
+        int64_t delay_us = w->t_recv_real_us - arrived_us;
+        // A clock step can make it negative; such samples are skipped
+        if (delay_us >= 0) {
+            hist_add(&w->queue_hist[w->path.pkt_class], (uint64_t)delay_us * 1000);
+        }
+    } else {
+        w->path.stats.no_timestamp++;
+    }
+    return rv;
+}
+
+// Random REMB + TWCC pair for the self-test at p (other bytes already
+// random); returns its length
+static int selftest_feedback(unsigned char *p) {
+    // REMB for one SSRC
+    p[0] = 0x80 | 15;
+    p[1] = RTCP_PSFB;
+    p[2] = 0;
+    p[3] = 5;
+    memcpy(p + 12, "REMB", 4);
+    p[16] = 1;
+    int len = 24;
+    
+    // TWCC with 1-28 two-bit status symbols, deltas to match, padded
+    unsigned char *t = p + len;
+    int count = 1 + rand() % 28;
+    int chunks = (count + 6) / 7;
+    int off = 20 + 2 * chunks;
+    t[14] = 0;
+    t[15] = count;
+    for (int c = 0; c < chunks; c++) {
+        uint16_t chunk = 0xC000;
+        for (int i = 0; i < 7; i++) {
+            int sym = rand() % 3;
+            if (c * 7 + i < count) {
+                off += sym;
+            }
+            chunk |= sym << (12 - 2 * i);
+        }
+        t[20 + 2 * c] = chunk >> 8;
+        t[21 + 2 * c] = chunk & 0xFF;
+    }
+    int pad = (4 - off % 4) % 4;
+    t[0] = 0x80 | 15 | (pad ? 0x20 : 0);
+    t[1] = RTCP_RTPFB;
+    t[2] = 0;
+    t[3] = (off + pad) / 4 - 1;
+    if (pad) {
+        t[off + pad - 1] = pad;
+    }
+    return len + off + pad;
+}
+
+// Self-check (-T): rewriting a random compound packet (SR with 0-3 blocks,
+// RR with 1-4 blocks, REMB, TWCC, SDES) must touch every report block and
+// both feedback messages, and the incrementally patched checksum must equal
+// a full recomputation, with and without IP options. A zero (absent) UDP
+// checksum must stay zero.
+static int run_checksum_selftest(int iterations) {
+    static unsigned char pkt[1500];
+    static struct live_config cfg = {
+        .mode = MODE_REWRITE,
+        .rules = { .n = 1, .r = { { .any_ssrc = 1, .mode = POLICY_FIXED } } },
+        .fb = { .remb_op = REMB_SET, .twcc_enabled = 1 }
+    };
+    struct policy_table *policies = policy_table_create();
+    struct rtcp_walk walk;
+    int failures = 0;
+    
+    if (!policies) {
+        perror("calloc");
+        return 1;
+    }
     
-    if (version == 2 && packet_type == RTCP_RR) {
-        // Extract IP addresses and ports
-        src_ip->s_addr = iph->saddr;
-        dst_ip->s_addr = iph->daddr;
-        *src_port = ntohs(udph->uh_sport);
-        *dst_port = ntohs(udph->uh_dport);
+    srand(12345);
+    for (int n = 0; n < iterations; n++) {
+        int ihl = 5 + rand() % 3;
+        int ip_header_len = ihl * 4;
+        int sr_blocks = rand() % 4;
+        int rr_blocks = 1 + rand() % 4;
+        int sdes_len = 4 * (2 + rand() % 8);
+        int fb_len;
+        int sr_len = RTCP_SR_BLOCKS_OFFSET + sr_blocks * (int)sizeof(struct rtcp_report_block);
+        int rr_len = RTCP_RR_BLOCKS_OFFSET + rr_blocks * (int)sizeof(struct rtcp_report_block);
         
-        // Extract SSRC and extended sequence number if requested
-        if (ssrc && extended_seq && udp_payload_len >= 32) {
-            struct rtcp_rr_packet *rr = (struct rtcp_rr_packet *)rtcp_data;
-            *ssrc = ntohl(rr->ssrc);  // Convert to host byte order
-            *extended_seq = ntohl(rr->extended_high_seq);  // Convert to host byte order
+        for (int i = 0; i < (int)sizeof(pkt); i++) {
+            pkt[i] = rand() & 0xFF;
         }
+        unsigned char *rtcp = pkt + ip_header_len + 8;
+        fb_len = selftest_feedback(rtcp + sr_len + rr_len);
+        int rtcp_len = sr_len + rr_len + fb_len + sdes_len;
+        int packet_len = ip_header_len + 8 + rtcp_len;
+
+        struct iphdr *iph = (struct iphdr *)pkt;
+        iph->version = 4;
+        iph->ihl = ihl;
+        iph->protocol = IPPROTO_UDP;
+        iph->tot_len = htons(packet_len);
+        iph->check = 0;
+        iph->check = htons(calculate_ip_checksum_debug(iph, NULL));
         
-        return 1;
+        struct udphdr *udph = (struct udphdr *)(pkt + ip_header_len);
+        udph->uh_ulen = htons(8 + rtcp_len);
+        
+        struct rtcp_header *h = (struct rtcp_header *)rtcp;
+        h->version_p_count = 0x80 | sr_blocks;
+        h->packet_type = RTCP_SR;
+        h->length = htons(sr_len / 4 - 1);
+        h = (struct rtcp_header *)(rtcp + sr_len);
+        h->version_p_count = 0x80 | rr_blocks;
+        h->packet_type = RTCP_RR;
+        h->length = htons(rr_len / 4 - 1);
+        h = (struct rtcp_header *)(rtcp + sr_len + rr_len + fb_len);
+        h->version_p_count = 0x81;
+        h->packet_type = RTCP_SDES;
+        h->length = htons(sdes_len / 4 - 1);
+        
+        int no_udp_checksum = (n % 16 == 0);
+        udph->uh_sum = 0;
+        if (!no_udp_checksum) {
+            udph->uh_sum = htons(calculate_udp_checksum(iph, udph, rtcp, rtcp_len));
+        }
+        uint16_t ip_check = iph->check;
+        
+        cfg.rules.r[0].jitter = rand();
+        cfg.rules.r[0].fraction_lost = rand() & 0xFF;
+        cfg.fb.remb_bitrate = rand();
+        cfg.fb.twcc_op = (n & 1) ? TWCC_ADD : TWCC_SCALE;
+        cfg.fb.twcc_value = (n & 1) ? rand() % 101 - 50 : rand() % 300;
+        rewrite_rtcp(pkt, packet_len, &cfg, policies, &walk);
+        if (walk.rewritten != sr_blocks + rr_blocks || walk.remb != 1 || walk.twcc != 1 ||
+            walk.malformed) {
+            printf("[SELFTEST] #%d: rewrote %d of %d blocks, %d REMB, %d TWCC (len %d, malformed %d)\n",
+                   n, walk.rewritten, sr_blocks + rr_blocks, walk.remb, walk.twcc,
+                   packet_len, walk.malformed);
+            failures++;
+            continue;
+        }
+        
+        uint16_t incremental = udph->uh_sum;
+        uint16_t expected = 0;
+        if (!no_udp_checksum) {
+            udph->uh_sum = 0;
+            expected = htons(calculate_udp_checksum(iph, udph, rtcp, rtcp_len));
+        }
+        if (incremental != expected || iph->check != ip_check) {
+            printf("[SELFTEST] #%d: len %d ihl %d: UDP 0x%04X expected 0x%04X, IP 0x%04X expected 0x%04X\n",
+                   n, packet_len, ihl, ntohs(incremental), ntohs(expected),
+                   ntohs(iph->check), ntohs(ip_check));
+            failures++;
+        }
     }
     
-    return 0;
+    free(policies);
+    printf("[SELFTEST] Compound RR rewrite: %d packets, %d mismatches\n", iterations, failures);
+    return failures ? 1 : 0;
 }
 
-// Inject a fake RR packet
-static int inject_fake_rr(const unsigned char *original_packet, int packet_len,
-                         uint32_t fixed_jitter, uint32_t fixed_fraction_lost,
-                         const char *debug_prefix) {
+// Kernel-side drop counters for queue_num from /proc/net/netfilter/nfnetlink_queue:
+// queue_dropped (queue full) and user_dropped (netlink socket overrun)
+static int read_queue_drops(int queue_num, unsigned long *queue_dropped,
+                            unsigned long *user_dropped) {
+    FILE *f = fopen("/proc/net/netfilter/nfnetlink_queue", "r");
+    if (!f) {
+        return -1;
+    }
     
-    unsigned char *fake_packet;
-    int fake_len;
+    int q, found = -1;
+    unsigned long portid, total, mode, range, qd, ud;
+    while (fscanf(f, "%d %lu %lu %lu %lu %lu %lu %*[^\n]",
+                  &q, &portid, &total, &mode, &range, &qd, &ud) == 7) {
+        if (q == queue_num) {
+            *queue_dropped = qd;
+            *user_dropped = ud;
+            found = 0;
+            break;
+        }
+    }
+    fclose(f);
+    return found;
+}
+
+// Both kernel drop counters summed over every worker's queue; -1 if none
+// could be read
+static int sum_queue_drops(unsigned long *queue_dropped, unsigned long *user_dropped) {
+    int found = -1;
+
+    *queue_dropped = *user_dropped = 0;
+    for (int i = 0; i < num_workers; i++) {
+        unsigned long qd, ud;
+        if (read_queue_drops(workers[i].queue_num, &qd, &ud) == 0) {
+            *queue_dropped += qd;
+            *user_dropped += ud;
+            found = 0;
+        }
+    }
+    return found;
+}
+
+// Receive one netlink message and stamp its arrival. NETLINK_NO_ENOBUFS is
+// set, so overruns never surface here; they are the kernel's user_dropped
+static int recv_queue_msg(struct worker *w, int flags) {
+    int rv = recv(w->fd, w->buf, w->buf_size, flags);
+    if (rv > 0) {
+        struct timespec real;
+        w->t_recv_ns = monotonic_ns();
+        w->t_recv_sec = (uint32_t)(w->t_recv_ns / 1000000000u);
+        clock_gettime(CLOCK_REALTIME, &real);
+        w->t_recv_real_us = (int64_t)real.tv_sec * 1000000 + real.tv_nsec / 1000;
+    }
+    return rv;
+}
+
+static void close_worker_queue(struct worker *w) {
+    if (w->qh) {
+        nfq_destroy_queue(w->qh);
+        w->qh = NULL;
+    }
+    if (w->h) {
+        nfq_close(w->h);
+        w->h = NULL;
+    }
+    free(w->buf);
+    w->buf = NULL;
+    free(w->path.flows);
+    w->path.flows = NULL;
+    sched_destroy(w->path.sched);
+    w->path.sched = NULL;
+    free(w->path.rtp);
+    w->path.rtp = NULL;
+    if (w->path.rtt) {
+        rtt_tables[w - workers] = NULL;
+        free(w->path.rtt);
+        w->path.rtt = NULL;
+    }
+    free(w->path.policies);
+    w->path.policies = NULL;
+}
+
+// Open a handle for w->queue_num and configure it. Only the first queue
+// (re)binds the AF_INET handler; the binding is per protocol family, not
+// per socket, and newer kernels ignore it altogether.
+static int open_worker_queue(struct worker *w, int bind_pf) {
+    w->h = nfq_open();
+    if (!w->h) {
+        fprintf(stderr, "Error: nfq_open() failed. Are you running as root?\n");
+        return -1;
+    }
+
+    if (bind_pf) {
+        // Unbind any existing handler for AF_INET (ignore errors)
+        nfq_unbind_pf(w->h, AF_INET);
+
+        if (nfq_bind_pf(w->h, AF_INET) < 0) {
+            fprintf(stderr, "Error: nfq_bind_pf() failed\n");
+            close_worker_queue(w);
+            return -1;
+        }
+    }
+
+    w->qh = nfq_create_queue(w->h, w->queue_num, &callback, w);
+    if (!w->qh) {
+        fprintf(stderr, "Error: nfq_create_queue() failed. Is queue %d already in use?\n", w->queue_num);
+        close_worker_queue(w);
+        return -1;
+    }
+
+    // Request packet data up to the copy range
+    if (nfq_set_mode(w->qh, NFQNL_COPY_PACKET, config.copy_range) < 0) {
+        fprintf(stderr, "Error: nfq_set_mode() failed\n");
+        close_worker_queue(w);
+        return -1;
+    }
+
+    // If we stall, let traffic through instead of blackholing wlan0
+    if (config.fail_open &&
+        nfq_set_queue_flags(w->qh, NFQA_CFG_F_FAIL_OPEN, NFQA_CFG_F_FAIL_OPEN) < 0) {
+        fprintf(stderr, "Warning: fail-open not supported by this kernel\n");
+    }
+
+    if (config.queue_maxlen && nfq_set_queue_maxlen(w->qh, config.queue_maxlen) < 0) {
+        fprintf(stderr, "Warning: nfq_set_queue_maxlen() failed\n");
+    }
+
+    w->fd = nfq_fd(w->h);
+    w->src.verdict = nfq_verdict;
+    w->src.inject = nfq_inject;
+    w->path.src = &w->src;
+    w->path.bypass_after = config.bypass_after;
+    
+    if (config.synthetic_ms > 0) {
+        w->path.sched = sched_create(config.synthetic_ms);
+        if (!w->path.sched) {
+            close_worker_queue(w);
+            return -1;
+        }
+    }
+
+    // Large socket buffer to absorb bursts; ENOBUFS reporting is switched
+    // off since lost messages show up in the kernel's queue counters anyway
+    nfnl_rcvbufsiz(nfq_nfnlh(w->h), config.rcvbuf_size);
+    int one = 1;
+    setsockopt(w->fd, SOL_NETLINK, NETLINK_NO_ENOBUFS, &one, sizeof(one));
+    // The kernel only adds NFQA_TIMESTAMP to packets stamped on receive,
+    // which it does while any socket has asked for timestamps
+    setsockopt(w->fd, SOL_SOCKET, SO_TIMESTAMP, &one, sizeof(one));
+
+    // Wake up periodically so the worker notices shutdown
+    struct timeval tv = { .tv_sec = 0, .tv_usec = RECV_TIMEOUT_MS * 1000 };
+    setsockopt(w->fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    // One message carries at most copy_range payload bytes plus attributes
+    w->buf_size = config.copy_range + NFQ_MSG_OVERHEAD;
+    w->buf = malloc(w->buf_size);
+    if (!w->buf) {
+        perror("malloc");
+        close_worker_queue(w);
+        return -1;
+    }
+
+    w->path.policies = policy_table_create();
+    if (!w->path.policies) {
+        perror("calloc");
+        close_worker_queue(w);
+        return -1;
+    }
+
+    w->path.flows = flow_table_create();
+    if (!w->path.flows) {
+        perror("posix_memalign");
+        close_worker_queue(w);
+        return -1;
+    }
     
-    printf("    %s=== PACKET INTEGRITY CHECK ===\n", debug_prefix);
-    verify_packet_integrity(original_packet, packet_len, "ORIGINAL");
+    if (config.track_rtp) {
+        w->path.rtp = rtp_table_create();
+        if (!w->path.rtp) {
+            perror("calloc");
+            close_worker_queue(w);
+            return -1;
+        }
+    }
     
-    if (create_fake_rr(original_packet, packet_len, &fake_packet, &fake_len,
-                      fixed_jitter, fixed_fraction_lost) == 0) {
-        
-        verify_packet_integrity(fake_packet, fake_len, "FAKE");
-        
-        printf("    %sINJECTING FAKE RR (Jitter: %u, Fraction Lost: %u/256)\n",
-               debug_prefix, fixed_jitter, fixed_fraction_lost);
+    w->path.rtt = rtt_table_create();
+    if (!w->path.rtt) {
+        perror("calloc");
+        close_worker_queue(w);
+        return -1;
+    }
+    w->path.rtt->peers = rtt_tables;
+    w->path.rtt->n_peers = MAX_QUEUES;
+    rtt_tables[w - workers] = w->path.rtt;
+    return 0;
+}
+
+static void *worker_main(void *arg) {
+    struct worker *w = arg;
+    int rv;
+
+    if (w->cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(w->cpu, &set);
+        if (sched_setaffinity(0, sizeof(set), &set) < 0) {
+            LOG_WARN("Warning: cannot pin queue %d to CPU %d\n", w->queue_num, w->cpu);
+        }
+    }
+
+    // Packet path logs into its own ring; the logger thread does the printing
+    log_register_thread();
+
+    while (keep_running) {
+        // No snapshot is held between packets
+        __atomic_store_n(&w->qs_gen, __atomic_load_n(&live_gen, __ATOMIC_ACQUIRE), __ATOMIC_RELEASE);
         
-        // Print fake RR details
-        int ip_header_len = ((struct iphdr *)fake_packet)->ihl * 4;
-        const unsigned char *fake_rtcp = fake_packet + ip_header_len + 8;
-        int fake_rtcp_len = fake_len - ip_header_len - 8;
-        print_rtcp_rr_details(fake_rtcp, fake_rtcp_len, "    [FAKE] ");
+        // Synthetic RRs: timer ticks and configuration changes are handled
+        // between packets, waking at least once per interval to see changes
+        if (w->path.sched) {
+            int timeout = config.synthetic_ms < RECV_TIMEOUT_MS ? config.synthetic_ms : RECV_TIMEOUT_MS;
+            int ready = sched_wait(w->path.sched, w->fd, timeout);
+            sched_run(w->path.sched, &w->path, live_get());
+            if (!ready) {
+                continue;
+            }
+        }
         
-        // Send via raw socket
-        int result = send_raw_packet(fake_packet, fake_len);
-        free(fake_packet);
+        rv = recv_queue_msg(w, 0);
+        if (rv < 0) {
+            if (errno == ENOBUFS || errno == EINTR || errno == EAGAIN) {
+                continue;
+            }
+            LOG_ERROR("Error: recv on queue %d failed: errno %d\n", w->queue_num, errno);
+            break;
+        }
+        nfq_handle_packet(w->h, w->buf, rv);
         
-        if (result > 0) {
-            printf("    %s✅ FAKE RR INJECTION SUCCESSFUL (%d bytes sent)\n", debug_prefix, result);
-            return 1;
-        } else {
-            printf("    %s❌ FAKE RR INJECTION FAILED\n", debug_prefix);
-            return 0;
+        // Batch mode: take whatever else is already queued, then give the
+        // accepted run a single verdict
+        if (config.batch_verdicts) {
+            for (int n = 1; n < VERDICT_BATCH_MAX; n++) {
+                rv = recv_queue_msg(w, MSG_DONTWAIT);
+                if (rv <= 0) {
+                    break;
+                }
+                nfq_handle_packet(w->h, w->buf, rv);
+            }
+            flush_accept_batch(w);
         }
-    } else {
-        printf("    %s❌ FAILED TO CREATE FAKE RR\n", debug_prefix);
-        return 0;
     }
+    
+    w->path.stats.flows_tracked = w->path.flows->tracked;
+    w->path.stats.flows_settled = w->path.flows->settled;
+    w->path.stats.flows_evicted = w->path.flows->evicted;
+    w->path.stats.flow_hits = w->path.flows->hits;
+    w->path.stats.flow_misses = w->path.flows->misses;
+    w->path.stats.policy_streams = w->path.policies->tracked;
+    w->path.stats.policy_evicted = w->path.policies->evicted;
+    if (w->path.sched) {
+        w->path.stats.synthetic_streams = sched_streams(w->path.sched);
+    }
+    if (w->path.rtp) {
+        w->path.stats.rtp_streams = w->path.rtp->tracked;
+        w->path.stats.rtp_evicted = w->path.rtp->evicted;
+    }
+    __atomic_store_n(&w->active, 0, __ATOMIC_RELEASE);
+    return NULL;
 }
 
-// Statistics structure
-struct stats {
-    unsigned long total_packets;
-    unsigned long udp_packets;
-    unsigned long rtcp_rr_packets;
-    unsigned long rtcp_rr_dropped;
-    unsigned long rtcp_rr_faked;
-    unsigned long non_udp_packets;
-    unsigned long parse_errors;
-};
+// Counters are all unsigned long, so merging is a plain element-wise sum
+static void merge_stats(struct stats *total, const struct stats *s) {
+    unsigned long *t = (unsigned long *)total;
+    const unsigned long *v = (const unsigned long *)s;
+    for (size_t i = 0; i < sizeof(*total) / sizeof(unsigned long); i++) {
+        t[i] += v[i];
+    }
+}
+
+// Snapshot of every worker's counters. Read without locking while the
+// workers run, so it can be a few packets inconsistent.
+static void snapshot_stats(struct stats *total) {
+    memset(total, 0, sizeof(*total));
+    for (int i = 0; i < num_workers; i++) {
+        merge_stats(total, &workers[i].path.stats);
+    }
+}
 
-static struct stats packet_stats = {0};
+// Per-class latency histograms of all workers as text (stats socket and
+// shutdown report). Returns the length, at most cap - 1.
+static int format_latency(char *buf, size_t cap) {
+    static const char *const titles[2] = {
+        "Receive to verdict:\n", "Kernel queue delay (NFQA timestamp):\n"
+    };
+    size_t n = 0;
+    
+    for (int t = 0; t < 2 && n < cap; t++) {
+        n += snprintf(buf + n, cap - n, "%s", titles[t]);
+        for (int c = 0; c < PKT_CLASSES && n < cap; c++) {
+            struct hist h;
+            memset(&h, 0, sizeof(h));
+            for (int i = 0; i < num_workers; i++) {
+                hist_merge(&h, t == 0 ? &workers[i].verdict_hist[c] : &workers[i].queue_hist[c]);
+            }
+            n += hist_format(buf + n, cap - n, pkt_class_names[c], &h);
+        }
+    }
+    return n < cap ? (int)n : (int)cap - 1;
+}
 
-// Global configuration
-static struct {
-    uint32_t fixed_jitter;
-    uint32_t fixed_fraction_lost;
-    operation_mode_t mode;
-} config = {
-    .fixed_jitter = 100,        // Default fixed jitter value
-    .fixed_fraction_lost = 10,  // Default fixed fraction lost (10/256 ≈ 3.9%)
-    .mode = MODE_REPLACE        // Default mode: replace real RR with fake
-};
+// Every worker's RTP streams (-M), one line each
+static int format_rtp(char *buf, size_t cap) {
+    const struct rtp_table *tables[MAX_QUEUES];
+    int n = 0;
+    
+    for (int i = 0; i < num_workers; i++) {
+        if (workers[i].path.rtp) {
+            tables[n++] = workers[i].path.rtp;
+        }
+    }
+    return rtp_format(buf, cap, tables, n);
+}
 
-static int callback(struct nfq_q_handle *qh, struct nfgenmsg *nfmsg,
-                   struct nfq_data *nfa, void *data)
-{
-    int id = 0;
-    struct nfqnl_msg_packet_hdr *ph;
-    unsigned char *packet_data;
-    int packet_len;
-    struct in_addr src_ip, dst_ip;
-    uint16_t src_port, dst_port;
-    uint32_t ssrc, extended_seq;
+// Every worker's RTT estimates, one line per SSRC
+static int format_rtt(char *buf, size_t cap) {
+    const struct rtt_table *tables[MAX_QUEUES];
+    int n = 0;
+    
+    for (int i = 0; i < num_workers; i++) {
+        if (workers[i].path.rtt) {
+            tables[n++] = workers[i].path.rtt;
+        }
+    }
+    return rtt_format(buf, cap, tables, n);
+}
+
+// CTL_GET_STATS: packet counters, the latency histograms, the RTT
+// estimates, then the RTP streams
+static int format_stats(char *buf, size_t cap) {
+    struct stats s;
+    
+    snapshot_stats(&s);
+    size_t n = snprintf(buf, cap,
+                        "Packets: %lu total, %lu UDP, %lu non-UDP, %lu RTCP with reports\n"
+                        "RTCP: %lu rewritten, %lu faked, %lu dropped, %lu truncated, %lu malformed\n"
+                        "Synthetic RRs: %lu\n"
+                        "No timestamp: %lu\n",
+                        s.total_packets, s.udp_packets, s.non_udp_packets, s.rtcp_rr_packets,
+                        s.rtcp_rr_rewritten, s.rtcp_rr_faked, s.rtcp_rr_dropped,
+                        s.rtcp_rr_truncated, s.rtcp_malformed, s.synthetic_sent,
+                        s.no_timestamp);
+    if (n >= cap) {
+        return (int)cap - 1;
+    }
+    unsigned long hits = 0, misses = 0, uncached = 0;
+    for (int i = 0; i < num_workers; i++) {
+        const struct flow_table *t = workers[i].path.flows;
+        if (t) {
+            hits += t->hits;
+            misses += t->misses;
+            uncached += t->uncached;
+        }
+    }
+    n += snprintf(buf + n, cap - n, "Flow cache: %lu hits, %lu misses, %lu uncached\n",
+                  hits, misses, uncached);
+    if (n >= cap) {
+        return (int)cap - 1;
+    }
+    unsigned long queue_dropped, user_dropped;
+    if (sum_queue_drops(&queue_dropped, &user_dropped) == 0) {
+        n += snprintf(buf + n, cap - n, "Kernel queue drops: %lu (queue full), %lu (socket overrun)\n",
+                      queue_dropped, user_dropped);
+        if (n >= cap) {
+            return (int)cap - 1;
+        }
+    }
+    n += format_latency(buf + n, cap - n);
+    if (n < cap - 1) {
+        n += format_rtt(buf + n, cap - n);
+    }
+    if (config.track_rtp && n < cap - 1) {
+        n += snprintf(buf + n, cap - n, "RTP media: %lu packets\n", s.rtp_packets);
+        if (n < cap - 1) {
+            n += format_rtp(buf + n, cap - n);
+        }
+    }
+    return n < cap ? (int)n : (int)cap - 1;
+}
+
+// "N" or "first:last" (same form as iptables --queue-balance)
+static int parse_queue_range(const char *arg, int *first, int *last) {
+    char *end;
+    long a = strtol(arg, &end, 10);
+    long b = a;
+    if (*end == ':') {
+        b = strtol(end + 1, &end, 10);
+    }
+    if (end == arg || *end != '\0' || a < 0 || b > 65535 || b < a) {
+        return -1;
+    }
+    *first = (int)a;
+    *last = (int)b;
+    return 0;
+}
+
+static void print_policy_rule(const struct policy_rule *r) {
+    static const char *const names[] = { "pass", "fixed", "scale", "target" };
     
-    packet_stats.total_packets++;
+    if (r->any_ssrc) {
+        printf("  Policy *: %s", names[r->mode]);
+    } else {
+        printf("  Policy 0x%08X: %s", r->ssrc, names[r->mode]);
+    }
+    if (r->mode == POLICY_SCALE) {
+        printf(" jitter x%u%%, fraction lost x%u%%", r->jitter, r->fraction_lost);
+    } else if (r->mode != POLICY_PASS) {
+        printf(" jitter %u, fraction lost %u/256", r->jitter, r->fraction_lost);
+    }
+    printf("\n");
+}
+
+// Re-read the TARGET values when the file's mtime changes and publish them
+static void reload_targets(const char *path, time_t *mtime) {
+    struct stat st;
     
-    ph = nfq_get_msg_packet_hdr(nfa);
-    if (ph) {
-        id = ntohl(ph->packet_id);
+    if (stat(path, &st) < 0 || st.st_mtime == *mtime) {
+        return;
     }
+    *mtime = st.st_mtime;
     
-    packet_len = nfq_get_payload(nfa, &packet_data);
+    pthread_mutex_lock(&live_lock);
+    struct live_config *next = live_copy();
+    int n = next ? policy_load_targets(&next->rules, path) : -1;
+    if (n > 0) {
+        live_publish(next);
+    } else {
+        free(next);
+    }
+    pthread_mutex_unlock(&live_lock);
     
-    if (packet_len >= 0) {
-        // Quick check if it's UDP
-        if (packet_len >= 20) {
-            struct iphdr *iph = (struct iphdr *)packet_data;
-            if (iph->version == 4 && iph->protocol == IPPROTO_UDP) {
-                packet_stats.udp_packets++;
+    if (n < 0) {
+        fprintf(stderr, "Warning: cannot read target file %s\n", path);
+    } else {
+        LOG_INFO("Loaded %d policy targets\n", n);
+    }
+}
+
+// Control socket command (control thread). Edits a private copy of the live
+// configuration and publishes it; the reply goes out without waiting for
+// the workers to let go of the old one.
+static int control_apply(const struct ctl_msg *m, uint32_t *gen) {
+    int status = CTL_OK;
+    
+    pthread_mutex_lock(&live_lock);
+    struct live_config *next = m->cmd == CTL_PING ? NULL : live_copy();
+    int any = (m->flags & CTL_F_ANY_SSRC) != 0;
+    
+    if (m->cmd != CTL_PING && !next) {
+        status = CTL_EFAIL;
+    } else switch (m->cmd) {
+        case CTL_PING:
+            break;
+        case CTL_SET_MODE:
+            if (m->arg > MODE_REWRITE) {
+                status = CTL_EINVAL;
+            } else if ((m->arg == MODE_REPLACE || m->arg == MODE_BOTH) && open_raw_socket() < 0) {
+                status = CTL_EFAIL;
             } else {
-                packet_stats.non_udp_packets++;
+                next->mode = m->arg;
             }
-        }
-        
-        // Check if it's an RTCP Receiver Report
-        if (is_rtcp_receiver_report(packet_data, packet_len, 
-                                    &src_ip, &dst_ip, &src_port, &dst_port,
-                                    &ssrc, &extended_seq)) {
-            packet_stats.rtcp_rr_packets++;
-            
-            printf("\n>>> RTCP RECEIVER REPORT DETECTED! <<<\n");
-            printf("    Source: %s:%u\n", inet_ntoa(src_ip), src_port);
-            printf("    Destination: %s:%u\n", inet_ntoa(dst_ip), dst_port);
-            printf("    Packet ID: %d, Length: %d bytes\n", id, packet_len);
-            printf("    SSRC: %u (0x%08X)\n", ssrc, ssrc);
-            printf("    Extended Seq: %u\n", extended_seq);
-            
-            // Print real RR details
-            int ip_header_len = ((struct iphdr *)packet_data)->ihl * 4;
-            const unsigned char *rtcp_data = packet_data + ip_header_len + 8;
-            int rtcp_len = packet_len - ip_header_len - 8;
-            print_rtcp_rr_details(rtcp_data, rtcp_len, "[REAL] ");
-            
-            // Handle based on operation mode
-            switch (config.mode) {
-                case MODE_ACCEPT_ALL:
-                    printf("    [MODE: ACCEPT_ALL] Accepting real RR packet\n");
-                    return nfq_set_verdict(qh, id, NF_ACCEPT, 0, NULL);
-                    
-                case MODE_REPLACE:
-                    printf("    [MODE: REPLACE] Replacing real RR with fake\n");
-                    if (inject_fake_rr(packet_data, packet_len, 
-                                     config.fixed_jitter, config.fixed_fraction_lost,
-                                     "[REPLACE] ")) {
-                        packet_stats.rtcp_rr_faked++;
-                        packet_stats.rtcp_rr_dropped++;
-                        printf("    [REPLACE] Dropping real RR packet\n");
-                        return nfq_set_verdict(qh, id, NF_DROP, 0, NULL);
-                    } else {
-                        // If injection failed, fall back to accepting real packet
-                        printf("    [REPLACE] Injection failed, accepting real RR\n");
-                        return nfq_set_verdict(qh, id, NF_ACCEPT, 0, NULL);
-                    }
-                    
-                case MODE_BOTH:
-                    printf("    [MODE: BOTH] Accepting real RR AND injecting fake\n");
-                    if (inject_fake_rr(packet_data, packet_len,
-                                     config.fixed_jitter, config.fixed_fraction_lost,
-                                     "[BOTH] ")) {
-                        packet_stats.rtcp_rr_faked++;
-                    }
-                    printf("    [BOTH] Also accepting real RR packet\n");
-                    return nfq_set_verdict(qh, id, NF_ACCEPT, 0, NULL);
-                    
-                default:
-                    printf("    [ERROR] Unknown operation mode, accepting packet\n");
-                    return nfq_set_verdict(qh, id, NF_ACCEPT, 0, NULL);
+            break;
+        case CTL_SET_RULE: {
+            struct policy_rule r = {
+                .ssrc = any ? 0 : m->ssrc, .any_ssrc = any, .mode = m->arg,
+                .jitter = m->a, .fraction_lost = m->b
+            };
+            if (m->arg > POLICY_TARGET || (m->arg != POLICY_SCALE && m->b > 255)) {
+                status = CTL_EINVAL;
+            } else if (policy_set_rule(&next->rules, &r) < 0) {
+                status = CTL_EFULL;
             }
-        } else {
-            // Accept non-RR packets
-            return nfq_set_verdict(qh, id, NF_ACCEPT, 0, NULL);
+            break;
         }
-        
-        // Print stats every 100 packets
-        if (packet_stats.total_packets % 100 == 0) {
-            printf("[Stats] Total: %lu | UDP: %lu | RTCP-RR: %lu | Dropped: %lu | Faked: %lu\n",
-                   packet_stats.total_packets,
-                   packet_stats.udp_packets,
-                   packet_stats.rtcp_rr_packets,
-                   packet_stats.rtcp_rr_dropped,
-                   packet_stats.rtcp_rr_faked);
-            fflush(stdout);
+        case CTL_DEL_RULE:
+            if (policy_del_rule(&next->rules, m->ssrc, any) < 0) {
+                status = CTL_ENOENT;
+            }
+            break;
+        case CTL_SET_TARGET:
+            if (m->b > 255) {
+                status = CTL_EINVAL;
+            } else if (policy_set_target(&next->rules, m->ssrc, any, m->a, m->b) < 0) {
+                status = CTL_ENOENT;
+            }
+            break;
+        case CTL_SET_REMB:
+            if (m->arg > REMB_SET || (m->arg != REMB_KEEP && m->a == 0)) {
+                status = CTL_EINVAL;
+            } else {
+                next->fb.remb_op = m->arg;
+                next->fb.remb_bitrate = m->a;
+            }
+            break;
+        case CTL_SET_TWCC: {
+            int32_t value = (int32_t)m->a;
+            if (m->arg > 2 || value < INT16_MIN || value > INT16_MAX || (m->arg == 1 && value < 0)) {
+                status = CTL_EINVAL;
+            } else {
+                next->fb.twcc_enabled = m->arg != 0;
+                next->fb.twcc_op = m->arg == 2 ? TWCC_ADD : TWCC_SCALE;
+                next->fb.twcc_value = value;
+            }
+            break;
         }
-        
-    } else {
-        packet_stats.parse_errors++;
-        fprintf(stderr, "Warning: Failed to get packet payload (id=%d)\n", id);
-        return nfq_set_verdict(qh, id, NF_ACCEPT, 0, NULL);
+        default:
+            status = CTL_EINVAL;
+            break;
     }
     
-    return 0;
+    if (next && status == CTL_OK) {
+        live_publish(next);
+        LOG_INFO("Control: command %u applied, generation %u\n", m->cmd, live_gen);
+    } else {
+        free(next);
+    }
+    *gen = live_gen;
+    pthread_mutex_unlock(&live_lock);
+    return status;
 }
 
 void print_usage(const char *program_name) {
-    printf("Usage: %s [options] [queue_num]\n", program_name);
+    printf("Usage: %s [options] [queue_num | first:last]\n", program_name);
     printf("Options:\n");
     printf("  -j jitter      Set fixed jitter value (default: 100)\n");
     printf("  -l fraction    Set fixed fraction lost (0-255, default: 10)\n");
-    printf("  -m mode        Operation mode: 0=ACCEPT_ALL, 1=REPLACE, 2=BOTH (default: 1)\n");
+    printf("  -m mode        Operation mode: 0=ACCEPT_ALL, 1=REPLACE, 2=BOTH, 3=REWRITE (default: 3)\n");
+    printf("  -v level       Log level: 0=error, 1=warn, 2=info, 3=debug, 4=trace (default: 2)\n");
+    printf("  -b             Batch verdicts for runs of accepted non-RTCP packets\n");
+    printf("  -c bytes       Copy range per packet (default: 65535); longer RRs pass unchanged\n");
+    printf("  -Q packets     Kernel queue max length (default: kernel default)\n");
+    printf("  -R bytes       Netlink receive buffer size (default: 1048576)\n");
+    printf("  -C             Fail closed: drop instead of accept when the queue is full\n");
+    printf("  -P             Pin each queue's worker thread to its own CPU\n");
+    printf("  -I iface       Install a kernel rule queueing only RTCP from iface (removed on exit)\n");
+    printf("  -K backend     Rule backend for -I: iptables (u32 match) or nft (default: iptables)\n");
+    printf("  -S ssrc[,ssrc] Only rewrite report blocks about these media SSRCs (default: all)\n");
+    printf("  -p rule        Per-SSRC policy, repeatable, first match wins: SSRC|*=pass,\n");
+    printf("                 =fixed:jitter:fraction, =scale:jitter%%:fraction%% or =target:jitter:fraction\n");
+    printf("  -r op:bps      REMB bitrate: clamp:BPS caps it, set:BPS replaces it\n");
+    printf("  -w op:value    TWCC receive deltas: scale:PERCENT or add:TICKS (250 us, may be negative)\n");
+    printf("  -t file        Read TARGET values (\"SSRC|* jitter fraction\" lines), reloaded on change\n");
+    printf("  -F file        Replay a recorded impairment profile (mkprofile.py) ahead of the rules;\n");
+    printf("                 each value applied is logged as a [PROFILE] line\n");
+    printf("  -s path        Control socket (Unix datagram) for changes while running\n");
+    printf("  -x command...  Send a command to the -s socket and exit: ping, stats, mode N,\n");
+    printf("                 rule SSRC|* pass|fixed|scale|target [J F], del SSRC|*,\n");
+    printf("                 target SSRC|* J F, remb off|clamp|set [BPS], twcc off|scale|add [VALUE]\n");
+    printf("  -B packets     Mark flows for CONNMARK bypass after this many non-WebRTC packets\n");
+    printf("  -i ms          After a policy change, send synthetic RRs every ms (5-1000) until\n");
+    printf("                 it has reached the sender, instead of waiting for real RRs\n");
+    printf("  -M             Track RTP media per SSRC (loss, jitter, frame interval, bitrate),\n");
+    printf("                 reported by the stats command; media is not queued with -I\n");
+    printf("  -T             Run the checksum self-test and exit\n");
     printf("  -h             Show this help\n");
     printf("\nOperation Modes:\n");
     printf("  0 (ACCEPT_ALL): Accept all real RR packets, no injection\n");
-    printf("  1 (REPLACE):    Drop real RR, inject fake instead (recommended)\n");
+    printf("  1 (REPLACE):    Drop real RR, inject fake via raw socket instead\n");
     printf("  2 (BOTH):       Accept real RR AND inject fake (debugging)\n");
+    printf("  3 (REWRITE):    Modify real RR in the queue and accept it (recommended)\n");
     printf("\nExamples:\n");
-    printf("  %s 0                    # Use queue 0 with default values (REPLACE mode)\n", program_name);
+    printf("  %s 0                    # Use queue 0 with default values (REWRITE mode)\n", program_name);
     printf("  %s -j 50 -l 5 -m 1 0   # Jitter=50, Loss=5/256, REPLACE mode, queue 0\n", program_name);
     printf("  %s -m 0 0              # ACCEPT_ALL mode - no modification\n", program_name);
     printf("  %s -m 2 0              # BOTH mode - debug both real and fake\n", program_name);
+    printf("  %s -b -c 256 0         # High-throughput: batch verdicts, copy headers + RTCP prefix\n", program_name);
+    printf("  %s -P 0:1              # Queues 0-1, one pinned thread each (--queue-balance 0:1)\n", program_name);
+    printf("  %s -I wlan0 0          # Only RTCP from wlan0 reaches queue 0\n", program_name);
+    printf("  %s -s /var/run/nfq_dummy.ctl -x rule '*' fixed 400 40   # Retune a running instance\n",
+           program_name);
 }
 
 int main(int argc, char **argv)
 {
-    struct nfq_handle *h;
-    struct nfq_q_handle *qh;
-    int fd;
-    int rv;
-    char buf[4096];
-    int queue_num = 0;
+    int first_queue = 0, last_queue = 0, num_queues;
+    int pin_workers = 0;
+    uint32_t select_ssrcs[POLICY_MAX_RULES];
+    int n_select = 0;
+    const char *policy_specs[POLICY_MAX_RULES];
+    int n_specs = 0;
     int opt;
+    
+    // First snapshot of the runtime-changeable settings
+    struct live_config *boot = calloc(1, sizeof(*boot));
+    if (!boot) {
+        perror("calloc");
+        return 1;
+    }
+    boot->mode = MODE_REWRITE;  // Default mode: rewrite real RR in place
 
     // Parse command line arguments
-    while ((opt = getopt(argc, argv, "j:l:m:h")) != -1) {
+    while ((opt = getopt(argc, argv, "j:l:m:v:bc:Q:R:CPI:K:B:S:p:t:F:r:w:i:Ms:xTh")) != -1) {
         switch (opt) {
             case 'j':
                 config.fixed_jitter = atoi(optarg);
@@ -640,12 +1136,126 @@ int main(int argc, char **argv)
                 }
                 break;
             case 'm':
-                config.mode = atoi(optarg);
-                if (config.mode < 0 || config.mode > 2) {
-                    fprintf(stderr, "Error: Mode must be 0, 1, or 2\n");
+                boot->mode = atoi(optarg);
+                if (boot->mode < 0 || boot->mode > 3) {
+                    fprintf(stderr, "Error: Mode must be 0, 1, 2, or 3\n");
+                    return 1;
+                }
+                break;
+            case 'v':
+                log_level = atoi(optarg);
+                if (log_level < LOG_LVL_ERROR || log_level > LOG_LVL_TRACE) {
+                    fprintf(stderr, "Error: Log level must be 0-4\n");
+                    return 1;
+                }
+                break;
+            case 'b':
+                config.batch_verdicts = 1;
+                break;
+            case 'c':
+                config.copy_range = atoi(optarg);
+                if (config.copy_range < 64 || config.copy_range > MAX_PACKET_SIZE) {
+                    fprintf(stderr, "Error: Copy range must be 64-65535\n");
+                    return 1;
+                }
+                break;
+            case 'Q':
+                config.queue_maxlen = atoi(optarg);
+                break;
+            case 'R':
+                config.rcvbuf_size = atoi(optarg);
+                if (config.rcvbuf_size <= 0) {
+                    fprintf(stderr, "Error: Receive buffer size must be positive\n");
+                    return 1;
+                }
+                break;
+            case 'C':
+                config.fail_open = 0;
+                break;
+            case 'P':
+                pin_workers = 1;
+                break;
+            case 'I':
+                config.filter_iface = optarg;
+                break;
+            case 'B':
+                config.bypass_after = atoi(optarg);
+                if (config.bypass_after < 1 || config.bypass_after > 65535) {
+                    fprintf(stderr, "Error: Bypass threshold must be 1-65535\n");
+                    return 1;
+                }
+                break;
+            case 'S': {
+                char *p = optarg, *end;
+                while (*p) {
+                    if (n_select == POLICY_MAX_RULES) {
+                        fprintf(stderr, "Error: At most %d SSRCs\n", POLICY_MAX_RULES);
+                        return 1;
+                    }
+                    select_ssrcs[n_select++] = strtoul(p, &end, 0);
+                    if (end == p || (*end && *end != ',')) {
+                        fprintf(stderr, "Error: Invalid SSRC list\n");
+                        return 1;
+                    }
+                    p = *end ? end + 1 : end;
+                }
+                break;
+            }
+            case 'p':
+                if (n_specs == POLICY_MAX_RULES) {
+                    fprintf(stderr, "Error: At most %d policy rules\n", POLICY_MAX_RULES);
+                    return 1;
+                }
+                policy_specs[n_specs++] = optarg;
+                break;
+            case 'M':
+                config.track_rtp = 1;
+                break;
+            case 'i':
+                config.synthetic_ms = atoi(optarg);
+                if (config.synthetic_ms < SCHED_TICK_MS || config.synthetic_ms > 1000) {
+                    fprintf(stderr, "Error: Synthetic RR interval must be %d-1000 ms\n", SCHED_TICK_MS);
+                    return 1;
+                }
+                break;
+            case 's':
+                config.ctl_path = optarg;
+                break;
+            case 'x':
+                // Client mode: the rest of the command line is the command
+                if (!config.ctl_path) {
+                    fprintf(stderr, "Error: -x needs -s path first\n");
+                    return 1;
+                }
+                return ctl_client(config.ctl_path, argc - optind, argv + optind);
+            case 't':
+                config.target_file = optarg;
+                break;
+            case 'F':
+                config.profile_path = optarg;
+                break;
+            case 'r':
+                if (feedback_parse_remb(&boot->fb, optarg) < 0) {
                     return 1;
                 }
                 break;
+            case 'w':
+                if (feedback_parse_twcc(&boot->fb, optarg) < 0) {
+                    return 1;
+                }
+                break;
+            case 'K':
+                if (strcmp(optarg, "iptables") == 0) {
+                    config.filter_backend = FILTER_IPTABLES;
+                } else if (strcmp(optarg, "nft") == 0) {
+                    config.filter_backend = FILTER_NFT;
+                } else {
+                    fprintf(stderr, "Error: Backend must be iptables or nft\n");
+                    return 1;
+                }
+                break;
+            case 'T':
+                return run_checksum_selftest(20000);
             case 'h':
                 print_usage(argv[0]);
                 return 0;
@@ -655,31 +1265,112 @@ int main(int argc, char **argv)
         }
     }
 
-    // Get queue number from remaining argument
-    if (optind < argc) {
-        queue_num = atoi(argv[optind]);
-        if (queue_num < 0 || queue_num > 65535) {
-            fprintf(stderr, "Error: Invalid queue number. Must be 0-65535\n");
+    // Get queue number (or range) from remaining argument
+    if (optind < argc && parse_queue_range(argv[optind], &first_queue, &last_queue) < 0) {
+        fprintf(stderr, "Error: Invalid queue number. Must be 0-65535 or first:last\n");
+        return 1;
+    }
+    num_queues = last_queue - first_queue + 1;
+    
+    // -S streams get the -j/-l values; everything else too unless -S was
+    // given. -p rules for the same SSRC (or *) replace these.
+    for (int i = 0; i <= n_select; i++) {
+        struct policy_rule r = {
+            .any_ssrc = (i == n_select),
+            .ssrc = i < n_select ? select_ssrcs[i] : 0,
+            .mode = (i == n_select && n_select) ? POLICY_PASS : POLICY_FIXED,
+            .jitter = config.fixed_jitter,
+            .fraction_lost = config.fixed_fraction_lost
+        };
+        if (policy_set_rule(&boot->rules, &r) < 0) {
+            fprintf(stderr, "Error: At most %d policy rules\n", POLICY_MAX_RULES);
+            return 1;
+        }
+    }
+    for (int i = 0; i < n_specs; i++) {
+        if (policy_add_rule(&boot->rules, policy_specs[i]) < 0) {
             return 1;
         }
     }
+    if (config.profile_path) {
+        boot->rules.profile = profile_open(config.profile_path);
+        if (!boot->rules.profile) {
+            return 1;
+        }
+    }
+    live_publish(boot);
+
+    time_t target_mtime = 0;
+    if (config.target_file) {
+        reload_targets(config.target_file, &target_mtime);
+    }
+    // After the target file: reload_targets publishes a new snapshot and
+    // retires boot. No worker runs yet, so nothing else replaces this one
+    // before the banner and setup below are done with it.
+    const struct live_config *cfg = live_get();
+    if (num_queues > MAX_QUEUES) {
+        fprintf(stderr, "Error: At most %d queues\n", MAX_QUEUES);
+        return 1;
+    }
 
     const char *mode_str;
-    switch (config.mode) {
+    switch (cfg->mode) {
         case MODE_ACCEPT_ALL: mode_str = "ACCEPT_ALL"; break;
         case MODE_REPLACE: mode_str = "REPLACE"; break;
         case MODE_BOTH: mode_str = "BOTH"; break;
+        case MODE_REWRITE: mode_str = "REWRITE"; break;
         default: mode_str = "UNKNOWN"; break;
     }
 
     printf("RTCP Receiver Report Manipulator\n");
     printf("=================================\n");
     printf("Configuration:\n");
-    printf("  Queue Number: %d\n", queue_num);
+    if (num_queues == 1) {
+        printf("  Queue Number: %d\n", first_queue);
+    } else {
+        printf("  Queues: %d-%d (%d worker threads%s)\n", first_queue, last_queue,
+               num_queues, pin_workers ? ", pinned" : "");
+    }
     printf("  Fixed Jitter: %u\n", config.fixed_jitter);
     printf("  Fixed Fraction Lost: %u/256 (%u%%)\n", 
            config.fixed_fraction_lost, (config.fixed_fraction_lost * 100) / 256);
-    printf("  Operation Mode: %d (%s)\n", config.mode, mode_str);
+    for (int i = 0; i < cfg->rules.n; i++) {
+        print_policy_rule(&cfg->rules.r[i]);
+    }
+    if (cfg->fb.remb_op != REMB_KEEP) {
+        printf("  REMB: %s %u bps\n", cfg->fb.remb_op == REMB_CLAMP ? "clamp to" : "set to",
+               cfg->fb.remb_bitrate);
+    }
+    if (cfg->fb.twcc_enabled) {
+        printf("  TWCC deltas: %s %d%s\n", cfg->fb.twcc_op == TWCC_SCALE ? "scale" : "add",
+               cfg->fb.twcc_value, cfg->fb.twcc_op == TWCC_SCALE ? "%" : " ticks");
+    }
+    printf("  Operation Mode: %d (%s)\n", cfg->mode, mode_str);
+    printf("  Log Level: %d\n", log_level);
+    printf("  Copy Range: %u bytes\n", config.copy_range);
+    printf("  Verdicts: %s, Fail-open: %s\n",
+           config.batch_verdicts ? "batched" : "per packet", config.fail_open ? "yes" : "no");
+    if (config.bypass_after) {
+        printf("  Flow Bypass: after %d packets, mark 0x%08X\n", config.bypass_after, BYPASS_MARK);
+    }
+    if (config.filter_iface) {
+        printf("  RTCP Pre-filter: %s (%s)\n", config.filter_iface,
+               config.filter_backend == FILTER_NFT ? "nft" : "iptables u32");
+    }
+    if (config.ctl_path) {
+        printf("  Control Socket: %s\n", config.ctl_path);
+    }
+    if (config.synthetic_ms) {
+        printf("  Synthetic RRs: every %d ms after changes\n", config.synthetic_ms);
+    }
+    if (cfg->rules.profile) {
+        printf("  Impairment Profile: %s (%u entries, %s)\n", config.profile_path,
+               cfg->rules.profile->n, cfg->rules.profile->duration_ms ? "looped" : "holds last step");
+    }
+    if (config.track_rtp) {
+        printf("  RTP Media Tracking: on%s\n",
+               config.filter_iface ? " (no media reaches the queue with -I)" : "");
+    }
     printf("\nPress Ctrl+C to stop\n\n");
     fflush(stdout);
 
@@ -687,46 +1378,106 @@ int main(int argc, char **argv)
     signal(SIGINT, signal_handler);
     signal(SIGTERM, signal_handler);
 
-    h = nfq_open();
-    if (!h) {
-        fprintf(stderr, "Error: nfq_open() failed. Are you running as root?\n");
+    // Injecting modes and synthetic RRs reuse one raw socket for the whole run
+    if ((cfg->mode == MODE_REPLACE || cfg->mode == MODE_BOTH || config.synthetic_ms) &&
+        open_raw_socket() < 0) {
+        fprintf(stderr, "Error: cannot open raw socket for injection. Are you running as root?\n");
         return 1;
     }
 
-    // Unbind any existing handler for AF_INET (ignore errors)
-    nfq_unbind_pf(h, AF_INET);
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    if (ncpu < 1) {
+        ncpu = 1;
+    }
+    num_workers = num_queues;
+    for (int i = 0; i < num_queues; i++) {
+        workers[i].queue_num = first_queue + i;
+        workers[i].cpu = pin_workers ? (int)(i % ncpu) : -1;
+        if (open_worker_queue(&workers[i], i == 0) < 0) {
+            while (--i >= 0) {
+                close_worker_queue(&workers[i]);
+            }
+            return 1;
+        }
+    }
+
+    printf("Successfully initialized. Waiting for packets...\n");
+    printf("(Stats every %d s while packets arrive%s)\n\n", STATS_INTERVAL_SEC,
+           config.ctl_path ? "; latency with -x stats" : "");
+    fflush(stdout);
 
-    if (nfq_bind_pf(h, AF_INET) < 0) {
-        fprintf(stderr, "Error: nfq_bind_pf() failed\n");
-        nfq_close(h);
+    if (log_start(stdout) < 0) {
+        for (int i = 0; i < num_queues; i++) {
+            close_worker_queue(&workers[i]);
+        }
         return 1;
     }
 
-    qh = nfq_create_queue(h, queue_num, &callback, NULL);
-    if (!qh) {
-        fprintf(stderr, "Error: nfq_create_queue() failed. Is queue %d already in use?\n", queue_num);
-        nfq_close(h);
-        return 1;
+    // Only the main thread handles SIGINT/SIGTERM; workers inherit the mask
+    sigset_t sigs, old_sigs;
+    sigemptyset(&sigs);
+    sigaddset(&sigs, SIGINT);
+    sigaddset(&sigs, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &sigs, &old_sigs);
+    int started = 0;
+    for (; started < num_queues; started++) {
+        workers[started].active = 1;
+        if (pthread_create(&workers[started].thread, NULL, worker_main, &workers[started]) != 0) {
+            fprintf(stderr, "Error: cannot start worker for queue %d\n", workers[started].queue_num);
+            workers[started].active = 0;
+            keep_running = 0;
+            break;
+        }
     }
+    pthread_sigmask(SIG_SETMASK, &old_sigs, NULL);
 
-    // Request full packet data (up to 65535 bytes)
-    if (nfq_set_mode(qh, NFQNL_COPY_PACKET, 0xFFFF) < 0) {
-        fprintf(stderr, "Error: nfq_set_mode() failed\n");
-        nfq_destroy_queue(qh);
-        nfq_close(h);
-        return 1;
+    // Queues are being served now, so narrowing the kernel rule is safe
+    int exit_code = 0;
+    if (keep_running && config.filter_iface &&
+        filter_install(config.filter_backend, config.filter_iface, first_queue, last_queue) < 0) {
+        keep_running = 0;
+        exit_code = 1;
+    }
+    if (keep_running && config.ctl_path && ctl_start(config.ctl_path, control_apply, format_stats) < 0) {
+        keep_running = 0;
+        exit_code = 1;
     }
 
-    fd = nfq_fd(h);
+    unsigned long last_total = 0;
+    for (int tick = 1; keep_running; tick++) {
+        sleep(1);
+        if (config.target_file) {
+            reload_targets(config.target_file, &target_mtime);
+        }
+        pthread_mutex_lock(&live_lock);
+        live_reclaim();
+        pthread_mutex_unlock(&live_lock);
+        
+        if (tick % STATS_INTERVAL_SEC == 0 && log_level >= LOG_LVL_INFO) {
+            struct stats s;
+            snapshot_stats(&s);
+            if (s.total_packets != last_total) {
+                printf("[Stats] Total: %lu | UDP: %lu | RTCP-RR: %lu | Rewritten: %lu | Dropped: %lu | Faked: %lu\n",
+                       s.total_packets, s.udp_packets, s.rtcp_rr_packets, s.rtcp_rr_rewritten,
+                       s.rtcp_rr_dropped, s.rtcp_rr_faked);
+                fflush(stdout);
+                last_total = s.total_packets;
+            }
+        }
+    }
 
-    printf("Successfully initialized. Waiting for packets...\n");
-    printf("(Stats will appear every 100 packets or when RTCP RR is detected)\n\n");
-    fflush(stdout);
+    ctl_stop();
+    filter_remove();
 
-    while (keep_running && (rv = recv(fd, buf, sizeof(buf), 0)) && rv >= 0) {
-        nfq_handle_packet(h, buf, rv);
+    // Workers leave their loop within RECV_TIMEOUT_MS
+    struct stats packet_stats = {0};
+    for (int i = 0; i < started; i++) {
+        pthread_join(workers[i].thread, NULL);
+        merge_stats(&packet_stats, &workers[i].path.stats);
     }
 
+    log_stop();
+
     printf("\n\n=== Final Statistics ===\n");
     printf("Total packets processed: %lu\n", packet_stats.total_packets);
     printf("UDP packets: %lu (%.1f%%)\n", 
@@ -736,12 +1487,72 @@ int main(int argc, char **argv)
     printf("RTCP Receiver Reports: %lu\n", packet_stats.rtcp_rr_packets);
     printf("RTCP RR Packets Dropped: %lu\n", packet_stats.rtcp_rr_dropped);
     printf("Fake RR Packets Injected: %lu\n", packet_stats.rtcp_rr_faked);
+    printf("RTCP RR Packets Rewritten: %lu\n", packet_stats.rtcp_rr_rewritten);
+    printf("Report blocks: %lu seen, %lu rewritten\n",
+           packet_stats.rtcp_blocks, packet_stats.rtcp_blocks_rewritten);
+    printf("Malformed compound RTCP: %lu\n", packet_stats.rtcp_malformed);
+    printf("Feedback: %lu REMB, %lu TWCC, %lu rewritten\n",
+           packet_stats.rtcp_remb, packet_stats.rtcp_twcc, packet_stats.rtcp_fb_rewritten);
+    if (config.synthetic_ms) {
+        printf("Synthetic RRs: %lu sent for %lu streams\n",
+               packet_stats.synthetic_sent, packet_stats.synthetic_streams);
+    }
+    if (config.track_rtp) {
+        printf("RTP media: %lu packets, %lu streams (%lu evicted)\n",
+               packet_stats.rtp_packets, packet_stats.rtp_streams, packet_stats.rtp_evicted);
+    }
+    printf("Policy streams: %lu (%lu evicted)\n",
+           packet_stats.policy_streams, packet_stats.policy_evicted);
     printf("Non-UDP packets: %lu\n", packet_stats.non_udp_packets);
+    printf("RTCP RR Truncated (copy range): %lu\n", packet_stats.rtcp_rr_truncated);
     printf("Parse errors: %lu\n", packet_stats.parse_errors);
+    if (config.batch_verdicts) {
+        printf("Batch verdicts: %lu\n", packet_stats.batch_verdicts);
+    }
+    printf("Non-RTCP packets queued: %lu\n", packet_stats.non_rtcp_queued);
+    printf("Flow cache: %lu hits, %lu misses (%.1f%% hit rate)\n",
+           packet_stats.flow_hits, packet_stats.flow_misses,
+           packet_stats.flow_hits + packet_stats.flow_misses > 0 ?
+           (100.0 * packet_stats.flow_hits / (packet_stats.flow_hits + packet_stats.flow_misses)) : 0);
+    printf("Flows tracked: %lu, uninteresting: %lu, evicted: %lu",
+           packet_stats.flows_tracked, packet_stats.flows_settled, packet_stats.flows_evicted);
+    if (config.bypass_after) {
+        printf(" (%lu packets marked)", packet_stats.bypass_marked);
+    }
+    printf("\n");
+    if (config.filter_iface && packet_stats.non_rtcp_queued) {
+        printf("  (pre-filter is active; check for other NFQUEUE rules on these queues)\n");
+    }
+    unsigned long queue_dropped, user_dropped;
+    if (sum_queue_drops(&queue_dropped, &user_dropped) == 0) {
+        printf("Kernel queue drops: %lu (queue full), %lu (socket overrun)\n",
+               queue_dropped, user_dropped);
+    }
+    printf("Log records dropped: %lu\n", log_dropped());
+    printf("Packets without NFQA timestamp: %lu\n", packet_stats.no_timestamp);
+    char report[CTL_STATS_MAX];
+    format_latency(report, sizeof(report));
+    fputs(report, stdout);
+    printf("RTT samples (LSR/DLSR): %lu\n", packet_stats.rtt_samples);
+    format_rtt(report, sizeof(report));
+    fputs(report, stdout);
+    if (config.track_rtp) {
+        format_rtp(report, sizeof(report));
+        fputs(report, stdout);
+    }
     printf("========================\n\n");
     
-    nfq_destroy_queue(qh);
-    nfq_close(h);
+    for (int i = 0; i < num_queues; i++) {
+        close_worker_queue(&workers[i]);
+    }
+    close_raw_socket();
+    
+    // No readers left
+    for (int i = 0; i < n_retired; i++) {
+        free(retired[i]);
+    }
+    profile_close(live->rules.profile);
+    free(live);
     printf("RTCP manipulator stopped\n");
-    return 0;
+    return exit_code;
 }
\ No newline at end of file
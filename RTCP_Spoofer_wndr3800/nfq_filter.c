@@ -0,0 +1,123 @@
+/* nfq_filter.c
+   Install / remove the RTCP pre-filter rule (see nfq_filter.h).
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+#include "nfq_filter.h"
+
+// u32: UDP, not a non-first fragment, and the first payload word (at IHL*4+8)
+// has version 2 in the top bits and a packet type of 200-206 (SR..XR)
+#define U32_RTCP "6&0xFF=0x11 && 4&0x1FFF=0 && 0>>22&0x3C@8>>16&0xC0FF=0x80C8:0x80CE"
+
+#define NFT_TABLE "nfq_dummy"
+#define NFT_CHAIN "prerouting"
+
+static int installed = -1;            // backend of the installed rule, -1 = none
+static char rule_iface[32];
+static char queue_spec[24];           // "N" or "first:last"
+static int queue_balanced;
+
+// fork/exec argv and wait; returns the exit status, -1 if it could not run
+static int run_cmd(char *const argv[]) {
+    pid_t pid = fork();
+    if (pid < 0) {
+        perror("fork");
+        return -1;
+    }
+    if (pid == 0) {
+        execvp(argv[0], argv);
+        _exit(127);
+    }
+
+    int status;
+    if (waitpid(pid, &status, 0) < 0) {
+        perror("waitpid");
+        return -1;
+    }
+    if (!WIFEXITED(status)) {
+        return -1;
+    }
+    if (WEXITSTATUS(status) == 127) {
+        fprintf(stderr, "Error: cannot run %s\n", argv[0]);
+    }
+    return WEXITSTATUS(status);
+}
+
+// op is "-I" or "-D"
+static int iptables_rule(const char *op) {
+    char *argv[] = {
+        "iptables", "-w", "-t", "mangle", (char *)op, "PREROUTING",
+        "-i", rule_iface, "-p", "udp", "-m", "u32", "--u32", U32_RTCP,
+        "-j", "NFQUEUE", queue_balanced ? "--queue-balance" : "--queue-num", queue_spec,
+        "--queue-bypass", NULL
+    };
+    return run_cmd(argv);
+}
+
+static int nft_install(void) {
+    char rule[256];
+    // nft queue ranges are written first-last
+    char spec[24];
+    snprintf(spec, sizeof(spec), "%s", queue_spec);
+    char *colon = strchr(spec, ':');
+    if (colon) {
+        *colon = '-';
+    }
+    snprintf(rule, sizeof(rule),
+             "add rule inet " NFT_TABLE " " NFT_CHAIN " iifname \"%s\" meta l4proto udp "
+             "ip frag-off & 0x1fff == 0 @th,64,2 2 @th,72,8 200-206 queue num %s bypass",
+             rule_iface, spec);
+
+    char *add_table[] = { "nft", "add table inet " NFT_TABLE, NULL };
+    char *add_chain[] = { "nft", "add chain inet " NFT_TABLE " " NFT_CHAIN
+                          " { type filter hook prerouting priority mangle; }", NULL };
+    char *add_rule[] = { "nft", rule, NULL };
+
+    if (run_cmd(add_table) != 0 || run_cmd(add_chain) != 0 || run_cmd(add_rule) != 0) {
+        char *del_table[] = { "nft", "delete table inet " NFT_TABLE, NULL };
+        run_cmd(del_table);
+        return -1;
+    }
+    return 0;
+}
+
+int filter_install(filter_backend_t backend, const char *iface, int first_queue, int last_queue) {
+    if (installed >= 0) {
+        return 0;
+    }
+
+    snprintf(rule_iface, sizeof(rule_iface), "%s", iface);
+    queue_balanced = last_queue > first_queue;
+    if (queue_balanced) {
+        snprintf(queue_spec, sizeof(queue_spec), "%d:%d", first_queue, last_queue);
+    } else {
+        snprintf(queue_spec, sizeof(queue_spec), "%d", first_queue);
+    }
+
+    int rv = backend == FILTER_NFT ? nft_install() : iptables_rule("-I");
+    if (rv != 0) {
+        fprintf(stderr, "Error: cannot install RTCP filter rule (%s)\n",
+                backend == FILTER_NFT ? "nft" : "iptables");
+        return -1;
+    }
+    installed = backend;
+    return 0;
+}
+
+void filter_remove(void) {
+    if (installed < 0) {
+        return;
+    }
+    if (installed == FILTER_NFT) {
+        char *del_table[] = { "nft", "delete table inet " NFT_TABLE, NULL };
+        run_cmd(del_table);
+    } else {
+        iptables_rule("-D");
+    }
+    installed = -1;
+}
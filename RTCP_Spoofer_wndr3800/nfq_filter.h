@@ -0,0 +1,22 @@
+/* nfq_filter.h
+   Kernel-side pre-filter: installs a rule that queues only RTCP (RTP
+   version 2, packet type 200-206 in the first UDP payload word) from one
+   interface, so media and everything else never leave the kernel.
+*/
+
+#ifndef NFQ_FILTER_H
+#define NFQ_FILTER_H
+
+typedef enum {
+    FILTER_IPTABLES = 0,      // mangle PREROUTING rule with the u32 match
+    FILTER_NFT = 1            // own "inet nfq_dummy" table with raw payload match
+} filter_backend_t;
+
+// Install the rule for iface sending to queues first..last (balanced when
+// more than one, bypassed when nobody listens). Returns 0 on success.
+int filter_install(filter_backend_t backend, const char *iface, int first_queue, int last_queue);
+
+// Remove whatever filter_install added (no-op if nothing is installed)
+void filter_remove(void);
+
+#endif
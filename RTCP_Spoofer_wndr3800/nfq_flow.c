@@ -0,0 +1,124 @@
+/* nfq_flow.c
+   Flow cache and classifier (see nfq_flow.h).
+*/
+
+#include <netinet/in.h>
+#include <netinet/ip.h>
+
+#include "nfq_flow.h"
+
+struct flow_table *flow_table_create(void) {
+    return table_alloc(sizeof(struct flow_table));
+}
+
+static uint32_t flow_hash(const struct flow_entry *k) {
+    return table_hash_fold(table_hash_addrs(k->saddr, k->daddr, k->sport, k->dport) ^ k->proto);
+}
+
+static int key_equal(const struct flow_entry *a, const struct flow_entry *b) {
+    return a->saddr == b->saddr && a->daddr == b->daddr &&
+           a->sport == b->sport && a->dport == b->dport && a->proto == b->proto;
+}
+
+// Find the flow's entry or claim one in its bucket: a free or idle entry,
+// else the least recently seen. Sets *way for the packets counter.
+static struct flow_entry *lookup(struct flow_table *t, const struct flow_entry *k,
+                                 uint16_t now, uint32_t *bucket, int *way) {
+    uint32_t h = flow_hash(k) & (FLOW_BUCKETS - 1);
+    struct flow_entry *b = t->b[h].e;
+    int free_way = -1, oldest = -1;
+
+    *bucket = h;
+    for (int i = 0; i < FLOW_WAYS; i++) {
+        if (b[i].cls != FLOW_FREE && key_equal(&b[i], k)) {
+            t->hits++;
+            *way = i;
+            return &b[i];
+        }
+    }
+    for (int i = 0; i < FLOW_WAYS; i++) {
+        uint16_t idle = now - b[i].last_seen;
+        if (b[i].cls == FLOW_FREE || idle > FLOW_IDLE_SEC) {
+            free_way = i;
+            break;
+        }
+        if (oldest < 0 || idle > (uint16_t)(now - b[oldest].last_seen)) {
+            oldest = i;
+        }
+    }
+
+    if (free_way < 0) {
+        free_way = oldest;
+        t->evicted++;
+    }
+    struct flow_entry *e = &b[free_way];
+    *e = *k;
+    e->cls = FLOW_UNKNOWN;
+    t->packets[h][free_way] = 0;
+    t->misses++;
+    t->tracked++;
+    *way = free_way;
+    return e;
+}
+
+flow_pkt_t flow_classify(struct flow_table *t, const unsigned char *packet, int packet_len,
+                         uint32_t now, int bypass_after) {
+    const struct iphdr *iph = (const struct iphdr *)packet;
+    // Non-first fragments carry no ports
+    if (packet_len < 20 || iph->version != 4 || (ntohs(iph->frag_off) & 0x1FFF)) {
+        t->uncached++;
+        return FLOW_PKT_OTHER;
+    }
+
+    int l4 = iph->ihl * 4;
+    struct flow_entry k = { .saddr = iph->saddr, .daddr = iph->daddr, .proto = iph->protocol };
+    const unsigned char *payload = NULL;
+
+    if (iph->protocol == IPPROTO_UDP || iph->protocol == IPPROTO_TCP) {
+        if (packet_len < l4 + 4) {
+            t->uncached++;
+            return FLOW_PKT_OTHER;
+        }
+        k.sport = (packet[l4] << 8) | packet[l4 + 1];
+        k.dport = (packet[l4 + 2] << 8) | packet[l4 + 3];
+        if (iph->protocol == IPPROTO_UDP && packet_len >= l4 + 10) {
+            payload = packet + l4 + 8;
+        }
+    }
+
+    uint32_t bucket;
+    int way;
+    struct flow_entry *e = lookup(t, &k, (uint16_t)now, &bucket, &way);
+    e->last_seen = (uint16_t)now;
+
+    if (e->cls == FLOW_OTHER) {
+        // Mark not restored yet (first packets in flight, or the conntrack
+        // entry was recreated); keep marking
+        return bypass_after ? FLOW_PKT_BYPASS : FLOW_PKT_OTHER;
+    }
+
+    if (e->cls == FLOW_UNKNOWN) {
+        // RFC 7983 demultiplexing on the first payload byte
+        uint8_t b0 = payload ? payload[0] : 0xFF;
+        if (b0 <= 3 || (b0 >= 20 && b0 <= 63) || (b0 >= 128 && b0 <= 191)) {
+            e->cls = FLOW_RTC;
+        } else {
+            if (++t->packets[bucket][way] >= (bypass_after ? bypass_after : FLOW_SETTLE)) {
+                e->cls = FLOW_OTHER;
+                t->settled++;
+                return bypass_after ? FLOW_PKT_BYPASS : FLOW_PKT_OTHER;
+            }
+            return FLOW_PKT_OTHER;
+        }
+    }
+
+    // FLOW_RTC: version 2, then RTCP packet types 200-206 (what the kernel
+    // pre-filter matches) or RTP (anything outside RTCP's 192-223)
+    if (!payload || (payload[0] & 0xC0) != 0x80) {
+        return FLOW_PKT_OTHER;
+    }
+    if (payload[1] >= 200 && payload[1] <= 206) {
+        return FLOW_PKT_RTCP;
+    }
+    return payload[1] >= 192 && payload[1] <= 223 ? FLOW_PKT_OTHER : FLOW_PKT_RTP;
+}
@@ -0,0 +1,88 @@
+/* nfq_flow.h
+   Per-worker flow cache: the first classification step of every packet.
+
+   Every queued packet is looked up by its 5-tuple in a fixed-size table of
+   cache-line buckets, so one probe touches one line. The entry remembers
+   what the flow has shown:
+
+     FLOW_RTC      anything WebRTC multiplexes on one port (RTP/RTCP, STUN,
+                   DTLS; RFC 7983 first-byte ranges). Its packets are told
+                   apart by the first two payload bytes alone: RTCP with a
+                   packet type of 200-206 goes on to the RTCP walk, other
+                   version 2 packets are RTP media, the rest is accepted.
+     FLOW_OTHER    N packets of nothing else. Accepted without looking into
+                   the payload again; with -B also given the bypass mark,
+                   which CONNMARK rules save and restore so the rest of the
+                   flow skips the queue.
+
+   Entries idle for FLOW_IDLE_SEC are reused, and a full bucket gives up
+   its least recently seen flow, so the footprint is fixed: 72 KB per
+   worker, 1.1 MB with every queue of MAX_QUEUES in use.
+*/
+
+#ifndef NFQ_FLOW_H
+#define NFQ_FLOW_H
+
+#include <stdint.h>
+
+#include "nfq_table.h"
+
+#define FLOW_BUCKETS    1024        // power of two
+#define FLOW_WAYS       4           // entries per bucket, 16 bytes each
+#define FLOW_LINE       TABLE_LINE  // bucket alignment
+#define FLOW_IDLE_SEC   60          // entries idle this long are reused
+#define FLOW_SETTLE     32          // packets before FLOW_OTHER when -B is not given
+
+// Verdict mark bit for bypassed flows; must match the CONNMARK rules
+#define BYPASS_MARK     0x00100000
+
+typedef enum {
+    FLOW_FREE = 0,
+    FLOW_UNKNOWN,                   // still being classified
+    FLOW_RTC,                       // carries RTP/RTCP/STUN/DTLS, keep queueing
+    FLOW_OTHER                      // proven uninteresting
+} flow_class_t;
+
+// What the packet path does with one packet
+typedef enum {
+    FLOW_PKT_OTHER = 0,             // accept, nothing to look at
+    FLOW_PKT_RTCP,                  // RTCP packet type 200-206: walk it
+    FLOW_PKT_RTP,                   // RTP media (for -M)
+    FLOW_PKT_BYPASS                 // accept with BYPASS_MARK
+} flow_pkt_t;
+
+struct flow_entry {
+    uint32_t saddr, daddr;          // network order
+    uint16_t sport, dport;          // host order
+    uint8_t proto;
+    uint8_t cls;                    // flow_class_t
+    uint16_t last_seen;             // seconds mod 65536, CLOCK_MONOTONIC_COARSE
+};
+
+struct flow_bucket {
+    struct flow_entry e[FLOW_WAYS];
+} __attribute__((aligned(FLOW_LINE)));
+
+struct flow_table {
+    struct flow_bucket b[FLOW_BUCKETS];
+    // Packets counted toward FLOW_OTHER; only touched while a flow is
+    // FLOW_UNKNOWN, so kept out of the buckets
+    uint16_t packets[FLOW_BUCKETS][FLOW_WAYS];
+    unsigned long hits;             // packets whose flow was in the table
+    unsigned long misses;           // packets that inserted their flow
+    unsigned long uncached;         // packets without a 5-tuple (fragments, non-IPv4)
+    unsigned long tracked;          // flows inserted
+    unsigned long settled;          // flows classified FLOW_OTHER (bypassed with -B)
+    unsigned long evicted;          // live flows pushed out of a full bucket
+};
+
+// An empty table, from table_alloc
+struct flow_table *flow_table_create(void);
+
+// Classify one packet. A flow becomes FLOW_OTHER after bypass_after
+// packets of nothing WebRTC, or FLOW_SETTLE when bypass_after is 0 (no
+// bypass: FLOW_PKT_BYPASS is never returned).
+flow_pkt_t flow_classify(struct flow_table *t, const unsigned char *packet, int packet_len,
+                         uint32_t now, int bypass_after);
+
+#endif
@@ -0,0 +1,58 @@
+/* nfq_hist.c
+   Log-bucketed latency histograms (see nfq_hist.h).
+*/
+
+#include <stdio.h>
+
+#include "nfq_hist.h"
+
+void hist_merge(struct hist *dst, const struct hist *src) {
+    dst->count += src->count;
+    dst->sum_ns += src->sum_ns;
+    if (src->max_ns > dst->max_ns) {
+        dst->max_ns = src->max_ns;
+    }
+    for (int i = 0; i < HIST_BUCKETS; i++) {
+        dst->b[i] += src->b[i];
+    }
+}
+
+// Smallest value of bucket i
+static uint64_t bucket_floor(int i) {
+    if (i < HIST_SUB) {
+        return i;
+    }
+    int e = i / HIST_SUB + HIST_SUB_BITS - 1;
+    return (uint64_t)(HIST_SUB + i % HIST_SUB) << (e - HIST_SUB_BITS);
+}
+
+uint64_t hist_quantile(const struct hist *h, double p) {
+    if (h->count == 0) {
+        return 0;
+    }
+    unsigned long rank = (unsigned long)(p * h->count + 0.5);
+    unsigned long seen = 0;
+    if (rank < 1) {
+        rank = 1;
+    }
+    for (int i = 0; i < HIST_BUCKETS - 1; i++) {
+        seen += h->b[i];
+        if (seen >= rank) {
+            uint64_t upper = bucket_floor(i + 1) - 1;
+            return upper < h->max_ns ? upper : h->max_ns;
+        }
+    }
+    return h->max_ns;
+}
+
+int hist_format(char *buf, size_t cap, const char *name, const struct hist *h) {
+    if (h->count == 0) {
+        return snprintf(buf, cap, "%-12s n=0\n", name);
+    }
+    return snprintf(buf, cap,
+                    "%-12s n=%lu mean=%.1f p50=%.1f p90=%.1f p99=%.1f p99.9=%.1f max=%.1f us\n",
+                    name, h->count, h->sum_ns / 1000.0 / h->count,
+                    hist_quantile(h, 0.50) / 1000.0, hist_quantile(h, 0.90) / 1000.0,
+                    hist_quantile(h, 0.99) / 1000.0, hist_quantile(h, 0.999) / 1000.0,
+                    h->max_ns / 1000.0);
+}
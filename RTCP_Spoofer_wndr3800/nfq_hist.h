@@ -0,0 +1,54 @@
+/* nfq_hist.h
+   Log-bucketed latency histograms for the verdict path.
+
+   Values (nanoseconds) fall into 4 buckets per power of two, so any
+   reported percentile is within 25% of the true value. Recording is a
+   count-leading-zeros and two increments; each worker owns its histograms
+   and they are merged for reporting only.
+*/
+
+#ifndef NFQ_HIST_H
+#define NFQ_HIST_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define HIST_SUB_BITS 2
+#define HIST_SUB      (1 << HIST_SUB_BITS)
+#define HIST_BUCKETS  128           // up to ~4.3 s; larger values land in the last bucket
+
+struct hist {
+    unsigned long count;
+    uint64_t sum_ns;
+    uint64_t max_ns;
+    unsigned long b[HIST_BUCKETS];
+};
+
+static inline int hist_bucket(uint64_t ns) {
+    if (ns < HIST_SUB) {
+        return (int)ns;
+    }
+    int e = 63 - __builtin_clzll(ns);
+    int i = (e - HIST_SUB_BITS + 1) * HIST_SUB + (int)((ns >> (e - HIST_SUB_BITS)) & (HIST_SUB - 1));
+    return i < HIST_BUCKETS ? i : HIST_BUCKETS - 1;
+}
+
+static inline void hist_add(struct hist *h, uint64_t ns) {
+    h->b[hist_bucket(ns)]++;
+    h->count++;
+    h->sum_ns += ns;
+    if (ns > h->max_ns) {
+        h->max_ns = ns;
+    }
+}
+
+void hist_merge(struct hist *dst, const struct hist *src);
+
+// Upper bound of the bucket holding the p-th quantile (0 < p <= 1), capped at max
+uint64_t hist_quantile(const struct hist *h, double p);
+
+// One line: "name: n=... mean=... p50=... p90=... p99=... p99.9=... max=..." in
+// microseconds. Returns the length written (snprintf semantics).
+int hist_format(char *buf, size_t cap, const char *name, const struct hist *h);
+
+#endif
@@ -0,0 +1,147 @@
+/* nfq_log.c
+   Asynchronous leveled logging (see nfq_log.h).
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <pthread.h>
+
+#include "nfq_log.h"
+
+int log_level = LOG_LVL_INFO;
+
+static struct log_ring *rings[LOG_MAX_RINGS];
+static uint32_t n_rings;
+static __thread struct log_ring *tls_ring;
+
+static FILE *log_out;
+static pthread_t log_thread;
+static volatile int log_running;
+
+static const char *const level_names[] = { "E", "W", "I", "D", "T" };
+
+static uint64_t now_us(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000ull + (uint64_t)ts.tv_nsec / 1000;
+}
+
+static void format_record(FILE *out, const struct log_record *r) {
+    const uint32_t *a = r->args;
+    if (r->level <= LOG_LVL_WARN)
+        fprintf(out, "[%s %llu.%06llu] ", level_names[r->level],
+                (unsigned long long)(r->ts_us / 1000000), (unsigned long long)(r->ts_us % 1000000));
+    if (r->tag)
+        fputs(r->tag, out);
+    fprintf(out, r->fmt, a[0], a[1], a[2], a[3], a[4], a[5], a[6], a[7], a[8], a[9]);
+}
+
+void log_write(int lvl, const char *tag, const char *fmt, const uint32_t *args) {
+    struct log_ring *ring = tls_ring;
+
+    if (!ring) {
+        struct log_record r = { .fmt = fmt, .tag = tag, .ts_us = now_us(), .level = (uint8_t)lvl };
+        memcpy(r.args, args, sizeof(r.args));
+        format_record(lvl <= LOG_LVL_WARN ? stderr : stdout, &r);
+        return;
+    }
+
+    uint32_t head = ring->head;
+    if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) >= LOG_RING_SIZE) {
+        ring->dropped++;
+        return;
+    }
+    struct log_record *r = &ring->rec[head & (LOG_RING_SIZE - 1)];
+    r->fmt = fmt;
+    r->tag = tag;
+    r->ts_us = now_us();
+    r->level = (uint8_t)lvl;
+    memcpy(r->args, args, sizeof(r->args));
+    __atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+int log_register_thread(void) {
+    if (tls_ring)
+        return 0;
+    uint32_t idx = __atomic_fetch_add(&n_rings, 1, __ATOMIC_ACQ_REL);
+    if (idx >= LOG_MAX_RINGS) {
+        fprintf(stderr, "Error: too many logging threads (max %d)\n", LOG_MAX_RINGS);
+        return -1;
+    }
+    struct log_ring *ring = calloc(1, sizeof(*ring));
+    if (!ring) {
+        perror("calloc");
+        return -1;
+    }
+    __atomic_store_n(&rings[idx], ring, __ATOMIC_RELEASE);
+    tls_ring = ring;
+    return 0;
+}
+
+// Format everything currently queued; returns the number of records written
+static int drain(FILE *out) {
+    int n = 0;
+    uint32_t count = __atomic_load_n(&n_rings, __ATOMIC_ACQUIRE);
+    if (count > LOG_MAX_RINGS) count = LOG_MAX_RINGS;
+
+    for (uint32_t i = 0; i < count; i++) {
+        struct log_ring *ring = __atomic_load_n(&rings[i], __ATOMIC_ACQUIRE);
+        if (!ring) continue;
+        uint32_t tail = ring->tail;
+        uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        while (tail != head) {
+            format_record(out, &ring->rec[tail & (LOG_RING_SIZE - 1)]);
+            tail++;
+            n++;
+        }
+        __atomic_store_n(&ring->tail, tail, __ATOMIC_RELEASE);
+    }
+    return n;
+}
+
+static void *log_main(void *arg) {
+    FILE *out = arg;
+    const struct timespec idle = { .tv_sec = 0, .tv_nsec = 5 * 1000 * 1000 };
+
+    while (log_running) {
+        if (drain(out))
+            fflush(out);
+        else
+            nanosleep(&idle, NULL);
+    }
+    drain(out);
+    fflush(out);
+    return NULL;
+}
+
+int log_start(FILE *out) {
+    log_out = out;
+    log_running = 1;
+    if (pthread_create(&log_thread, NULL, log_main, out) != 0) {
+        log_running = 0;
+        fprintf(stderr, "Error: cannot start logging thread\n");
+        return -1;
+    }
+    return 0;
+}
+
+void log_stop(void) {
+    if (!log_running)
+        return;
+    log_running = 0;
+    pthread_join(log_thread, NULL);
+    fflush(log_out);
+}
+
+unsigned long log_dropped(void) {
+    unsigned long total = 0;
+    uint32_t count = __atomic_load_n(&n_rings, __ATOMIC_ACQUIRE);
+    if (count > LOG_MAX_RINGS) count = LOG_MAX_RINGS;
+    for (uint32_t i = 0; i < count; i++) {
+        struct log_ring *ring = __atomic_load_n(&rings[i], __ATOMIC_ACQUIRE);
+        if (ring) total += __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+    }
+    return total;
+}
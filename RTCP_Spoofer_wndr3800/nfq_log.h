@@ -0,0 +1,92 @@
+/* nfq_log.h
+   Asynchronous leveled logging for the verdict path.
+
+   LOG_* calls below LOG_COMPILE_LEVEL compile to nothing; the rest are
+   checked against the runtime level and, if enabled, stored as a binary
+   record (format pointer, optional tag, up to LOG_ARGS_MAX 32-bit args) in a
+   lock-free single-producer ring. A background thread formats and flushes
+   the records, so the packet path never formats or blocks.
+
+   Rules for deferred records: the format and tag must be string literals,
+   and every argument must be a 32-bit integer conversion (%u %d %x %X %c).
+   Use LOG_IP() for addresses. Threads without a registered ring (startup,
+   control threads) fall back to formatting synchronously.
+*/
+
+#ifndef NFQ_LOG_H
+#define NFQ_LOG_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <arpa/inet.h>
+
+#define LOG_LVL_ERROR 0
+#define LOG_LVL_WARN  1
+#define LOG_LVL_INFO  2
+#define LOG_LVL_DEBUG 3
+#define LOG_LVL_TRACE 4
+
+// Build with -DLOG_COMPILE_LEVEL=LOG_LVL_INFO to drop debug records entirely
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_LVL_DEBUG
+#endif
+
+#define LOG_ARGS_MAX  10
+#define LOG_RING_SIZE 1024          // records per producer, power of two
+#define LOG_MAX_RINGS 16
+
+struct log_record {
+    const char *fmt;
+    const char *tag;                // printed before fmt, may be NULL
+    uint64_t ts_us;
+    uint8_t level;
+    uint32_t args[LOG_ARGS_MAX];
+};
+
+struct log_ring {
+    uint32_t head;                  // written by the producer
+    uint32_t tail;                  // written by the logger thread
+    uint32_t dropped;               // records lost because the ring was full
+    struct log_record rec[LOG_RING_SIZE];
+};
+
+extern int log_level;
+
+// Dotted-quad arguments for a network-order IPv4 address: "%u.%u.%u.%u"
+#define LOG_IP(a) ((ntohl(a) >> 24) & 0xFF), ((ntohl(a) >> 16) & 0xFF), \
+                  ((ntohl(a) >> 8) & 0xFF), (ntohl(a) & 0xFF)
+
+#define LOG_AT(lvl, tag, fmt, ...) do {                                      \
+    if ((lvl) <= LOG_COMPILE_LEVEL && (lvl) <= log_level)                    \
+        log_write((lvl), (tag), fmt,                                         \
+                  (const uint32_t[LOG_ARGS_MAX]){ __VA_ARGS__ });            \
+    if (0) printf(fmt, ##__VA_ARGS__);  /* format checking only */           \
+} while (0)
+
+#define LOG_ERROR(...) LOG_AT(LOG_LVL_ERROR, NULL, __VA_ARGS__)
+#define LOG_WARN(...)  LOG_AT(LOG_LVL_WARN,  NULL, __VA_ARGS__)
+#define LOG_INFO(...)  LOG_AT(LOG_LVL_INFO,  NULL, __VA_ARGS__)
+#define LOG_DEBUG(...) LOG_AT(LOG_LVL_DEBUG, NULL, __VA_ARGS__)
+#define LOG_TRACE(...) LOG_AT(LOG_LVL_TRACE, NULL, __VA_ARGS__)
+
+// Same, with a string-literal tag such as "[REPLACE] " printed first
+#define LOG_DEBUG_T(tag, ...) LOG_AT(LOG_LVL_DEBUG, tag, __VA_ARGS__)
+#define LOG_TRACE_T(tag, ...) LOG_AT(LOG_LVL_TRACE, tag, __VA_ARGS__)
+
+static inline int log_enabled(int lvl) {
+    return lvl <= LOG_COMPILE_LEVEL && lvl <= log_level;
+}
+
+void log_write(int lvl, const char *tag, const char *fmt, const uint32_t *args);
+
+// Give the calling thread its own ring (call once per packet thread)
+int log_register_thread(void);
+
+// Start / stop the formatter thread; stop drains everything still queued
+int log_start(FILE *out);
+void log_stop(void);
+
+// Records dropped on full rings so far
+unsigned long log_dropped(void);
+
+#endif
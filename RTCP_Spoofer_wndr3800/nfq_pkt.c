@@ -0,0 +1,590 @@
+/* nfq_pkt.c
+   Per-packet classification and RTCP rewrite (see nfq_pkt.h).
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+
+#include "nfq_pkt.h"
+#include "nfq_log.h"
+#include "nfq_sched.h"
+
+const char *const pkt_class_names[PKT_CLASSES] = {
+    "non-udp", "udp", "rtcp", "rewritten", "injected"
+};
+
+// Fake RRs are built here (one per thread); the verdict path never allocates
+static __thread unsigned char inject_buf[MAX_PACKET_SIZE];
+
+// Enhanced checksum calculation with detailed debugging
+uint16_t calculate_ip_checksum_debug(struct iphdr *iph, const char *debug_prefix) {
+    uint16_t *ip_data = (uint16_t *)iph;
+    int ip_header_len = iph->ihl * 4;
+    uint32_t sum = 0;
+    
+    LOG_TRACE_T(debug_prefix, "Calculating IP checksum for %d words (%d bytes):\n",
+                ip_header_len / 2, ip_header_len);
+    
+    for (int i = 0; i < ip_header_len / 2; i++) {
+        uint16_t word = ntohs(ip_data[i]);
+        
+        // Skip the checksum field itself (word 5 in standard 20-byte header)
+        if (i == 5) {
+            LOG_TRACE_T(debug_prefix, "  Word %2d: 0x%04X [checksum field - skipping]\n", i, word);
+            continue;
+        }
+        
+        sum += word;
+        
+        // Handle carry
+        while (sum >> 16) {
+            sum = (sum & 0xFFFF) + (sum >> 16);
+        }
+        LOG_TRACE_T(debug_prefix, "  Word %2d: 0x%04X -> sum: 0x%08X\n", i, word, sum);
+    }
+    
+    uint16_t result = ~sum;
+    LOG_TRACE_T(debug_prefix, "Final sum: 0x%08X, One's complement: 0x%04X\n", sum, result);
+    return result;
+}
+
+// Calculate UDP checksum including pseudo-header
+uint16_t calculate_udp_checksum(struct iphdr *iph, struct udphdr *udph,
+                                const unsigned char *payload, int payload_len) {
+    uint32_t sum = 0;
+    uint16_t *data;
+    int i;
+    
+    LOG_TRACE("    [UDP CHECKSUM] Calculating UDP checksum:\n");
+    
+    // Pseudo-header: source IP (2 words)
+    data = (uint16_t*)&iph->saddr;
+    sum += ntohs(data[0]);
+    sum += ntohs(data[1]);
+    LOG_TRACE("    [UDP CHECKSUM]   Source IP: 0x%04X + 0x%04X -> sum: 0x%08X\n",
+              ntohs(data[0]), ntohs(data[1]), sum);
+    
+    // Pseudo-header: destination IP (2 words)
+    data = (uint16_t*)&iph->daddr;
+    sum += ntohs(data[0]);
+    sum += ntohs(data[1]);
+    LOG_TRACE("    [UDP CHECKSUM]   Dest IP: 0x%04X + 0x%04X -> sum: 0x%08X\n",
+              ntohs(data[0]), ntohs(data[1]), sum);
+    
+    // Pseudo-header: protocol and UDP length
+    sum += IPPROTO_UDP;
+    sum += ntohs(udph->uh_ulen);
+    LOG_TRACE("    [UDP CHECKSUM]   Protocol+Length: 0x%04X + 0x%04X -> sum: 0x%08X\n",
+              IPPROTO_UDP, ntohs(udph->uh_ulen), sum);
+    
+    // UDP header (excluding checksum field)
+    sum += ntohs(udph->uh_sport);
+    sum += ntohs(udph->uh_dport);
+    sum += ntohs(udph->uh_ulen);
+    LOG_TRACE("    [UDP CHECKSUM]   UDP header: 0x%04X + 0x%04X + 0x%04X -> sum: 0x%08X\n",
+              ntohs(udph->uh_sport), ntohs(udph->uh_dport), ntohs(udph->uh_ulen), sum);
+    
+    // UDP payload
+    data = (uint16_t*)payload;
+    for (i = 0; i < payload_len / 2; i++) {
+        uint16_t word = ntohs(data[i]);
+        sum += word;
+        
+        // Handle carry
+        while (sum >> 16) {
+            sum = (sum & 0xFFFF) + (sum >> 16);
+        }
+        LOG_TRACE("    [UDP CHECKSUM]   Payload word %d: 0x%04X -> sum: 0x%08X\n", i, word, sum);
+    }
+    
+    // If payload length is odd, add the last byte
+    if (payload_len % 2) {
+        uint16_t last_byte = ((uint16_t)payload[payload_len - 1]) << 8;
+        sum += last_byte;
+        
+        while (sum >> 16) {
+            sum = (sum & 0xFFFF) + (sum >> 16);
+        }
+        LOG_TRACE("    [UDP CHECKSUM]   Last byte: 0x%04X -> sum: 0x%08X\n", last_byte, sum);
+    }
+    
+    uint16_t result = ~sum;
+    LOG_TRACE("    [UDP CHECKSUM] Final sum: 0x%08X, One's complement: 0x%04X\n", sum, result);
+    // 0 means "no checksum" in UDP, so a computed 0 is sent as 0xFFFF
+    return result ? result : 0xFFFF;
+}
+
+// Debug dump of one report block (walker callback, ctx = log tag)
+static int log_report_block(void *ctx, uint32_t sender_ssrc, struct rtcp_report_block *rb) {
+    const char *prefix = ctx;
+    uint32_t source_ssrc = ntohl(rb->ssrc);
+    
+    // Parse fraction lost and cumulative lost
+    uint32_t fraction_lost = ntohl(rb->fraction_lost);
+    uint8_t fraction = (fraction_lost >> 24) & 0xFF;
+    uint32_t cumulative_lost = fraction_lost & 0xFFFFFF;
+    // Convert from 24-bit signed to 32-bit signed
+    if (cumulative_lost & 0x800000) {
+        cumulative_lost |= 0xFF000000;
+    }
+    
+    LOG_DEBUG_T(prefix, "Report block (sender 0x%08X):\n", sender_ssrc);
+    LOG_DEBUG_T(prefix, "  Source SSRC: %u (0x%08X)\n", source_ssrc, source_ssrc);
+    LOG_DEBUG_T(prefix, "  Fraction Lost: %u/256 (%u%%)\n", fraction, (fraction * 100) / 256);
+    LOG_DEBUG_T(prefix, "  Cumulative Packets Lost: %d\n", (int32_t)cumulative_lost);
+    LOG_DEBUG_T(prefix, "  Extended Highest Seq: %u\n", ntohl(rb->extended_high_seq));
+    LOG_DEBUG_T(prefix, "  Jitter: %u\n", ntohl(rb->jitter));
+    LOG_DEBUG_T(prefix, "  Last SR Timestamp: %u (0x%08X)\n", ntohl(rb->lsr), ntohl(rb->lsr));
+    LOG_DEBUG_T(prefix, "  Delay Since Last SR: %u units\n", ntohl(rb->dlsr));
+    return 0;
+}
+
+// Walker callback: print one REMB / transport-wide CC message
+static int log_feedback(void *ctx, int type, unsigned char *fb, int len, uint16_t *udp_csum) {
+    const char *prefix = ctx;
+    (void)udp_csum;
+    
+    if (type == RTCP_FB_REMB) {
+        int64_t bitrate = remb_get_bitrate(fb, len);
+        LOG_DEBUG_T(prefix, "REMB: %u kbps for %u SSRCs\n",
+                    bitrate < 0 ? 0 : (uint32_t)(bitrate / 1000), fb[16]);
+    } else if (len >= 20) {
+        LOG_DEBUG_T(prefix, "TWCC: base seq %u, %u packets, fb count %u\n",
+                    (fb[12] << 8) | fb[13], (fb[14] << 8) | fb[15], fb[19]);
+    }
+    return 0;
+}
+
+static const struct rtcp_handlers log_handlers = { log_report_block, log_feedback, NULL };
+
+// Print every report block and feedback message of a compound RTCP packet
+static void print_rtcp_details(unsigned char *rtcp_data, int rtcp_len, const char *prefix) {
+    struct rtcp_walk walk;
+    
+    if (!log_enabled(LOG_LVL_DEBUG)) {
+        return;
+    }
+    rtcp_walk(rtcp_data, rtcp_len, &log_handlers, (void *)prefix, NULL, &walk);
+    LOG_DEBUG_T(prefix, "%d sub-packets, %d report blocks, %d REMB, %d TWCC, malformed=%d\n",
+                walk.packets, walk.blocks, walk.remb, walk.twcc, walk.malformed);
+}
+
+// Test function to verify packet integrity
+static void verify_packet_integrity(const unsigned char *packet, int len, const char *label) {
+    struct iphdr *iph = (struct iphdr *)packet;
+    int ip_header_len = iph->ihl * 4;
+    
+    if (!log_enabled(LOG_LVL_DEBUG)) {
+        return;
+    }
+    
+    LOG_DEBUG_T(label, "\n");
+    LOG_DEBUG("    IP Version: %d, IHL: %d, Total Length: %d\n",
+              iph->version, iph->ihl, ntohs(iph->tot_len));
+    LOG_DEBUG("    Protocol: %d, Checksum: 0x%04X\n", iph->protocol, ntohs(iph->check));
+    LOG_DEBUG("    Source: %u.%u.%u.%u\n", LOG_IP(iph->saddr));
+    LOG_DEBUG("    Dest: %u.%u.%u.%u\n", LOG_IP(iph->daddr));
+    
+    // Verify IP checksum
+    uint16_t calculated = calculate_ip_checksum_debug((struct iphdr *)packet, "    [VERIFY] ");
+    if (calculated == ntohs(iph->check)) {
+        LOG_DEBUG("    IP Checksum VALID: calculated=0x%04X, packet=0x%04X\n",
+                  calculated, ntohs(iph->check));
+    } else {
+        LOG_DEBUG("    IP Checksum INVALID: calculated=0x%04X, packet=0x%04X\n",
+                  calculated, ntohs(iph->check));
+    }
+    
+    if (iph->protocol == IPPROTO_UDP) {
+        struct udphdr *udph = (struct udphdr *)(packet + ip_header_len);
+        LOG_DEBUG("    UDP Source Port: %d, Dest Port: %d\n",
+                  ntohs(udph->uh_sport), ntohs(udph->uh_dport));
+        LOG_DEBUG("    UDP Length: %d, Checksum: 0x%04X\n",
+                  ntohs(udph->uh_ulen), ntohs(udph->uh_sum));
+        
+        // Print some RTCP info
+        if (len >= ip_header_len + 8 + 8) {
+            const unsigned char *rtcp_data = packet + ip_header_len + 8;
+            unsigned char version = (rtcp_data[0] >> 6) & 0x03;
+            unsigned char packet_type = rtcp_data[1];
+            LOG_DEBUG("    RTCP Version: %d, Type: %d\n", version, packet_type);
+        }
+    }
+}
+
+// Per-packet context for rewrite_block / rewrite_feedback
+struct block_rewrite {
+    const struct live_config *cfg;
+    struct policy_table *policies;
+    struct policy_key key;              // 5-tuple; ssrc filled in per block
+    uint32_t now;
+    struct rtt_table *rtt;              // NULL: no RTT estimation
+    uint64_t arrival_ns;
+    int rtt_samples;
+};
+
+// Walker callback: remember when an SR passed
+static void observe_sr(void *ctx, uint32_t sender_ssrc, const unsigned char *info) {
+    struct block_rewrite *rw = ctx;
+    if (rw->rtt) {
+        rtt_sr(rw->rtt, sender_ssrc, info, rw->arrival_ns);
+    }
+}
+
+// Walker callback: RTT sample from a report block's LSR/DLSR
+static int observe_block(void *ctx, uint32_t sender_ssrc, struct rtcp_report_block *rb) {
+    struct block_rewrite *rw = ctx;
+    (void)sender_ssrc;
+    
+    if (rw->rtt) {
+        rw->rtt_samples += rtt_report(rw->rtt, rb, rw->key.saddr, rw->key.sport, rw->arrival_ns);
+    }
+    return 0;
+}
+
+// Walker callback: take the block's RTT sample, then apply the stream's
+// policy to it
+static int rewrite_block(void *ctx, uint32_t sender_ssrc, struct rtcp_report_block *rb) {
+    struct block_rewrite *rw = ctx;
+    uint32_t jitter = ntohl(rb->jitter), fraction_lost = ntohl(rb->fraction_lost);
+    
+    observe_block(ctx, sender_ssrc, rb);
+    rw->key.ssrc = ntohl(rb->ssrc);
+    if (!policy_apply(rw->policies, &rw->cfg->rules, &rw->key, rw->now, rb)) {
+        return 0;
+    }
+    
+    LOG_DEBUG("    [MODIFY] SSRC 0x%08X: Jitter %u -> %u, Fraction Lost 0x%08X -> 0x%08X\n",
+              rw->key.ssrc, jitter, ntohl(rb->jitter), fraction_lost, ntohl(rb->fraction_lost));
+    return 1;
+}
+
+// Walker callback: clamp/set the REMB bitrate or stretch the TWCC receive
+// deltas, in place
+static int rewrite_feedback(void *ctx, int type, unsigned char *fb, int len, uint16_t *udp_csum) {
+    const struct feedback_rewrite *fr = &((struct block_rewrite *)ctx)->cfg->fb;
+    
+    if (type == RTCP_FB_REMB) {
+        if (fr->remb_op == REMB_KEEP) {
+            return 0;
+        }
+        int64_t bitrate = remb_get_bitrate(fb, len);
+        if (bitrate < 0) {
+            return -1;
+        }
+        uint64_t target = fr->remb_bitrate;
+        if (fr->remb_op == REMB_CLAMP && (uint64_t)bitrate < target) {
+            target = bitrate;
+        }
+        LOG_DEBUG("    [MODIFY] REMB %u kbps -> %u kbps\n",
+                  (uint32_t)(bitrate / 1000), (uint32_t)(target / 1000));
+        return remb_set_bitrate(fb, len, target, udp_csum);
+    }
+    
+    if (!fr->twcc_enabled) {
+        return 0;
+    }
+    int changed = twcc_adjust_deltas(fb, len, fr->twcc_op, fr->twcc_value, udp_csum);
+    if (changed > 0) {
+        LOG_DEBUG("    [MODIFY] TWCC: %d receive deltas adjusted\n", changed);
+    }
+    return changed > 0 ? 1 : changed;
+}
+
+static const struct rtcp_handlers rewrite_handlers = { rewrite_block, rewrite_feedback, observe_sr };
+static const struct rtcp_handlers observe_handlers = { observe_block, NULL, observe_sr };
+
+int locate_rtcp(unsigned char *packet, int packet_len, unsigned char **rtcp, int *complete) {
+    struct iphdr *iph = (struct iphdr *)packet;
+    
+    if (packet_len < 20 || iph->version != 4 || iph->protocol != IPPROTO_UDP) {
+        return -1;
+    }
+    
+    int ip_header_len = iph->ihl * 4;
+    if (packet_len < ip_header_len + 8) {
+        return -1;
+    }
+    
+    struct udphdr *udph = (struct udphdr *)(packet + ip_header_len);
+    int udp_len = ntohs(udph->uh_ulen);
+    if (udp_len < 8 + (int)sizeof(struct rtcp_header)) {
+        return -1;
+    }
+    
+    int avail = packet_len - ip_header_len - 8;
+    *complete = (ip_header_len + udp_len <= packet_len);
+    *rtcp = packet + ip_header_len + 8;
+    return *complete ? udp_len - 8 : avail;
+}
+
+// rewrite_rtcp, also feeding the RTT estimator if rw has a table
+static int rewrite_walk(unsigned char *packet, int packet_len, struct block_rewrite *rw,
+                        struct rtcp_walk *walk) {
+    unsigned char *rtcp;
+    int complete;
+    int rtcp_len = locate_rtcp(packet, packet_len, &rtcp, &complete);
+    
+    // The packet goes back to the kernel as these bytes, so the whole UDP
+    // datagram must be here
+    if (rtcp_len < 0 || !complete) {
+        return -1;
+    }
+    
+    struct iphdr *iph = (struct iphdr *)packet;
+    struct udphdr *udph = (struct udphdr *)(packet + iph->ihl * 4);
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    rw->key = (struct policy_key){ .saddr = iph->saddr, .daddr = iph->daddr,
+                                   .sport = udph->uh_sport, .dport = udph->uh_dport };
+    rw->now = (uint32_t)ts.tv_sec;
+    
+    LOG_DEBUG("    [CHECKSUM] Original UDP checksum: 0x%04X\n", ntohs(udph->uh_sum));
+    rtcp_walk(rtcp, rtcp_len, &rewrite_handlers, rw, &udph->uh_sum, walk);
+    LOG_DEBUG("    [CHECKSUM] New UDP checksum: 0x%04X\n", ntohs(udph->uh_sum));
+    return walk->rewritten + walk->fb_rewritten;
+}
+
+int rewrite_rtcp(unsigned char *packet, int packet_len, const struct live_config *cfg,
+                 struct policy_table *policies, struct rtcp_walk *walk) {
+    struct block_rewrite rw = { .cfg = cfg, .policies = policies };
+    return rewrite_walk(packet, packet_len, &rw, walk);
+}
+
+// Inject a fake RR packet through the source
+static int inject_fake_rr(struct pkt_path *pp, const unsigned char *original_packet, int packet_len,
+                          const struct live_config *cfg, const char *debug_prefix) {
+    
+    unsigned char *fake_packet = inject_buf;
+    int fake_len = packet_len;
+    struct rtcp_walk walk;
+    
+    if (packet_len > (int)sizeof(inject_buf)) {
+        LOG_WARN("❌ FAILED TO CREATE FAKE RR\n");
+        return 0;
+    }
+    
+    LOG_DEBUG_T(debug_prefix, "=== PACKET INTEGRITY CHECK ===\n");
+    verify_packet_integrity(original_packet, packet_len, "    [VERIFY ORIGINAL]");
+    
+    // Copy original packet EXACTLY, then patch the copy
+    memcpy(fake_packet, original_packet, packet_len);
+    
+    if (rewrite_rtcp(fake_packet, fake_len, cfg, pp->policies, &walk) > 0) {
+        
+        verify_packet_integrity(fake_packet, fake_len, "    [VERIFY FAKE]");
+        
+        LOG_DEBUG_T(debug_prefix, "INJECTING FAKE RR (%d of %d blocks, %d feedback rewritten)\n",
+                    walk.rewritten, walk.blocks, walk.fb_rewritten);
+        
+        // Print fake RR details
+        int ip_header_len = ((struct iphdr *)fake_packet)->ihl * 4;
+        print_rtcp_details(fake_packet + ip_header_len + 8, fake_len - ip_header_len - 8,
+                           "        [FAKE] ");
+        
+        int result = pp->src->inject(pp->src, fake_packet, fake_len);
+        
+        if (result > 0) {
+            LOG_DEBUG_T(debug_prefix, "✅ FAKE RR INJECTION SUCCESSFUL (%d bytes sent)\n", result);
+            return 1;
+        } else {
+            LOG_WARN("❌ FAKE RR INJECTION FAILED\n");
+            return 0;
+        }
+    } else {
+        LOG_WARN("❌ FAILED TO CREATE FAKE RR\n");
+        return 0;
+    }
+}
+
+int feedback_parse_remb(struct feedback_rewrite *fb, const char *arg) {
+    unsigned long bps;
+    char op[8];
+    
+    if (sscanf(arg, "%7[a-z]:%lu", op, &bps) != 2 || bps == 0 || bps > UINT32_MAX ||
+        (strcmp(op, "clamp") != 0 && strcmp(op, "set") != 0)) {
+        fprintf(stderr, "Error: REMB rewrite must be clamp:BPS or set:BPS\n");
+        return -1;
+    }
+    fb->remb_op = strcmp(op, "clamp") == 0 ? REMB_CLAMP : REMB_SET;
+    fb->remb_bitrate = bps;
+    return 0;
+}
+
+int feedback_parse_twcc(struct feedback_rewrite *fb, const char *arg) {
+    long value;
+    char op[8];
+    
+    if (sscanf(arg, "%7[a-z]:%ld", op, &value) != 2 ||
+        (strcmp(op, "scale") != 0 && strcmp(op, "add") != 0) ||
+        value < INT16_MIN || value > INT16_MAX || (op[0] == 's' && value < 0)) {
+        fprintf(stderr, "Error: TWCC rewrite must be scale:PERCENT or add:TICKS\n");
+        return -1;
+    }
+    fb->twcc_enabled = 1;
+    fb->twcc_op = op[0] == 's' ? TWCC_SCALE : TWCC_ADD;
+    fb->twcc_value = (int32_t)value;
+    return 0;
+}
+
+int pkt_process(struct pkt_path *pp, const struct live_config *cfg, struct pkt *p)
+{
+    struct pkt_source *src = pp->src;
+    unsigned char *packet_data = p->data;
+    int packet_len = p->len;
+    unsigned char *rtcp_data;
+    int rtcp_len, complete;
+    struct stats *packet_stats = &pp->stats;
+    
+    packet_stats->total_packets++;
+    pp->pkt_class = PKT_NON_UDP;
+    
+    // Quick check if it's UDP
+    if (packet_len >= 20) {
+        struct iphdr *iph = (struct iphdr *)packet_data;
+        if (iph->version == 4 && iph->protocol == IPPROTO_UDP) {
+            packet_stats->udp_packets++;
+            pp->pkt_class = PKT_UDP;
+        } else {
+            packet_stats->non_udp_packets++;
+        }
+    }
+    
+    // One flow cache probe and a look at the first payload bytes decide
+    // what the packet is; flows proven uninteresting are not looked into
+    flow_pkt_t kind = flow_classify(pp->flows, packet_data, packet_len, p->now_sec,
+                                    pp->bypass_after);
+    int rtcp_candidate = kind == FLOW_PKT_RTCP;
+    
+    // Self-check for the kernel pre-filter: count what it let through
+    if (!rtcp_candidate) {
+        packet_stats->non_rtcp_queued++;
+    }
+    
+    // Passive media statistics
+    if (pp->rtp && kind == FLOW_PKT_RTP && rtp_track(pp->rtp, packet_data, packet_len, p->ts_ns)) {
+        packet_stats->rtp_packets++;
+    }
+    
+    // Flow bypass: a flow that has shown enough packets that cannot be
+    // WebRTC gets the bypass mark, which CONNMARK carries to the rest of
+    // the flow so it no longer enters the queue
+    if (kind == FLOW_PKT_BYPASS) {
+        packet_stats->bypass_marked++;
+        return src->verdict(src, p, PKT_ACCEPT_MARK);
+    }
+    
+    // RTCP: walk the compound packet once. In REWRITE mode that single
+    // pass also rewrites report blocks, REMB/TWCC and the checksum.
+    rtcp_len = rtcp_candidate ? locate_rtcp(packet_data, packet_len, &rtcp_data, &complete) : -1;
+    if (rtcp_len >= 0) {
+        struct rtcp_walk walk;
+        
+        print_rtcp_details(rtcp_data, rtcp_len, "    [REAL] ");
+        // Template for synthetic reports, taken before any rewrite
+        if (pp->sched && complete) {
+            sched_learn(pp->sched, packet_data, (int)(rtcp_data - packet_data) + rtcp_len);
+        }
+        struct block_rewrite rw = {
+            .cfg = cfg, .policies = pp->policies, .rtt = pp->rtt, .arrival_ns = p->ts_ns
+        };
+        if (cfg->mode == MODE_REWRITE && complete) {
+            rewrite_walk(packet_data, packet_len, &rw, &walk);
+        } else if (pp->rtt) {
+            struct iphdr *iph = (struct iphdr *)packet_data;
+            struct udphdr *udph = (struct udphdr *)(packet_data + iph->ihl * 4);
+            rw.key.saddr = iph->saddr;
+            rw.key.sport = udph->uh_sport;
+            rtcp_walk(rtcp_data, rtcp_len, &observe_handlers, &rw, NULL, &walk);
+        } else {
+            rtcp_walk(rtcp_data, rtcp_len, NULL, NULL, NULL, &walk);
+        }
+        packet_stats->rtt_samples += rw.rtt_samples;
+        if (walk.malformed) {
+            packet_stats->rtcp_malformed++;
+        }
+        
+        // SDES/BYE/NACK/PLI only: nothing to do
+        if (walk.blocks == 0 && walk.remb == 0 && walk.twcc == 0) {
+            return src->verdict(src, p, PKT_ACCEPT);
+        }
+        pp->pkt_class = PKT_RTCP;
+        
+        if (walk.blocks) {
+            packet_stats->rtcp_rr_packets++;
+            packet_stats->rtcp_blocks += walk.blocks;
+        }
+        packet_stats->rtcp_remb += walk.remb;
+        packet_stats->rtcp_twcc += walk.twcc;
+        
+        if (!complete) {
+            packet_stats->rtcp_rr_truncated++;
+        }
+        
+        struct iphdr *iph = (struct iphdr *)packet_data;
+        struct udphdr *udph = (struct udphdr *)(packet_data + iph->ihl * 4);
+        LOG_INFO(">>> RTCP RR %u.%u.%u.%u:%u -> %u.%u.%u.%u:%u\n",
+                 LOG_IP(iph->saddr), ntohs(udph->uh_sport), LOG_IP(iph->daddr), ntohs(udph->uh_dport));
+        LOG_DEBUG("    Packet ID: %u, Length: %d bytes\n", p->id, packet_len);
+        LOG_DEBUG("    Sender SSRC: %u (0x%08X), %d report blocks in %d sub-packets\n",
+                  walk.sender_ssrc, walk.sender_ssrc, walk.blocks, walk.packets);
+        LOG_DEBUG("    Feedback: %d REMB, %d TWCC\n", walk.remb, walk.twcc);
+        
+        // Handle based on operation mode
+        switch (cfg->mode) {
+            case MODE_ACCEPT_ALL:
+                LOG_DEBUG("    [MODE: ACCEPT_ALL] Accepting real RR packet\n");
+                return src->verdict(src, p, PKT_ACCEPT_NOW);
+                
+            case MODE_REPLACE:
+                LOG_DEBUG("    [MODE: REPLACE] Replacing real RR with fake\n");
+                if (inject_fake_rr(pp, packet_data, packet_len, cfg, "    [REPLACE] ")) {
+                    pp->pkt_class = PKT_INJECTED;
+                    packet_stats->rtcp_rr_faked++;
+                    packet_stats->rtcp_rr_dropped++;
+                    LOG_DEBUG("    [REPLACE] Dropping real RR packet\n");
+                    return src->verdict(src, p, PKT_DROP);
+                } else {
+                    // If injection failed, fall back to accepting real packet
+                    LOG_WARN("    [REPLACE] Injection failed, accepting real RR\n");
+                    return src->verdict(src, p, PKT_ACCEPT_NOW);
+                }
+                
+            case MODE_BOTH:
+                LOG_DEBUG("    [MODE: BOTH] Accepting real RR AND injecting fake\n");
+                if (inject_fake_rr(pp, packet_data, packet_len, cfg, "    [BOTH] ")) {
+                    pp->pkt_class = PKT_INJECTED;
+                    packet_stats->rtcp_rr_faked++;
+                }
+                LOG_DEBUG("    [BOTH] Also accepting real RR packet\n");
+                return src->verdict(src, p, PKT_ACCEPT_NOW);
+                
+            case MODE_REWRITE:
+                if (walk.rewritten > 0 || walk.fb_rewritten > 0) {
+                    pp->pkt_class = PKT_REWRITTEN;
+                    packet_stats->rtcp_rr_rewritten++;
+                    packet_stats->rtcp_blocks_rewritten += walk.rewritten;
+                    packet_stats->rtcp_fb_rewritten += walk.fb_rewritten;
+                    print_rtcp_details(rtcp_data, rtcp_len, "        [REWRITTEN] ");
+                    // Hand the modified bytes back with the verdict; the packet
+                    // keeps its place in the flow
+                    return src->verdict(src, p, PKT_ACCEPT_MODIFIED);
+                } else if (!complete) {
+                    LOG_WARN("    [REWRITE] RR longer than the copy range, accepting unchanged\n");
+                } else {
+                    LOG_DEBUG("    [REWRITE] Nothing to change, accepting unchanged\n");
+                }
+                return src->verdict(src, p, PKT_ACCEPT_NOW);
+                
+            default:
+                LOG_ERROR("    [ERROR] Unknown operation mode, accepting packet\n");
+                return src->verdict(src, p, PKT_ACCEPT_NOW);
+        }
+    } else {
+        // Accept non-RR packets
+        return src->verdict(src, p, PKT_ACCEPT);
+    }
+}
@@ -0,0 +1,182 @@
+/* nfq_pkt.h
+   The per-packet path: classify one IPv4 packet, rewrite or replace the
+   RTCP it carries according to a configuration snapshot, and decide its
+   verdict.
+
+   Nothing here knows about libnetfilter_queue. Packets arrive from a
+   packet source (the NFQUEUE workers in nfq_dummy.c, a pcap file in
+   nfq_bench.c), and the verdict and any fabricated packet go back out
+   through the source's hooks, so the same code runs on the router and in
+   an offline benchmark on the build host.
+*/
+
+#ifndef NFQ_PKT_H
+#define NFQ_PKT_H
+
+#include <stdint.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+
+#include "nfq_flow.h"
+#include "nfq_policy.h"
+#include "nfq_rtp.h"
+#include "nfq_rtt.h"
+#include "rtcp.h"
+
+#define MAX_PACKET_SIZE 65535
+
+// Operational modes
+typedef enum {
+    MODE_ACCEPT_ALL = 0,      // Accept all real RR packets
+    MODE_REPLACE = 1,         // Drop real RR, inject fake instead
+    MODE_BOTH = 2,            // Accept real RR AND inject fake (debugging)
+    MODE_REWRITE = 3          // Modify real RR in place and accept it
+} operation_mode_t;
+
+// REMB rewrite (-r)
+typedef enum {
+    REMB_KEEP = 0,
+    REMB_CLAMP,                         // min(reported, bitrate)
+    REMB_SET                            // always bitrate
+} remb_op_t;
+
+// Feedback rewrite settings (-r / -w)
+struct feedback_rewrite {
+    remb_op_t remb_op;
+    uint32_t remb_bitrate;              // bits/s
+    int twcc_enabled;
+    twcc_op_t twcc_op;
+    int32_t twcc_value;                 // percent or 250 us ticks
+};
+
+// Everything the control socket can change while running. A published
+// snapshot is never modified: writers copy it, edit the copy and swap the
+// pointer (see live_publish), so the verdict path reads it without locks.
+struct live_config {
+    uint32_t gen;
+    operation_mode_t mode;
+    struct policy_rules rules;          // -p, -S, -j/-l
+    struct feedback_rewrite fb;
+};
+
+// Statistics structure
+struct stats {
+    unsigned long total_packets;
+    unsigned long udp_packets;
+    unsigned long rtcp_rr_packets;     // RTCP packets carrying SR/RR report blocks
+    unsigned long rtcp_blocks;         // report blocks seen
+    unsigned long rtcp_blocks_rewritten;
+    unsigned long rtcp_malformed;      // compound packets with an inconsistent length/count
+    unsigned long rtcp_remb;           // REMB messages seen
+    unsigned long rtcp_twcc;           // transport-wide CC messages seen
+    unsigned long rtcp_fb_rewritten;   // REMB/TWCC messages changed
+    unsigned long rtcp_rr_dropped;
+    unsigned long rtcp_rr_faked;
+    unsigned long rtcp_rr_rewritten;
+    unsigned long rtcp_rr_truncated;   // RR longer than the copy range, passed unchanged
+    unsigned long non_udp_packets;
+    unsigned long parse_errors;
+    unsigned long batch_verdicts;      // nfq_set_verdict_batch calls
+    unsigned long non_rtcp_queued;     // packets the RTCP pre-filter should have kept in the kernel
+    unsigned long bypass_marked;       // packets accepted with BYPASS_MARK
+    unsigned long flows_tracked;       // copied from the worker's flow table at exit
+    unsigned long flows_settled;
+    unsigned long flows_evicted;
+    unsigned long flow_hits;
+    unsigned long flow_misses;
+    unsigned long policy_streams;      // copied from the worker's policy table at exit
+    unsigned long policy_evicted;
+    unsigned long no_timestamp;        // packets without NFQA_TIMESTAMP (no queue delay sample)
+    unsigned long synthetic_sent;      // scheduler RRs injected (-i)
+    unsigned long synthetic_streams;   // copied from the worker's scheduler at exit
+    unsigned long rtp_packets;         // media packets accounted by the tracker (-M)
+    unsigned long rtp_streams;         // copied from the worker's RTP table at exit
+    unsigned long rtp_evicted;
+    unsigned long rtt_samples;         // RTT samples from LSR/DLSR
+};
+
+// Verdict-path latency is kept per packet class
+enum pkt_class {
+    PKT_NON_UDP = 0,
+    PKT_UDP,                    // UDP that is not RTCP with reports or feedback
+    PKT_RTCP,                   // RTCP with reports/feedback, forwarded unchanged
+    PKT_REWRITTEN,              // RTCP modified in place
+    PKT_INJECTED,               // fake RR sent through the source
+    PKT_CLASSES
+};
+
+extern const char *const pkt_class_names[PKT_CLASSES];
+
+// What the packet path decided for one packet
+typedef enum {
+    PKT_ACCEPT = 0,             // unchanged; may share a batch verdict with its neighbours
+    PKT_ACCEPT_NOW,             // unchanged, verdict on its own
+    PKT_ACCEPT_MODIFIED,        // with the rewritten bytes in pkt->data
+    PKT_ACCEPT_MARK,            // unchanged, with pkt->mark | BYPASS_MARK
+    PKT_DROP
+} pkt_verdict_t;
+
+// One packet as delivered by a source
+struct pkt {
+    unsigned char *data;        // starts at the IPv4 header, rewritten in place
+    int len;                    // bytes present, may be cut short by a copy range
+    uint32_t id;                // the source's handle for the verdict
+    uint32_t mark;              // packet mark, 0 if the source has none
+    uint64_t ts_ns;             // arrival time, ns on the source's clock
+    uint32_t now_sec;           // seconds on a steady clock, for flow cache aging
+};
+
+// Where packets come from and where decisions go
+struct pkt_source {
+    // Carry out the verdict; returns what the source's verdict call returned
+    int (*verdict)(struct pkt_source *src, const struct pkt *p, pkt_verdict_t v);
+    // Send a fabricated packet (REPLACE / BOTH). Packets accepted before it
+    // must be on their way first. Returns bytes sent, <= 0 on failure.
+    int (*inject)(struct pkt_source *src, const unsigned char *packet, int len);
+};
+
+struct sched;
+
+// Per-thread packet path state
+struct pkt_path {
+    struct pkt_source *src;
+    struct flow_table *flows;   // flow cache, required
+    int bypass_after;           // for flow_classify, 0 = no bypass
+    struct policy_table *policies;  // per-stream rewrite state
+    struct sched *sched;        // synthetic RR scheduler, NULL if disabled
+    struct rtp_table *rtp;      // passive media statistics, NULL if disabled
+    struct rtt_table *rtt;      // LSR/DLSR round-trip times, NULL if disabled
+    int pkt_class;              // class of the packet last processed
+    struct stats stats;
+};
+
+// Parse -r "clamp:BPS" / "set:BPS" and -w "scale:PERCENT" / "add:TICKS"
+// into fb. Return 0, or -1 with a message on stderr.
+int feedback_parse_remb(struct feedback_rewrite *fb, const char *arg);
+int feedback_parse_twcc(struct feedback_rewrite *fb, const char *arg);
+
+// Run one packet through the path under cfg and hand its verdict to the
+// source. Sets pp->pkt_class.
+int pkt_process(struct pkt_path *pp, const struct live_config *cfg, struct pkt *p);
+
+// Locate the RTCP payload of an IPv4/UDP packet. Returns its length, bounded
+// by both the UDP length and the bytes actually copied, or -1. *complete
+// tells whether the whole UDP datagram is present (needed to hand the packet
+// back modified).
+int locate_rtcp(unsigned char *packet, int packet_len, unsigned char **rtcp, int *complete);
+
+// Apply the per-stream policies to every report block, and the feedback
+// settings to every REMB/TWCC message, of the compound RTCP packet in place,
+// patching the UDP checksum as it goes. Returns the number of blocks and
+// feedback messages rewritten, or -1 if the packet is not a complete RTCP
+// datagram.
+int rewrite_rtcp(unsigned char *packet, int packet_len, const struct live_config *cfg,
+                 struct policy_table *policies, struct rtcp_walk *walk);
+
+// Reference checksums, computed from scratch (host order). A debug_prefix
+// enables trace output.
+uint16_t calculate_ip_checksum_debug(struct iphdr *iph, const char *debug_prefix);
+uint16_t calculate_udp_checksum(struct iphdr *iph, struct udphdr *udph,
+                                const unsigned char *payload, int payload_len);
+
+#endif
@@ -0,0 +1,290 @@
+/* nfq_policy.c
+   Per-stream spoofing policy (see nfq_policy.h).
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "nfq_policy.h"
+#include "nfq_log.h"
+
+struct policy_table *policy_table_create(void) {
+    return table_alloc(sizeof(struct policy_table));
+}
+
+static uint32_t policy_hash(const struct policy_key *k) {
+    return table_hash_fold(table_hash_addrs(k->saddr, k->daddr, k->sport, k->dport) ^
+                           table_hash_ssrc(k->ssrc));
+}
+
+static int key_equal(const struct table_slot *s, const void *key) {
+    const struct policy_key *a = &((const struct policy_entry *)s)->key, *b = key;
+    return a->ssrc == b->ssrc && a->saddr == b->saddr && a->daddr == b->daddr &&
+           a->sport == b->sport && a->dport == b->dport;
+}
+
+static int match_rule(const struct policy_rules *rules, uint32_t ssrc) {
+    int wildcard = -1;
+    for (int i = 0; i < rules->n; i++) {
+        if (rules->r[i].any_ssrc) {
+            if (wildcard < 0) wildcard = i;
+        } else if (rules->r[i].ssrc == ssrc) {
+            return i;
+        }
+    }
+    return wildcard;
+}
+
+// The stream's entry, claimed (see nfq_table.h) if it has none
+static struct policy_entry *lookup(struct policy_table *t, const struct policy_key *k,
+                                   uint32_t now) {
+    int how;
+    struct policy_entry *e = (struct policy_entry *)
+        table_probe(t->e, sizeof(t->e[0]), POLICY_TABLE_SIZE, POLICY_MAX_PROBE, policy_hash(k),
+                    now, POLICY_IDLE_SEC, key_equal, k, &how);
+
+    if (how == TABLE_FOUND) {
+        return e;
+    }
+    if (how == TABLE_EVICTED) {
+        t->evicted++;
+    }
+    memset(e, 0, sizeof(*e));
+    e->key = *k;
+    e->slot.used = 1;
+    e->rule = -1;
+    e->gen = ~0u;
+    t->tracked++;
+    return e;
+}
+
+static uint32_t scale(uint32_t v, uint32_t pct, uint32_t max) {
+    uint64_t s = (uint64_t)v * pct / 100;
+    return s > max ? max : (uint32_t)s;
+}
+
+// Move cur 1/2^POLICY_TARGET_SHIFT of the way to target, at least one step
+static uint32_t approach(uint32_t cur, uint32_t target) {
+    int64_t d = (int64_t)target - cur;
+    int64_t step = d / (1 << POLICY_TARGET_SHIFT);
+    if (step == 0) step = d;
+    return (uint32_t)(cur + step);
+}
+
+static int set_block(struct rtcp_report_block *rb, uint32_t jitter, uint32_t fraction) {
+    rb->jitter = htonl(jitter);
+    // Cumulative lost (low 24 bits) stays as reported
+    rb->fraction_lost = htonl((fraction << 24) | (ntohl(rb->fraction_lost) & 0xFFFFFF));
+    return 1;
+}
+
+int policy_apply(struct policy_table *t, const struct policy_rules *rules,
+                 const struct policy_key *k, uint32_t now, struct rtcp_report_block *rb) {
+    struct policy_entry *e = lookup(t, k, now);
+    uint32_t fl = ntohl(rb->fraction_lost);
+
+    // New stream, or the rules changed since it was matched
+    if (e->gen != rules->gen) {
+        e->rule = (int8_t)match_rule(rules, k->ssrc);
+        e->gen = rules->gen;
+    }
+
+    e->slot.last_seen = now;
+    e->real_jitter = ntohl(rb->jitter);
+    e->real_fraction = fl >> 24;
+    if (e->reports++ == 0) {
+        e->jitter = e->real_jitter;
+        e->fraction = (uint32_t)e->real_fraction << 8;
+    }
+
+    uint32_t jitter, fraction;
+
+    if (rules->profile) {
+        uint32_t t_ms;
+        const struct profile_entry *pe = profile_lookup(rules->profile, &t->profile_cursor,
+                                                        k->ssrc, &t_ms);
+        if (pe) {
+            jitter = ntohl(pe->jitter);
+            fraction = pe->fraction_lost;
+            // Where a TARGET rule picks up if the profile lets the stream go
+            e->jitter = jitter;
+            e->fraction = fraction << 8;
+            e->profiled = 1;
+            LOG_INFO("[PROFILE] t=%u ms step %u SSRC 0x%08X: jitter %u -> %u, fraction lost %u -> %u\n",
+                     t_ms, t->profile_cursor.step, k->ssrc, e->real_jitter, jitter,
+                     e->real_fraction, fraction);
+            return set_block(rb, jitter, fraction);
+        }
+    }
+    e->profiled = 0;
+    if (e->rule < 0) {
+        return 0;
+    }
+
+    const struct policy_rule *r = &rules->r[e->rule];
+
+    switch (r->mode) {
+        case POLICY_FIXED:
+            jitter = r->jitter;
+            fraction = r->fraction_lost;
+            break;
+        case POLICY_SCALE:
+            jitter = scale(e->real_jitter, r->jitter, UINT32_MAX);
+            fraction = scale(e->real_fraction, r->fraction_lost, 255);
+            break;
+        case POLICY_TARGET:
+            e->jitter = approach(e->jitter, r->jitter);
+            e->fraction = approach(e->fraction, r->fraction_lost << 8);
+            jitter = e->jitter;
+            fraction = (e->fraction + 128) >> 8;
+            break;
+        default:
+            return 0;
+    }
+
+    return set_block(rb, jitter, fraction);
+}
+
+int policy_settled(const struct policy_table *t, const struct policy_rules *rules,
+                   const struct policy_key *k) {
+    const struct policy_entry *e = (const struct policy_entry *)
+        table_find(t->e, sizeof(t->e[0]), POLICY_TABLE_SIZE, POLICY_MAX_PROBE,
+                   policy_hash(k), key_equal, k);
+
+    if (!e || e->gen != rules->gen) {
+        return 0;
+    }
+    // A profile step is written in one report; there is nothing to glide
+    if (e->profiled || e->rule < 0 || rules->r[e->rule].mode != POLICY_TARGET) {
+        return 1;
+    }
+    const struct policy_rule *r = &rules->r[e->rule];
+    return e->jitter == r->jitter && e->fraction == r->fraction_lost << 8;
+}
+
+static int parse_ssrc(const char *s, const char *end, struct policy_rule *r) {
+    if (end - s == 1 && *s == '*') {
+        r->any_ssrc = 1;
+        return 0;
+    }
+    char *e;
+    r->ssrc = strtoul(s, &e, 0);
+    return (e == s || e != end) ? -1 : 0;
+}
+
+int policy_add_rule(struct policy_rules *rules, const char *spec) {
+    struct policy_rule r;
+    char mode[8];
+    unsigned long a = 0, b = 0;
+    int n;
+
+    memset(&r, 0, sizeof(r));
+    const char *eq = strchr(spec, '=');
+    if (!eq || parse_ssrc(spec, eq, &r) < 0) {
+        fprintf(stderr, "Error: policy '%s': expected SSRC|*=mode\n", spec);
+        return -1;
+    }
+    n = sscanf(eq + 1, "%7[a-z]:%lu:%lu", mode, &a, &b);
+
+    if (n == 1 && strcmp(mode, "pass") == 0) {
+        r.mode = POLICY_PASS;
+    } else if (n == 3 && strcmp(mode, "fixed") == 0) {
+        r.mode = POLICY_FIXED;
+    } else if (n == 3 && strcmp(mode, "scale") == 0) {
+        r.mode = POLICY_SCALE;
+    } else if (n == 3 && strcmp(mode, "target") == 0) {
+        r.mode = POLICY_TARGET;
+    } else {
+        fprintf(stderr, "Error: policy '%s': mode must be pass, fixed:J:F, scale:J%%:F%% or target:J:F\n",
+                spec);
+        return -1;
+    }
+    if (r.mode != POLICY_SCALE && b > 255) {
+        fprintf(stderr, "Error: policy '%s': fraction lost must be 0-255\n", spec);
+        return -1;
+    }
+    if (a > UINT32_MAX || b > UINT32_MAX) {
+        fprintf(stderr, "Error: policy '%s': value out of range\n", spec);
+        return -1;
+    }
+    r.jitter = a;
+    r.fraction_lost = b;
+    if (policy_set_rule(rules, &r) < 0) {
+        fprintf(stderr, "Error: at most %d policy rules\n", POLICY_MAX_RULES);
+        return -1;
+    }
+    return 0;
+}
+
+static int find_rule(const struct policy_rules *rules, uint32_t ssrc, int any_ssrc) {
+    for (int i = 0; i < rules->n; i++) {
+        if (any_ssrc ? rules->r[i].any_ssrc : (!rules->r[i].any_ssrc && rules->r[i].ssrc == ssrc)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int policy_set_rule(struct policy_rules *rules, const struct policy_rule *r) {
+    int i = find_rule(rules, r->ssrc, r->any_ssrc);
+    if (i < 0) {
+        if (rules->n == POLICY_MAX_RULES) {
+            return -1;
+        }
+        i = rules->n++;
+    }
+    rules->r[i] = *r;
+    rules->gen++;
+    return 0;
+}
+
+int policy_del_rule(struct policy_rules *rules, uint32_t ssrc, int any_ssrc) {
+    int i = find_rule(rules, ssrc, any_ssrc);
+    if (i < 0) {
+        return -1;
+    }
+    memmove(&rules->r[i], &rules->r[i + 1], (rules->n - i - 1) * sizeof(rules->r[0]));
+    rules->n--;
+    rules->gen++;
+    return 0;
+}
+
+int policy_set_target(struct policy_rules *rules, uint32_t ssrc, int any_ssrc,
+                      uint32_t jitter, uint32_t fraction_lost) {
+    int i = find_rule(rules, ssrc, any_ssrc);
+    if (i < 0 || rules->r[i].mode != POLICY_TARGET) {
+        return -1;
+    }
+    rules->r[i].jitter = jitter;
+    rules->r[i].fraction_lost = fraction_lost;
+    return 0;
+}
+
+int policy_load_targets(struct policy_rules *rules, const char *path) {
+    FILE *f = fopen(path, "r");
+    if (!f) {
+        return -1;
+    }
+
+    char line[128], ssrc[16];
+    unsigned long jitter, fraction;
+    int updated = 0;
+    while (fgets(line, sizeof(line), f)) {
+        if (sscanf(line, "%15s %lu %lu", ssrc, &jitter, &fraction) != 3 ||
+            ssrc[0] == '#' || fraction > 255) {
+            continue;
+        }
+        struct policy_rule key;
+        memset(&key, 0, sizeof(key));
+        if (parse_ssrc(ssrc, ssrc + strlen(ssrc), &key) < 0) {
+            continue;
+        }
+        if (policy_set_target(rules, key.ssrc, key.any_ssrc, jitter, fraction) == 0) {
+            updated++;
+        }
+    }
+    fclose(f);
+    return updated;
+}
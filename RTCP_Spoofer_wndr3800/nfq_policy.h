@@ -0,0 +1,119 @@
+/* nfq_policy.h
+   Per-stream spoofing policy for report blocks.
+
+   A small ordered rule list (-p, plus the -j/-l/-S defaults) says what to do
+   with the report blocks about a media SSRC: leave them alone, write fixed
+   values, scale the real values, or glide towards an externally supplied
+   target. Each worker keeps a fixed-size open addressing table keyed by
+   (RTCP 5-tuple, media SSRC) that caches the matching rule and the per-stream
+   state, so the verdict path does one hash lookup and never allocates.
+
+   A rule set is immutable once the workers can see it; changes are made on a
+   copy with a new generation number, and cached matches from an older
+   generation are redone on the next report.
+*/
+
+#ifndef NFQ_POLICY_H
+#define NFQ_POLICY_H
+
+#include <stdint.h>
+
+#include "nfq_profile.h"
+#include "nfq_table.h"
+#include "rtcp.h"
+
+#define POLICY_MAX_RULES  16
+#define POLICY_TABLE_SIZE 1024      // entries, power of two
+#define POLICY_MAX_PROBE  8         // linear probe window
+#define POLICY_IDLE_SEC   60        // entries idle this long are reused
+
+// TARGET mode moves the applied values 1/2^shift of the way per report
+#define POLICY_TARGET_SHIFT 2
+
+typedef enum {
+    POLICY_PASS = 0,                // forward the real values
+    POLICY_FIXED,                   // jitter / fraction lost set to constants
+    POLICY_SCALE,                   // real values times a percentage
+    POLICY_TARGET                   // converge on values set from outside (-t, -s)
+} policy_mode_t;
+
+struct policy_rule {
+    uint32_t ssrc;                  // media SSRC, host order
+    int any_ssrc;                   // wildcard rule
+    policy_mode_t mode;
+    // FIXED / TARGET: absolute jitter and fraction lost (0-255);
+    // SCALE: percentages
+    uint32_t jitter;
+    uint32_t fraction_lost;
+};
+
+// Rules are matched in order: first exact SSRC match, else the first
+// wildcard, else pass-through. Streams the profile selects skip them.
+struct policy_rules {
+    uint32_t gen;                   // bumped on every change
+    int n;
+    struct policy_rule r[POLICY_MAX_RULES];
+    struct profile *profile;        // -F, NULL = none
+};
+
+struct policy_key {
+    uint32_t saddr, daddr;          // of the RTCP packet, network order
+    uint16_t sport, dport;
+    uint32_t ssrc;                  // media SSRC, host order
+};
+
+struct policy_entry {
+    struct table_slot slot;
+    struct policy_key key;
+    uint32_t gen;                   // rules generation rule was matched in
+    int8_t rule;                    // index into the rules, -1 = pass
+    uint8_t profiled;               // last report took the profile's values
+    uint8_t real_fraction;          // last values the receiver reported
+    uint32_t real_jitter;
+    uint32_t jitter;                // last values written (TARGET state)
+    uint32_t fraction;              // fraction lost << 8, for smoothing
+    uint32_t reports;
+};
+
+struct policy_table {
+    struct policy_entry e[POLICY_TABLE_SIZE];
+    unsigned long tracked;          // streams inserted
+    unsigned long evicted;          // live streams pushed out by a full probe window
+    struct profile_cursor profile_cursor;
+};
+
+// An empty table, from table_alloc
+struct policy_table *policy_table_create(void);
+
+// Apply the stream's policy from rules to one report block in place.
+// Returns 1 if the block was rewritten, 0 if it passes unchanged.
+int policy_apply(struct policy_table *t, const struct policy_rules *rules,
+                 const struct policy_key *k, uint32_t now, struct rtcp_report_block *rb);
+
+// Whether the stream's policy has nothing left to converge: its rule is not
+// TARGET, the profile set its last report, or the values last written are
+// the target's. Unknown streams and
+// streams matched under an older rules generation count as unsettled.
+int policy_settled(const struct policy_table *t, const struct policy_rules *rules,
+                   const struct policy_key *k);
+
+// Parse "SSRC|*=pass", "=fixed:J:F", "=scale:J%:F%" or "=target:J:F" and
+// set it (see policy_set_rule). Returns 0, or -1 with a message on stderr.
+int policy_add_rule(struct policy_rules *rules, const char *spec);
+
+// Replace the rule for the same SSRC (or the first wildcard), else append.
+// Returns 0, -1 if the rule set is full.
+int policy_set_rule(struct policy_rules *rules, const struct policy_rule *r);
+
+// Remove the rule for ssrc (or the first wildcard); -1 if there is none
+int policy_del_rule(struct policy_rules *rules, uint32_t ssrc, int any_ssrc);
+
+// Set the values of the matching TARGET rule; -1 if there is none
+int policy_set_target(struct policy_rules *rules, uint32_t ssrc, int any_ssrc,
+                      uint32_t jitter, uint32_t fraction_lost);
+
+// Read "SSRC|* jitter fraction" lines from path into the matching TARGET
+// rules. Returns the number of rules updated, -1 if the file can't be read.
+int policy_load_targets(struct policy_rules *rules, const char *path);
+
+#endif
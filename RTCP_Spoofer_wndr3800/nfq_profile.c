@@ -0,0 +1,146 @@
+/* nfq_profile.c
+   Recorded impairment profiles (see nfq_profile.h).
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <arpa/inet.h>
+
+#include "nfq_profile.h"
+
+struct profile *profile_open(const char *path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    void *map;
+
+    if (fd < 0 || fstat(fd, &st) < 0) {
+        perror(path);
+        if (fd >= 0) close(fd);
+        return NULL;
+    }
+    if ((size_t)st.st_size < sizeof(struct profile_header)) {
+        fprintf(stderr, "Error: %s: too short for a profile\n", path);
+        close(fd);
+        return NULL;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror("mmap");
+        return NULL;
+    }
+
+    const struct profile_header *h = map;
+    const struct profile_entry *e = (const struct profile_entry *)(h + 1);
+    uint32_t n = ntohl(h->entries);
+    const char *err = NULL;
+
+    if (memcmp(h->magic, PROFILE_MAGIC, 4) != 0) {
+        err = "not a profile (bad magic)";
+    } else if (ntohs(h->version) != PROFILE_VERSION ||
+               ntohs(h->entry_size) != sizeof(struct profile_entry)) {
+        err = "unsupported version or entry size";
+    } else if (n == 0 || sizeof(*h) + (size_t)n * sizeof(*e) != (size_t)st.st_size) {
+        err = "entry count does not match the file size";
+    } else {
+        // Checked once here, so lookups can trust the order
+        for (uint32_t i = 1; i < n && !err; i++) {
+            if (ntohl(e[i].offset_ms) < ntohl(e[i - 1].offset_ms)) {
+                err = "entries not sorted by offset";
+            }
+        }
+        if (!err && h->duration_ms && ntohl(h->duration_ms) <= ntohl(e[n - 1].offset_ms)) {
+            err = "loop duration does not cover the last step";
+        }
+    }
+    if (err) {
+        fprintf(stderr, "Error: %s: %s\n", path, err);
+        munmap(map, st.st_size);
+        return NULL;
+    }
+
+    struct profile *p = calloc(1, sizeof(*p));
+    if (!p) {
+        perror("calloc");
+        munmap(map, st.st_size);
+        return NULL;
+    }
+    p->hdr = h;
+    p->e = e;
+    p->n = n;
+    p->duration_ms = ntohl(h->duration_ms);
+    p->map_len = st.st_size;
+    // Read ahead; the verdict path should not fault pages in
+    madvise(map, st.st_size, MADV_WILLNEED);
+    return p;
+}
+
+void profile_close(struct profile *p) {
+    if (p) {
+        munmap((void *)p->hdr, p->map_len);
+        free(p);
+    }
+}
+
+// First entry after the step starting at i
+static uint32_t step_end(const struct profile *p, uint32_t i) {
+    uint32_t off = p->e[i].offset_ms;
+    while (++i < p->n && p->e[i].offset_ms == off) {
+    }
+    return i;
+}
+
+const struct profile_entry *profile_lookup(struct profile *p, struct profile_cursor *c,
+                                           uint32_t ssrc, uint32_t *t_ms) {
+    struct timespec ts;
+    uint64_t now, start = __atomic_load_n(&p->start_ns, __ATOMIC_RELAXED);
+
+    // One jiffy of resolution is plenty next to report intervals
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    now = (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+    if (start == 0) {
+        // The first worker to get here starts the clock for all
+        if (!__atomic_compare_exchange_n(&p->start_ns, &start, now, 0,
+                                         __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+            now = now > start ? now : start;
+        } else {
+            start = now;
+        }
+    }
+
+    uint64_t ms = (now - start) / 1000000u;
+    uint32_t t = p->duration_ms ? (uint32_t)(ms % p->duration_ms) : (uint32_t)ms;
+    *t_ms = t;
+
+    // Before the first step nothing applies; a loop back starts over
+    if (t < ntohl(p->e[0].offset_ms)) {
+        return NULL;
+    }
+    if (c->next == 0 || t < ntohl(p->e[c->step].offset_ms)) {
+        c->step = 0;
+        c->next = step_end(p, 0);
+    }
+    while (c->next < p->n && ntohl(p->e[c->next].offset_ms) <= t) {
+        c->step = c->next;
+        c->next = step_end(p, c->next);
+    }
+
+    const struct profile_entry *any = NULL;
+    uint32_t key = htonl(ssrc);
+    for (uint32_t i = c->step; i < c->next; i++) {
+        const struct profile_entry *e = &p->e[i];
+        if (e->flags & PROFILE_F_ANY_SSRC) {
+            if (!any) any = e;
+        } else if (e->ssrc == key) {
+            any = e;
+            break;
+        }
+    }
+    return any && !(any->flags & PROFILE_F_PASS) ? any : NULL;
+}
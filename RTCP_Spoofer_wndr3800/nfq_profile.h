@@ -0,0 +1,78 @@
+/* nfq_profile.h
+   Recorded impairment profiles for report blocks (-F file).
+
+   A profile is a binary file of fixed-size entries (time offset, SSRC
+   selector, jitter, fraction lost) sorted by offset, mapped read-only and
+   used in place. Entries with the same offset form a step that states the
+   whole schedule from that time on: a stream selected by the current step
+   (its SSRC, else a wildcard entry) gets the step's values in every report
+   block, ahead of the policy rules; other streams follow the rules.
+   mkprofile.py builds a file from CSV, carrying values forward so the CSV
+   only lists changes.
+
+   The clock starts at the first report block looked up, shared by all
+   workers. Each worker walks the steps with its own cursor, so a lookup
+   costs one step of advance at most per step boundary crossed and a scan
+   of the (few) entries of one step.
+
+   All fields are in network byte order:
+
+     header  "RRPF", u16 version (1), u16 entry size (16), u32 entries,
+             u32 duration_ms (0: hold the last step, else loop)
+     entry   u32 offset_ms, u32 ssrc, u32 jitter, u8 fraction lost,
+             u8 flags (PROFILE_F_*), u16 reserved
+*/
+
+#ifndef NFQ_PROFILE_H
+#define NFQ_PROFILE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define PROFILE_MAGIC       "RRPF"
+#define PROFILE_VERSION     1
+#define PROFILE_F_ANY_SSRC  0x01
+#define PROFILE_F_PASS      0x02        // selected streams follow the rules
+
+struct profile_header {
+    char magic[4];
+    uint16_t version;
+    uint16_t entry_size;
+    uint32_t entries;
+    uint32_t duration_ms;
+};
+
+struct profile_entry {
+    uint32_t offset_ms;
+    uint32_t ssrc;
+    uint32_t jitter;
+    uint8_t fraction_lost;
+    uint8_t flags;
+    uint16_t reserved;
+};
+
+struct profile {
+    const struct profile_header *hdr;   // the mapping
+    const struct profile_entry *e;
+    uint32_t n;
+    uint32_t duration_ms;
+    size_t map_len;
+    uint64_t start_ns;                  // CLOCK_MONOTONIC_COARSE of the first lookup, 0 = not started
+};
+
+// Per-worker position in the profile
+struct profile_cursor {
+    uint32_t step;                      // first entry of the current step
+    uint32_t next;                      // first entry of the following step
+};
+
+// Map and check a profile file. Returns NULL with a message on stderr.
+struct profile *profile_open(const char *path);
+void profile_close(struct profile *p);
+
+// The current step's entry for ssrc, or NULL if the step does not select
+// it (or passes it). *t_ms is set to the profile time used.
+const struct profile_entry *profile_lookup(struct profile *p, struct profile_cursor *c,
+                                           uint32_t ssrc, uint32_t *t_ms);
+
+#endif
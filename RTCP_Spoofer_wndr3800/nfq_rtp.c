@@ -0,0 +1,283 @@
+/* nfq_rtp.c
+   Passive per-SSRC RTP media statistics (see nfq_rtp.h).
+*/
+
+#include <stdio.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include <netinet/ip.h>
+#include <netinet/udp.h>
+
+#include "nfq_rtp.h"
+
+#define RTP_SEQ_MOD (1u << 16)
+#define NS_PER_SEC 1000000000ull
+
+struct rtp_table *rtp_table_create(void) {
+    return table_alloc(sizeof(struct rtp_table));
+}
+
+static uint32_t rtp_hash(const struct rtp_key *k) {
+    return table_hash_fold(table_hash_addrs(k->saddr, k->daddr, k->sport, k->dport) ^
+                           table_hash_ssrc(k->ssrc));
+}
+
+static int key_equal(const struct table_slot *slot, const void *key) {
+    const struct rtp_key *a = &((const struct rtp_stream *)slot)->key, *b = key;
+    return a->ssrc == b->ssrc && a->saddr == b->saddr && a->daddr == b->daddr &&
+           a->sport == b->sport && a->dport == b->dport;
+}
+
+// The stream's entry, claimed (see nfq_table.h) if it has none
+static struct rtp_stream *lookup(struct rtp_table *t, const struct rtp_key *k, uint16_t seq,
+                                 uint32_t now) {
+    int how;
+    struct rtp_stream *s = (struct rtp_stream *)
+        table_probe(t->e, sizeof(t->e[0]), RTP_TABLE_SIZE, RTP_MAX_PROBE, rtp_hash(k), now,
+                    RTP_IDLE_SEC, key_equal, k, &how);
+
+    if (how == TABLE_FOUND) {
+        return s;
+    }
+    if (how == TABLE_EVICTED) {
+        t->evicted++;
+    }
+    memset(s, 0, sizeof(*s));
+    s->key = *k;
+    s->slot.used = 1;
+    s->probation = RTP_MIN_SEQUENTIAL;
+    s->max_seq = seq - 1;
+    t->tracked++;
+    return s;
+}
+
+// RFC 3550 A.1
+static void init_seq(struct rtp_stream *s, uint16_t seq) {
+    s->base_seq = seq;
+    s->max_seq = seq;
+    s->bad_seq = RTP_SEQ_MOD + 1;
+    s->cycles = 0;
+    s->received = 0;
+    s->received_prior = 0;
+    s->expected_prior = 0;
+}
+
+// Returns 1 if the packet belongs to the validated stream
+static int update_seq(struct rtp_stream *s, uint16_t seq) {
+    uint16_t udelta = seq - s->max_seq;
+
+    if (s->probation) {
+        // A new source is valid after RTP_MIN_SEQUENTIAL packets in sequence
+        if (udelta == 1) {
+            s->max_seq = seq;
+            if (--s->probation == 0) {
+                init_seq(s, seq);
+                s->received++;
+                return 1;
+            }
+        } else {
+            s->probation = RTP_MIN_SEQUENTIAL - 1;
+            s->max_seq = seq;
+        }
+        return 0;
+    }
+    if (udelta < RTP_MAX_DROPOUT) {
+        // In order, with permissible gap
+        if (seq < s->max_seq) {
+            s->cycles += RTP_SEQ_MOD;
+        }
+        s->max_seq = seq;
+    } else if (udelta <= RTP_SEQ_MOD - RTP_MAX_MISORDER) {
+        // A very large jump: two sequential packets mean the sender restarted
+        if (seq == s->bad_seq) {
+            init_seq(s, seq);
+        } else {
+            s->bad_seq = (seq + 1) & (RTP_SEQ_MOD - 1);
+            return 0;
+        }
+    }
+    // else duplicate or reordered, counted as received
+    s->received++;
+    return 1;
+}
+
+// Nearest usual RTP clock rate to an estimate from the first second
+static void set_clock_rate(struct rtp_stream *s, uint32_t ts, uint64_t arrival_ns) {
+    static const uint32_t rates[] = { 8000, 16000, 24000, 32000, 48000, 90000 };
+    uint64_t est = (uint64_t)(ts - s->first_ts) * NS_PER_SEC / (arrival_ns - s->first_ns);
+    uint32_t best = rates[0];
+
+    for (size_t i = 1; i < sizeof(rates) / sizeof(rates[0]); i++) {
+        // Past the geometric mean of the two, the higher rate is nearer
+        if (est * est > (uint64_t)best * rates[i]) {
+            best = rates[i];
+        }
+    }
+    s->clock_rate = best;
+    s->ticks_per_ns = (uint32_t)(((uint64_t)best << 32) / NS_PER_SEC);
+}
+
+// Close the one-second window: bitrate, frame rate, interval loss
+static void roll_window(struct rtp_stream *s, uint64_t arrival_ns) {
+    uint64_t elapsed = arrival_ns - s->window_ns;
+    uint32_t expected = s->cycles + s->max_seq - s->base_seq + 1;
+    uint32_t expected_interval = expected - s->expected_prior;
+    uint32_t received_interval = s->received - s->received_prior;
+    int32_t lost_interval = (int32_t)(expected_interval - received_interval);
+
+    s->bitrate = (uint32_t)((uint64_t)s->window_bytes * 8 * NS_PER_SEC / elapsed);
+    s->frame_rate = (uint32_t)(((uint64_t)s->window_frames * NS_PER_SEC + elapsed / 2) / elapsed);
+    s->interval_fraction = (expected_interval == 0 || lost_interval <= 0) ? 0 :
+                           (uint8_t)(((uint32_t)lost_interval << 8) / expected_interval);
+    s->expected_prior = expected;
+    s->received_prior = s->received;
+    s->frame_gap_peak_ns = s->frame_gap_max_ns;
+    s->frame_gap_max_ns = 0;
+    s->window_bytes = 0;
+    s->window_frames = 0;
+    s->window_ns = arrival_ns;
+}
+
+int rtp_track(struct rtp_table *t, const unsigned char *packet, int packet_len,
+              uint64_t arrival_ns) {
+    const struct iphdr *iph = (const struct iphdr *)packet;
+
+    if (packet_len < 20 || iph->version != 4 || iph->protocol != IPPROTO_UDP ||
+        (ntohs(iph->frag_off) & 0x1FFF)) {
+        return 0;
+    }
+    int ihl = iph->ihl * 4;
+    const struct udphdr *udph = (const struct udphdr *)(packet + ihl);
+    const unsigned char *rtp = packet + ihl + 8;
+    if (packet_len < ihl + 8 + 12 || ntohs(udph->uh_ulen) < 8 + 12) {
+        return 0;
+    }
+    // Version 2; packet types 192-223 are RTCP on a multiplexed port
+    if ((rtp[0] & 0xC0) != 0x80 || (rtp[1] >= 192 && rtp[1] <= 223)) {
+        return 0;
+    }
+
+    uint16_t seq = (rtp[2] << 8) | rtp[3];
+    uint32_t ts = ((uint32_t)rtp[4] << 24) | (rtp[5] << 16) | (rtp[6] << 8) | rtp[7];
+    struct rtp_key k = {
+        .saddr = iph->saddr, .daddr = iph->daddr,
+        .sport = udph->uh_sport, .dport = udph->uh_dport,
+        .ssrc = ((uint32_t)rtp[8] << 24) | (rtp[9] << 16) | (rtp[10] << 8) | rtp[11]
+    };
+    uint32_t now = table_now_sec();
+    struct rtp_stream *s = lookup(t, &k, seq, now);
+
+    s->slot.last_seen = now;
+    s->pt = rtp[1] & 0x7F;
+    if (!update_seq(s, seq)) {
+        return 1;
+    }
+
+    if (s->received == 1) {
+        // Just validated
+        s->first_ts = ts;
+        s->first_ns = arrival_ns;
+        s->last_ts = ts;
+        s->last_pkt_ts = ts;
+        s->last_arrival_ns = arrival_ns;
+        s->frame_start_ns = arrival_ns;
+        s->window_ns = arrival_ns;
+    } else {
+        if (!s->clock_rate && ts != s->first_ts && arrival_ns - s->first_ns >= NS_PER_SEC &&
+            arrival_ns - s->first_ns < 10 * NS_PER_SEC) {
+            set_clock_rate(s, ts, arrival_ns);
+        }
+
+        // Jitter, D(i-1, i) in timestamp units. A gap of more than ~4 s or
+        // a clock step backwards gives no sample.
+        uint64_t dn = arrival_ns - s->last_arrival_ns;
+        if (s->clock_rate && dn < 0xFFFFFFFFull) {
+            int32_t d = (int32_t)(((uint64_t)(uint32_t)dn * s->ticks_per_ns) >> 32) -
+                        (int32_t)(ts - s->last_pkt_ts);
+            if (d < 0) {
+                d = -d;
+            }
+            s->jitter += d - ((s->jitter + 8) >> 4);
+        }
+        s->last_arrival_ns = arrival_ns;
+        s->last_pkt_ts = ts;
+
+        // A newer timestamp starts a frame; late packets of older frames do not
+        if ((int32_t)(ts - s->last_ts) > 0) {
+            uint64_t gap = arrival_ns - s->frame_start_ns;
+            uint32_t gap_ns = gap > 0xFFFFFFFFull ? 0xFFFFFFFFu : (uint32_t)gap;
+            s->frame_gap_ns = gap_ns;
+            if (s->frames == 0) {
+                s->frame_gap_avg_ns = gap_ns;
+            } else {
+                s->frame_gap_avg_ns += ((int64_t)gap_ns - (int64_t)s->frame_gap_avg_ns) / 16;
+            }
+            if (gap_ns > s->frame_gap_max_ns) {
+                s->frame_gap_max_ns = gap_ns;
+            }
+            s->frames++;
+            s->window_frames++;
+            s->frame_start_ns = arrival_ns;
+            s->last_ts = ts;
+        }
+
+        if (arrival_ns - s->window_ns >= NS_PER_SEC) {
+            roll_window(s, arrival_ns);
+        }
+    }
+
+    uint32_t bytes = ntohs(udph->uh_ulen) - 8;
+    s->bytes += bytes;
+    s->window_bytes += bytes;
+    return 1;
+}
+
+static int live(const struct rtp_stream *s, uint32_t now) {
+    return s->slot.used && !s->probation && now - s->slot.last_seen <= RTP_IDLE_SEC;
+}
+
+int rtp_streams(const struct rtp_table *t) {
+    uint32_t now = table_now_sec();
+    int n = 0;
+    for (int i = 0; i < RTP_TABLE_SIZE; i++) {
+        n += live(&t->e[i], now);
+    }
+    return n;
+}
+
+int rtp_format(char *buf, size_t cap, const struct rtp_table *const *tables, int n) {
+    uint32_t now = table_now_sec();
+    size_t len = 0;
+
+    table_format_empty(buf, cap);
+    for (int w = 0; w < n && len < cap; w++) {
+        for (int i = 0; i < RTP_TABLE_SIZE && len < cap; i++) {
+            const struct rtp_stream *s = &tables[w]->e[i];
+            if (!live(s, now)) {
+                continue;
+            }
+            uint32_t expected = s->cycles + s->max_seq - s->base_seq + 1;
+            uint64_t jitter_ns = s->clock_rate ?
+                                 (uint64_t)s->jitter * (NS_PER_SEC / 16) / s->clock_rate : 0;
+            len += snprintf(buf + len, cap - len,
+                            "RTP 0x%08X pt %u %u.%u.%u.%u:%u > %u.%u.%u.%u:%u: "
+                            "%u pkts, %d lost (%u/256 last s), jitter %u.%u ms @ %u Hz, "
+                            "%u fps, frame gap %u.%u/%u.%u ms avg/max, %u kbit/s\n",
+                            s->key.ssrc, s->pt,
+                            ((const unsigned char *)&s->key.saddr)[0],
+                            ((const unsigned char *)&s->key.saddr)[1],
+                            ((const unsigned char *)&s->key.saddr)[2],
+                            ((const unsigned char *)&s->key.saddr)[3], ntohs(s->key.sport),
+                            ((const unsigned char *)&s->key.daddr)[0],
+                            ((const unsigned char *)&s->key.daddr)[1],
+                            ((const unsigned char *)&s->key.daddr)[2],
+                            ((const unsigned char *)&s->key.daddr)[3], ntohs(s->key.dport),
+                            s->received, (int32_t)(expected - s->received), s->interval_fraction,
+                            TABLE_MS10(jitter_ns / 1000), s->clock_rate, s->frame_rate,
+                            TABLE_MS10(s->frame_gap_avg_ns / 1000),
+                            TABLE_MS10(s->frame_gap_peak_ns / 1000),
+                            s->bitrate / 1000);
+        }
+    }
+    return len < cap ? (int)len : (int)cap - 1;
+}
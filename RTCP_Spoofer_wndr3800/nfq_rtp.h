@@ -0,0 +1,113 @@
+/* nfq_rtp.h
+   Passive per-SSRC RTP media statistics.
+
+   With -M every queued UDP packet that looks like RTP (version 2, payload
+   type outside the RTCP range, RFC 5761) is accounted to its stream, keyed
+   by (5-tuple, SSRC) in a fixed-size open addressing table per worker:
+
+     - sequence numbers, extended and validated as in RFC 3550 A.1, give the
+       packets expected and lost, in total and over the last second;
+     - interarrival jitter as in RFC 3550 6.4.1 / A.8, in timestamp units;
+       the clock rate is inferred from the first second of the stream;
+     - a new RTP timestamp starts a frame; the time between the first
+       packets of consecutive frames is the frame interval (what
+       live_monitoring/frame_delay.py plots);
+     - payload bitrate over the last second.
+
+   This is the ground truth the rewritten receiver reports are spoofing, as
+   seen at the router. Nothing here allocates; the per-packet cost is one
+   hash lookup and a few integer operations.
+
+   Media only reaches the queue without the RTCP pre-filter (-I).
+*/
+
+#ifndef NFQ_RTP_H
+#define NFQ_RTP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "nfq_table.h"
+
+#define RTP_TABLE_SIZE      256         // entries, power of two
+#define RTP_MAX_PROBE       8           // linear probe window
+#define RTP_IDLE_SEC        30          // entries idle this long are reused
+
+// RFC 3550 A.1 sequence validation
+#define RTP_MIN_SEQUENTIAL  2
+#define RTP_MAX_DROPOUT     3000
+#define RTP_MAX_MISORDER    100
+
+struct rtp_key {
+    uint32_t saddr, daddr;              // network order
+    uint16_t sport, dport;
+    uint32_t ssrc;                      // host order
+};
+
+struct rtp_stream {
+    struct table_slot slot;
+    struct rtp_key key;
+    uint8_t pt;
+    uint8_t probation;                  // sequential packets still needed
+    uint8_t interval_fraction;          // lost over the last second, 1/256 units
+    uint16_t max_seq;
+    uint32_t cycles;                    // wraps of the sequence number << 16
+    uint32_t base_seq;
+    uint32_t bad_seq;
+    uint32_t received;
+
+    // Clock rate, inferred once from the first second
+    uint64_t first_ns;
+    uint32_t first_ts;
+    uint32_t clock_rate;                // Hz, 0 = not known yet
+    uint32_t ticks_per_ns;              // clock_rate / 1e9 in 0.32 fixed point
+
+    // Jitter (RFC 3550 A.8: 16 times the estimate, in timestamp units)
+    uint32_t last_ts;                   // RTP timestamp of the newest frame
+    uint64_t last_arrival_ns;
+    uint32_t last_pkt_ts;
+    uint32_t jitter;
+
+    // Frames
+    uint64_t frame_start_ns;
+    uint32_t frames;
+    uint32_t frame_gap_ns;              // last frame interval
+    uint32_t frame_gap_avg_ns;          // moving average, 1/16 per frame
+    uint32_t frame_gap_max_ns;          // largest in the current second
+    uint32_t frame_gap_peak_ns;         // largest in the last complete second
+
+    // Last second window (bitrate, interval loss, frame rate)
+    uint64_t window_ns;
+    uint32_t window_bytes;
+    uint32_t window_frames;
+    uint32_t expected_prior;
+    uint32_t received_prior;
+    uint32_t bitrate;                   // bits/s of RTP packets
+    uint32_t frame_rate;                // frames in the last second
+
+    uint64_t bytes;
+};
+
+struct rtp_table {
+    struct rtp_stream e[RTP_TABLE_SIZE];
+    unsigned long tracked;              // streams inserted
+    unsigned long evicted;              // live streams pushed out by a full probe window
+};
+
+// An empty table, from table_alloc
+struct rtp_table *rtp_table_create(void);
+
+// Account one IPv4 packet that arrived at arrival_ns (any clock, ns). Returns
+// 1 if it was RTP, 0 otherwise.
+int rtp_track(struct rtp_table *t, const unsigned char *packet, int packet_len,
+              uint64_t arrival_ns);
+
+// Streams past probation and not idle
+int rtp_streams(const struct rtp_table *t);
+
+// One line per stream of every table, for the stats report. Tables are read
+// without locking while their worker runs, so a line can mix two packets'
+// state. Returns the length, at most cap - 1.
+int rtp_format(char *buf, size_t cap, const struct rtp_table *const *tables, int n);
+
+#endif
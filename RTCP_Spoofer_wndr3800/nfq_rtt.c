@@ -0,0 +1,175 @@
+/* nfq_rtt.c
+   Passive round-trip time from LSR/DLSR (see nfq_rtt.h).
+*/
+
+#include <stdio.h>
+#include <arpa/inet.h>
+
+#include "nfq_rtt.h"
+
+struct rtt_table *rtt_table_create(void) {
+    return table_alloc(sizeof(struct rtt_table));
+}
+
+static uint32_t rtt_hash(uint32_t ssrc) {
+    return table_hash_fold(table_hash_ssrc(ssrc));
+}
+
+static int ssrc_equal(const struct table_slot *s, const void *ssrc) {
+    return ((const struct rtt_entry *)s)->ssrc == *(const uint32_t *)ssrc;
+}
+
+static const struct rtt_entry *find(const struct rtt_table *t, uint32_t ssrc) {
+    return (const struct rtt_entry *)table_find(t->e, sizeof(t->e[0]), RTT_TABLE_SIZE,
+                                                RTT_MAX_PROBE, rtt_hash(ssrc), ssrc_equal, &ssrc);
+}
+
+// The SSRC's entry, claimed (see nfq_table.h) if it has none
+static struct rtt_entry *lookup(struct rtt_table *t, uint32_t ssrc, uint32_t now) {
+    int how;
+    struct rtt_entry *e = (struct rtt_entry *)
+        table_probe(t->e, sizeof(t->e[0]), RTT_TABLE_SIZE, RTT_MAX_PROBE, rtt_hash(ssrc), now,
+                    RTT_IDLE_SEC, ssrc_equal, &ssrc, &how);
+
+    if (how == TABLE_FOUND) {
+        return e;
+    }
+    if (how == TABLE_EVICTED) {
+        t->evicted++;
+    }
+    // Readers in other workers may be probing this slot; they recheck the
+    // NTP bits, so clear those first and fence them ahead of everything
+    // else. The shared fields are reset one by one, never by memset.
+    for (int i = 0; i < RTT_SR_HISTORY; i++) {
+        __atomic_store_n(&e->sr_mid[i], 0, __ATOMIC_RELAXED);
+    }
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    for (int i = 0; i < RTT_SR_HISTORY; i++) {
+        __atomic_store_n(&e->sr_us[i], 0, __ATOMIC_RELAXED);
+    }
+    e->sr_next = 0;
+    e->rr_saddr = 0;
+    e->rr_sport = 0;
+    e->samples = e->unmatched = 0;
+    e->last_us = e->srtt_us = e->min_us = e->max_us = 0;
+    e->ssrc = ssrc;
+    e->slot.used = 1;
+    t->tracked++;
+    return e;
+}
+
+void rtt_sr(struct rtt_table *t, uint32_t ssrc, const unsigned char *info, uint64_t arrival_ns) {
+    uint32_t now = table_now_sec();
+    struct rtt_entry *e = lookup(t, ssrc, now);
+    // Middle 32 bits of the 64-bit NTP timestamp
+    uint32_t mid = ((uint32_t)info[2] << 24) | (info[3] << 16) | (info[4] << 8) | info[5];
+    int i = e->sr_next;
+
+    e->slot.last_seen = now;
+    if (mid == 0) {
+        return;                         // indistinguishable from an empty slot
+    }
+    // Seqlock-style: a release store orders only what precedes it, so the
+    // fence keeps the new arrival from becoming visible under the old bits
+    __atomic_store_n(&e->sr_mid[i], 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&e->sr_us[i], (uint32_t)(arrival_ns / 1000), __ATOMIC_RELAXED);
+    __atomic_store_n(&e->sr_mid[i], mid, __ATOMIC_RELEASE);
+    e->sr_next = (i + 1) % RTT_SR_HISTORY;
+}
+
+// Arrival of the SR with these NTP bits in t; 0 if t has no such SR
+static int sr_arrival(const struct rtt_table *t, uint32_t ssrc, uint32_t lsr, uint32_t *us) {
+    const struct rtt_entry *e = find(t, ssrc);
+    if (!e) {
+        return 0;
+    }
+    for (int i = 0; i < RTT_SR_HISTORY; i++) {
+        if (__atomic_load_n(&e->sr_mid[i], __ATOMIC_ACQUIRE) != lsr) {
+            continue;
+        }
+        uint32_t v = __atomic_load_n(&e->sr_us[i], __ATOMIC_ACQUIRE);
+        // Unchanged around the read: v belongs to this SR
+        if (__atomic_load_n(&e->sr_mid[i], __ATOMIC_ACQUIRE) == lsr) {
+            *us = v;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int rtt_report(struct rtt_table *t, const struct rtcp_report_block *rb, uint32_t saddr,
+               uint16_t sport, uint64_t arrival_ns) {
+    uint32_t lsr = ntohl(rb->lsr);
+    uint32_t ssrc = ntohl(rb->ssrc);
+    uint32_t sr_us;
+    int found;
+
+    // LSR 0: the receiver has had no SR yet
+    if (lsr == 0) {
+        return 0;
+    }
+    found = sr_arrival(t, ssrc, lsr, &sr_us);
+    for (int i = 0; !found && t->peers && i < t->n_peers; i++) {
+        if (t->peers[i] && t->peers[i] != t) {
+            found = sr_arrival(t->peers[i], ssrc, lsr, &sr_us);
+        }
+    }
+
+    uint32_t now = table_now_sec();
+    struct rtt_entry *e = lookup(t, ssrc, now);
+    e->slot.last_seen = now;
+    e->rr_saddr = saddr;
+    e->rr_sport = sport;
+    if (!found) {
+        e->unmatched++;
+        return 0;
+    }
+
+    // DLSR is in 1/65536 s
+    uint32_t held_us = (uint32_t)(((uint64_t)ntohl(rb->dlsr) * 15625) >> 10);
+    int64_t rtt = (int64_t)(uint32_t)((uint32_t)(arrival_ns / 1000) - sr_us) - held_us;
+    if (rtt > RTT_MAX_US) {
+        e->unmatched++;
+        return 0;
+    }
+    // DLSR is rounded by the receiver; a little below zero is a short hop
+    uint32_t us = rtt < 0 ? 0 : (uint32_t)rtt;
+
+    e->last_us = us;
+    if (e->samples++ == 0) {
+        e->srtt_us = e->min_us = e->max_us = us;
+    } else {
+        e->srtt_us += ((int32_t)(us - e->srtt_us)) >> RTT_EWMA_SHIFT;
+        if (us < e->min_us) e->min_us = us;
+        if (us > e->max_us) e->max_us = us;
+    }
+    return 1;
+}
+
+const struct rtt_entry *rtt_find(const struct rtt_table *t, uint32_t ssrc) {
+    return find(t, ssrc);
+}
+
+int rtt_format(char *buf, size_t cap, const struct rtt_table *const *tables, int n) {
+    size_t len = 0;
+
+    table_format_empty(buf, cap);
+    for (int w = 0; w < n && len < cap; w++) {
+        for (int i = 0; i < RTT_TABLE_SIZE && len < cap; i++) {
+            const struct rtt_entry *e = &tables[w]->e[i];
+            if (!e->slot.used || (e->samples == 0 && e->unmatched == 0)) {
+                continue;
+            }
+            const unsigned char *a = (const unsigned char *)&e->rr_saddr;
+            len += snprintf(buf + len, cap - len,
+                            "RTT 0x%08X (RR from %u.%u.%u.%u:%u): %u.%u ms smoothed, "
+                            "%u.%u last, %u.%u-%u.%u min-max, %u samples, %u unmatched\n",
+                            e->ssrc, a[0], a[1], a[2], a[3], ntohs(e->rr_sport),
+                            TABLE_MS10(e->srtt_us), TABLE_MS10(e->last_us), TABLE_MS10(e->min_us),
+                            TABLE_MS10(e->max_us),
+                            e->samples, e->unmatched);
+        }
+    }
+    return len < cap ? (int)len : (int)cap - 1;
+}
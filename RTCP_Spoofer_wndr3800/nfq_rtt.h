@@ -0,0 +1,87 @@
+/* nfq_rtt.h
+   Passive round-trip time from the LSR/DLSR fields of receiver reports.
+
+   A sender's SR carries an NTP timestamp; a receiver's report block about
+   that sender echoes its middle 32 bits as LSR, along with DLSR, the time
+   it held the SR before reporting. The router does not share the
+   sender's clock, so instead of the sender's arrival - LSR - DLSR it
+   remembers when each SR passed, keyed by the NTP mid-32 bits, and takes
+
+     RTT = RR arrival - arrival of the SR named by LSR - DLSR
+
+   which is the round trip between the router and the receiver (on the
+   experiments' setup, the wireless hop), measured without sending
+   anything. Both directions must be queued for SRs and RRs to meet.
+
+   Each worker keeps a fixed-size open addressing table keyed by SSRC,
+   holding the last few SRs of that sender and the RTT statistics of
+   reports about it. An SR and the RRs answering it belong to different
+   flows and may be queued to different workers, so a worker looks for
+   the SR in every worker's table: only the owner writes an entry, and a
+   reader rechecks the NTP bits around reading the arrival time.
+*/
+
+#ifndef NFQ_RTT_H
+#define NFQ_RTT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "nfq_table.h"
+#include "rtcp.h"
+
+#define RTT_TABLE_SIZE      256         // entries, power of two
+#define RTT_MAX_PROBE       8           // linear probe window
+#define RTT_IDLE_SEC        60          // entries idle this long are reused
+#define RTT_SR_HISTORY      4           // an RR may name an older SR after losses
+#define RTT_EWMA_SHIFT      3           // smoothed RTT moves 1/8 per sample, as TCP's
+#define RTT_MAX_US          10000000    // longer samples are taken as mismatches
+
+struct rtt_entry {
+    struct table_slot slot;
+    uint32_t ssrc;                      // host order
+    uint8_t sr_next;                    // ring position
+
+    // SRs this worker saw from ssrc
+    uint32_t sr_mid[RTT_SR_HISTORY];    // NTP middle 32 bits, 0 = empty
+    uint32_t sr_us[RTT_SR_HISTORY];     // arrival in us (wraps; only differences are used)
+
+    // Reports about ssrc this worker saw
+    uint32_t rr_saddr;                  // last reporter, network order
+    uint16_t rr_sport;
+    uint32_t samples;
+    uint32_t unmatched;                 // LSR named no SR we saw
+    uint32_t last_us;
+    uint32_t srtt_us;                   // EWMA
+    uint32_t min_us;
+    uint32_t max_us;
+};
+
+struct rtt_table {
+    struct rtt_entry e[RTT_TABLE_SIZE];
+    unsigned long tracked;              // SSRCs inserted
+    unsigned long evicted;              // live entries pushed out by a full probe window
+    struct rtt_table *const *peers;     // every worker's table (NULL slots skipped), or NULL
+    int n_peers;
+};
+
+// An empty table, from table_alloc
+struct rtt_table *rtt_table_create(void);
+
+// An SR from ssrc passed at arrival_ns (the router's clock); info is the
+// sender info as given to an rtcp_sr_fn
+void rtt_sr(struct rtt_table *t, uint32_t ssrc, const unsigned char *info, uint64_t arrival_ns);
+
+// A report block from saddr:sport arrived at arrival_ns. Returns 1 if it
+// gave an RTT sample.
+int rtt_report(struct rtt_table *t, const struct rtcp_report_block *rb, uint32_t saddr,
+               uint16_t sport, uint64_t arrival_ns);
+
+// This worker's statistics for reports about ssrc, or NULL
+const struct rtt_entry *rtt_find(const struct rtt_table *t, uint32_t ssrc);
+
+// One line per SSRC with samples, of every table, for the stats report.
+// Returns the length, at most cap - 1.
+int rtt_format(char *buf, size_t cap, const struct rtt_table *const *tables, int n);
+
+#endif
@@ -0,0 +1,297 @@
+/* nfq_sched.c
+   Timer-driven synthetic receiver reports (see nfq_sched.h).
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <time.h>
+#include <sys/timerfd.h>
+#include <arpa/inet.h>
+
+#include "nfq_sched.h"
+#include "nfq_log.h"
+
+static uint64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + ts.tv_nsec;
+}
+
+struct sched *sched_create(int interval_ms) {
+    struct sched *s = calloc(1, sizeof(*s));
+    if (!s) {
+        return NULL;
+    }
+    s->tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (s->tfd < 0) {
+        perror("timerfd_create");
+        free(s);
+        return NULL;
+    }
+    s->interval = interval_ms / SCHED_TICK_MS;
+    if (s->interval < 1) {
+        s->interval = 1;
+    }
+    for (int i = 0; i < SCHED_WHEEL_SLOTS; i++) {
+        s->wheel[i] = -1;
+    }
+    return s;
+}
+
+void sched_destroy(struct sched *s) {
+    if (s) {
+        close(s->tfd);
+        free(s);
+    }
+}
+
+static void arm(struct sched *s, int on) {
+    long ns = on ? SCHED_TICK_MS * 1000000L : 0;
+    struct itimerspec its = {
+        .it_interval = { .tv_sec = 0, .tv_nsec = ns },
+        .it_value = { .tv_sec = 0, .tv_nsec = ns }
+    };
+    timerfd_settime(s->tfd, 0, &its, NULL);
+}
+
+static void enqueue(struct sched *s, int i, uint32_t delay) {
+    struct sched_stream *st = &s->s[i];
+    int slot;
+
+    st->due = s->tick + delay;
+    slot = st->due & (SCHED_WHEEL_SLOTS - 1);
+    st->next = s->wheel[slot];
+    s->wheel[slot] = i;
+    st->queued = 1;
+    if (s->n_queued++ == 0) {
+        arm(s, 1);
+    }
+}
+
+// Template fields as a policy key (media SSRC filled in per block)
+static struct policy_key stream_key(const unsigned char *packet) {
+    const struct iphdr *iph = (const struct iphdr *)packet;
+    const struct udphdr *udph = (const struct udphdr *)(packet + iph->ihl * 4);
+    struct policy_key k = {
+        .saddr = iph->saddr, .daddr = iph->daddr,
+        .sport = udph->uh_sport, .dport = udph->uh_dport
+    };
+    return k;
+}
+
+static struct rtcp_report_block *first_block(unsigned char *packet, int *count) {
+    unsigned char *rr = packet + ((struct iphdr *)packet)->ihl * 4 + 8;
+    *count = rr[0] & 0x1F;
+    return (struct rtcp_report_block *)(rr + RTCP_RR_BLOCKS_OFFSET);
+}
+
+// Does the stream owe the sender more reports?
+static int pending(struct sched_stream *st, struct pkt_path *pp, const struct live_config *cfg) {
+    if (st->burst > 0) {
+        return 1;
+    }
+    int count;
+    struct rtcp_report_block *rb = first_block(st->tmpl, &count);
+    struct policy_key k = stream_key(st->tmpl);
+    for (int i = 0; i < count; i++) {
+        k.ssrc = ntohl(rb[i].ssrc);
+        if (!policy_settled(pp->policies, &cfg->rules, &k)) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Build one RR from the stream's template under cfg and inject it
+static void send_report(struct sched_stream *st, struct pkt_path *pp,
+                        const struct live_config *cfg, uint64_t now) {
+    static __thread unsigned char pkt[SCHED_TEMPLATE_MAX];
+    struct iphdr *iph = (struct iphdr *)pkt;
+    int ihl, count;
+
+    memcpy(pkt, st->tmpl, st->len);
+    ihl = iph->ihl * 4;
+    struct udphdr *udph = (struct udphdr *)(pkt + ihl);
+    struct rtcp_report_block *rb = first_block(pkt, &count);
+    struct policy_key k = stream_key(pkt);
+
+    // DLSR counts on from the real report; 1/65536 s units
+    uint32_t elapsed = (uint32_t)(((now - st->learned_ns) << 16) / 1000000000u);
+    for (int i = 0; i < count; i++) {
+        if (rb[i].lsr) {
+            rb[i].dlsr = htonl(ntohl(rb[i].dlsr) + elapsed);
+        }
+        k.ssrc = ntohl(rb[i].ssrc);
+        policy_apply(pp->policies, &cfg->rules, &k, (uint32_t)(now / 1000000000u), &rb[i]);
+    }
+
+    iph->id = htons(++st->ip_id);
+    iph->check = 0;
+    iph->check = htons(calculate_ip_checksum_debug(iph, NULL));
+    if (udph->uh_sum) {
+        udph->uh_sum = 0;
+        udph->uh_sum = htons(calculate_udp_checksum(iph, udph, pkt + ihl + 8, st->len - ihl - 8));
+    }
+
+    if (pp->src->inject(pp->src, pkt, st->len) > 0) {
+        pp->stats.synthetic_sent++;
+    }
+    if (st->burst > 0) {
+        st->burst--;
+    }
+}
+
+void sched_learn(struct sched *s, const unsigned char *packet, int len) {
+    const struct iphdr *iph = (const struct iphdr *)packet;
+    int ihl = iph->ihl * 4;
+    const unsigned char *rr = packet + ihl + 8;
+
+    // The walker has checked the UDP length; only the first header is needed
+    if (len < ihl + 8 + RTCP_RR_BLOCKS_OFFSET || (rr[0] & 0xC0) != 0x80 || rr[1] != RTCP_RR ||
+        (rr[0] & 0x1F) == 0) {
+        return;
+    }
+    int rr_len = ihl + 8 + (((rr[2] << 8) | rr[3]) + 1) * 4;
+    if (rr_len > len || rr_len > SCHED_TEMPLATE_MAX ||
+        rr_len < ihl + 8 + RTCP_RR_BLOCKS_OFFSET + (rr[0] & 0x1F) * (int)sizeof(struct rtcp_report_block)) {
+        return;
+    }
+
+    struct policy_key k = stream_key(packet);
+    uint32_t sender = ((uint32_t)rr[4] << 24) | (rr[5] << 16) | (rr[6] << 8) | rr[7];
+    uint64_t now = monotonic_ns();
+    int slot = -1, oldest = -1;
+
+    for (int i = 0; i < SCHED_MAX_STREAMS; i++) {
+        struct sched_stream *st = &s->s[i];
+        if (!st->used) {
+            if (slot < 0) slot = i;
+            continue;
+        }
+        const unsigned char *t = st->tmpl + ((const struct iphdr *)st->tmpl)->ihl * 4 + 8;
+        struct policy_key tk = stream_key(st->tmpl);
+        if (tk.saddr == k.saddr && tk.daddr == k.daddr && tk.sport == k.sport &&
+            tk.dport == k.dport && memcmp(t + 4, rr + 4, 4) == 0) {
+            slot = i;
+            oldest = -1;
+            break;
+        }
+        if (oldest < 0 || st->learned_ns < s->s[oldest].learned_ns) {
+            oldest = i;
+        }
+    }
+    if (slot < 0) {
+        slot = oldest;              // full: replace the stream heard from least recently
+    }
+
+    struct sched_stream *st = &s->s[slot];
+    if (!st->used) {
+        LOG_DEBUG("    [SCHED] Learned stream of sender SSRC 0x%08X\n", sender);
+    }
+    memcpy(st->tmpl, packet, rr_len);
+    // The template is the RR alone (reduced-size RTCP, RFC 5506)
+    struct iphdr *tiph = (struct iphdr *)st->tmpl;
+    struct udphdr *tudph = (struct udphdr *)(st->tmpl + ihl);
+    tiph->tot_len = htons(rr_len);
+    tudph->uh_ulen = htons(rr_len - ihl);
+    st->len = rr_len;
+    st->ip_id = ntohs(iph->id);
+    st->learned_ns = now;
+    st->used = 1;
+    
+    // Checked again one interval from now, in case a TARGET glide has
+    // started for it
+    if (!st->queued) {
+        enqueue(s, slot, s->interval);
+    }
+}
+
+// Fire everything due at the current tick
+static void run_tick(struct sched *s, struct pkt_path *pp, const struct live_config *cfg,
+                     uint64_t now) {
+    int slot = s->tick & (SCHED_WHEEL_SLOTS - 1);
+    int i = s->wheel[slot];
+
+    s->wheel[slot] = -1;
+    while (i >= 0) {
+        struct sched_stream *st = &s->s[i];
+        int next = st->next;
+
+        if (st->used && (int32_t)(st->due - s->tick) > 0) {
+            // Another lap of the wheel to go
+            st->next = s->wheel[slot];
+            s->wheel[slot] = i;
+        } else {
+            st->queued = 0;
+            s->n_queued--;
+            if (st->used && now - st->learned_ns > SCHED_IDLE_SEC * 1000000000ull) {
+                st->used = 0;       // receiver went quiet
+            } else if (st->used && cfg->mode != MODE_ACCEPT_ALL && pending(st, pp, cfg)) {
+                send_report(st, pp, cfg, now);
+                if (pending(st, pp, cfg)) {
+                    enqueue(s, i, s->interval);
+                }
+            }
+        }
+        i = next;
+    }
+}
+
+int sched_wait(struct sched *s, int fd, int timeout_ms) {
+    struct pollfd pfd[2] = {
+        { .fd = fd, .events = POLLIN },
+        { .fd = s->tfd, .events = POLLIN }
+    };
+
+    if (poll(pfd, 2, timeout_ms) <= 0) {
+        return 0;
+    }
+    s->fired = (pfd[1].revents & POLLIN) != 0;
+    return (pfd[0].revents & (POLLIN | POLLERR)) != 0;
+}
+
+void sched_run(struct sched *s, struct pkt_path *pp, const struct live_config *cfg) {
+    uint64_t ticks;
+    uint64_t now = monotonic_ns();
+
+    if (s->fired && read(s->tfd, &ticks, sizeof(ticks)) == sizeof(ticks)) {
+        s->fired = 0;
+        while (ticks-- > 0) {
+            s->tick++;
+            run_tick(s, pp, cfg, now);
+        }
+        if (s->n_queued == 0) {
+            arm(s, 0);
+        }
+    }
+
+    // New configuration: every stream gets a report now and a short burst
+    if (cfg->gen != s->gen) {
+        s->gen = cfg->gen;
+        if (cfg->mode == MODE_ACCEPT_ALL) {
+            return;
+        }
+        for (int i = 0; i < SCHED_MAX_STREAMS; i++) {
+            struct sched_stream *st = &s->s[i];
+            if (!st->used || now - st->learned_ns > SCHED_IDLE_SEC * 1000000000ull) {
+                continue;
+            }
+            st->burst = SCHED_BURST;
+            send_report(st, pp, cfg, now);
+            if (!st->queued && pending(st, pp, cfg)) {
+                enqueue(s, i, s->interval);
+            }
+        }
+    }
+}
+
+int sched_streams(const struct sched *s) {
+    int n = 0;
+    for (int i = 0; i < SCHED_MAX_STREAMS; i++) {
+        n += s->s[i].used;
+    }
+    return n;
+}
@@ -0,0 +1,74 @@
+/* nfq_sched.h
+   Timer-driven synthetic receiver reports.
+
+   Real RRs arrive about once a second, which is how often a rewrite can
+   reach the media sender. The scheduler learns each receiver stream from
+   its real RRs (addresses, ports, sender SSRC and the report blocks, kept
+   as a packet template) and, after a configuration change, sends extra
+   RRs built from the template at a fixed interval (-i) until the change
+   has fully reached the sender: a short burst for every stream, continued
+   while a TARGET glide is still moving.
+
+   Each worker owns one scheduler and runs it between packets: a timerfd
+   ticking every SCHED_TICK_MS drives a hashed timer wheel, and is only
+   armed while reports are queued. Synthetic reports go through the same
+   policy table as real ones, so both carry the same values.
+*/
+
+#ifndef NFQ_SCHED_H
+#define NFQ_SCHED_H
+
+#include <stdint.h>
+
+#include "nfq_pkt.h"
+
+#define SCHED_MAX_STREAMS   64
+#define SCHED_TEMPLATE_MAX  512         // IP + UDP + RR with up to 20 blocks
+#define SCHED_WHEEL_SLOTS   64          // power of two
+#define SCHED_TICK_MS       5
+#define SCHED_BURST         3           // reports per stream after any configuration change
+#define SCHED_IDLE_SEC      10          // streams without a real RR for this long are dropped
+
+struct sched_stream {
+    uint8_t used;
+    uint8_t queued;                     // on the wheel
+    uint8_t burst;                      // reports still owed for the last change
+    uint16_t len;
+    uint16_t ip_id;
+    int next;                           // wheel slot list, -1 = end
+    uint32_t due;                       // tick to fire at
+    uint64_t learned_ns;                // when the template was taken
+    unsigned char tmpl[SCHED_TEMPLATE_MAX];
+};
+
+struct sched {
+    int tfd;                            // timerfd, armed while anything is queued
+    int fired;                          // sched_wait saw it readable
+    uint32_t tick;                      // ticks run so far
+    uint32_t interval;                  // ticks between synthetic reports of a stream
+    uint32_t gen;                       // configuration generation last acted on
+    int n_queued;
+    int wheel[SCHED_WHEEL_SLOTS];
+    struct sched_stream s[SCHED_MAX_STREAMS];
+};
+
+// Allocate a scheduler sending every interval_ms; NULL on failure
+struct sched *sched_create(int interval_ms);
+void sched_destroy(struct sched *s);
+
+// Verdict path: keep the original (not yet rewritten) bytes of a complete
+// RTCP packet as the stream's template if it starts with an RR
+void sched_learn(struct sched *s, const unsigned char *packet, int len);
+
+// Wait up to timeout_ms for fd to become readable or the timer to tick.
+// Returns 1 if fd is readable.
+int sched_wait(struct sched *s, int fd, int timeout_ms);
+
+// Run the ticks that have passed and react to a new configuration
+// generation; synthetic reports go out through pp->src
+void sched_run(struct sched *s, struct pkt_path *pp, const struct live_config *cfg);
+
+// Streams currently known
+int sched_streams(const struct sched *s);
+
+#endif
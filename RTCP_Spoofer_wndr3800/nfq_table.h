@@ -0,0 +1,126 @@
+/* nfq_table.h
+   Pieces shared by the per-worker tables (policy, RTP, RTT) and the flow
+   cache: the key hashes, the coarse second clock, and the probe window of
+   the fixed-size open addressing tables.
+
+   Each of those tables is an array of entries that begin with a struct
+   table_slot, allocated zeroed at startup and never in the verdict path.
+   A key hashes to a window of a few consecutive slots; a key that is not
+   there claims the first free or idle slot of the window, else the least
+   recently seen one, so the footprint stays fixed and a burst of new
+   streams pushes out the stalest.
+*/
+
+#ifndef NFQ_TABLE_H
+#define NFQ_TABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define TABLE_LINE 64                   // table alignment; two of the 24Kc's 32-byte lines
+
+// First member of every table entry
+struct table_slot {
+    uint32_t last_seen;                 // seconds, CLOCK_MONOTONIC_COARSE
+    uint8_t used;
+};
+
+// What table_probe found
+enum {
+    TABLE_FOUND = 0,                    // the key's own entry
+    TABLE_CLAIMED,                      // a free or idle slot, to be initialised
+    TABLE_EVICTED                       // a live entry's slot, to be initialised
+};
+
+// Allocate an empty table (at startup, never in the verdict path)
+static inline void *table_alloc(size_t size) {
+    void *t;
+    if (posix_memalign(&t, TABLE_LINE, size) != 0) {
+        return NULL;
+    }
+    return memset(t, 0, size);
+}
+
+static inline uint32_t table_now_sec(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+    return (uint32_t)ts.tv_sec;
+}
+
+// Addresses and ports of a flow, network order, before the final fold
+static inline uint32_t table_hash_addrs(uint32_t saddr, uint32_t daddr, uint16_t sport,
+                                        uint16_t dport) {
+    uint32_t h = saddr * 0x9E3779B1u;
+    h ^= daddr * 0x85EBCA77u;
+    h ^= (((uint32_t)sport << 16) | dport) * 0xC2B2AE3Du;
+    return h;
+}
+
+static inline uint32_t table_hash_ssrc(uint32_t ssrc) {
+    return ssrc * 0x27D4EB2Fu;
+}
+
+static inline uint32_t table_hash_fold(uint32_t h) {
+    return h ^ (h >> 15);
+}
+
+// The entry at position i of hash h's window; size is a power of two
+static inline struct table_slot *table_at(void *e, size_t entry_size, uint32_t size,
+                                          uint32_t h, int i) {
+    return (struct table_slot *)((char *)e + ((h + i) & (size - 1)) * entry_size);
+}
+
+// Find key's entry, or NULL. match is called on used entries only.
+static inline const struct table_slot *table_find(const void *e, size_t entry_size,
+                                                  uint32_t size, int probe, uint32_t h,
+                                                  int (*match)(const struct table_slot *,
+                                                               const void *),
+                                                  const void *key) {
+    for (int i = 0; i < probe; i++) {
+        const struct table_slot *s = table_at((void *)e, entry_size, size, h, i);
+        if (s->used && match(s, key)) {
+            return s;
+        }
+    }
+    return NULL;
+}
+
+// Find key's entry or pick one to claim: a free or idle slot in the probe
+// window, else the least recently seen entry. *how says which (TABLE_*);
+// a claimed slot still holds its old contents.
+static inline struct table_slot *table_probe(void *e, size_t entry_size, uint32_t size,
+                                             int probe, uint32_t h, uint32_t now,
+                                             uint32_t idle_sec,
+                                             int (*match)(const struct table_slot *, const void *),
+                                             const void *key, int *how) {
+    struct table_slot *free_slot = NULL, *oldest = NULL;
+
+    for (int i = 0; i < probe; i++) {
+        struct table_slot *s = table_at(e, entry_size, size, h, i);
+        if (s->used && match(s, key)) {
+            *how = TABLE_FOUND;
+            return s;
+        }
+        if (!s->used || now - s->last_seen > idle_sec) {
+            if (!free_slot) free_slot = s;
+        } else if (!oldest || s->last_seen < oldest->last_seen) {
+            oldest = s;
+        }
+    }
+    *how = free_slot ? TABLE_CLAIMED : TABLE_EVICTED;
+    return free_slot ? free_slot : oldest;
+}
+
+// Stats reports: tenths of a millisecond as "%u.%u", and an empty report
+#define TABLE_MS10(us) (unsigned)((us) / 1000), (unsigned)((us) / 100 % 10)
+
+static inline void table_format_empty(char *buf, size_t cap) {
+    if (cap) {
+        buf[0] = '\0';
+    }
+}
+
+#endif
@@ -0,0 +1,276 @@
+/* rtcp.c
+   Compound RTCP walker (see rtcp.h).
+*/
+
+#include <string.h>
+#include <arpa/inet.h>
+
+#include "rtcp.h"
+#include "csum.h"
+
+#define BLOCK_WORDS (sizeof(struct rtcp_report_block) / 4)
+
+#define FB_FMT_AFB  15              // PSFB application layer feedback (REMB)
+#define FB_FMT_TWCC 15              // RTPFB transport-wide CC
+
+#define REMB_OFFSET        16       // num SSRC | BR exp | BR mantissa
+#define TWCC_CHUNKS_OFFSET 20       // after base seq, status count, ref time, fb count
+
+// RTCP_FB_* for messages the walker hands to the feedback callback, else 0
+static int feedback_type(const unsigned char *pkt, int len) {
+    int fmt = pkt[0] & 0x1F;
+    if (pkt[1] == RTCP_RTPFB && fmt == FB_FMT_TWCC) {
+        return RTCP_FB_TWCC;
+    }
+    if (pkt[1] == RTCP_PSFB && fmt == FB_FMT_AFB && len >= REMB_OFFSET &&
+        memcmp(pkt + 12, "REMB", 4) == 0) {
+        return RTCP_FB_REMB;
+    }
+    return 0;
+}
+
+void rtcp_walk(unsigned char *rtcp, int len, const struct rtcp_handlers *ops, void *ctx,
+               uint16_t *udp_csum, struct rtcp_walk *out) {
+    int off = 0;
+
+    memset(out, 0, sizeof(*out));
+
+    while (len - off >= (int)sizeof(struct rtcp_header)) {
+        const struct rtcp_header *h = (const struct rtcp_header *)(rtcp + off);
+        int pkt_len = (ntohs(h->length) + 1) * 4;
+
+        if ((h->version_p_count >> 6) != 2 || pkt_len > len - off) {
+            out->malformed = 1;
+            return;
+        }
+        out->packets++;
+
+        int first_block;
+        if (h->packet_type == RTCP_SR) {
+            first_block = RTCP_SR_BLOCKS_OFFSET;
+        } else if (h->packet_type == RTCP_RR) {
+            first_block = RTCP_RR_BLOCKS_OFFSET;
+        } else {
+            int type = feedback_type(rtcp + off, pkt_len);
+            if (type == RTCP_FB_REMB) {
+                out->remb++;
+            } else if (type == RTCP_FB_TWCC) {
+                out->twcc++;
+            }
+            if (type && ops && ops->feedback) {
+                int rv = ops->feedback(ctx, type, rtcp + off, pkt_len, udp_csum);
+                if (rv > 0) {
+                    out->fb_rewritten++;
+                } else if (rv < 0) {
+                    out->malformed = 1;
+                }
+            }
+            off += pkt_len;
+            continue;
+        }
+
+        int rc = h->version_p_count & 0x1F;
+        if (first_block + rc * (int)sizeof(struct rtcp_report_block) > pkt_len) {
+            out->malformed = 1;
+            return;
+        }
+
+        uint32_t sender_ssrc;
+        memcpy(&sender_ssrc, rtcp + off + 4, 4);
+        sender_ssrc = ntohl(sender_ssrc);
+        if (out->reports++ == 0) {
+            out->sender_ssrc = sender_ssrc;
+        }
+        if (h->packet_type == RTCP_SR && ops && ops->sr) {
+            ops->sr(ctx, sender_ssrc, rtcp + off + 8);
+        }
+
+        for (int i = 0; i < rc; i++) {
+            struct rtcp_report_block *rb = (struct rtcp_report_block *)
+                (rtcp + off + first_block + i * sizeof(struct rtcp_report_block));
+            out->blocks++;
+            if (!ops || !ops->block) {
+                continue;
+            }
+
+            struct rtcp_report_block before = *rb;
+            if (!ops->block(ctx, sender_ssrc, rb)) {
+                continue;
+            }
+            out->rewritten++;
+            if (udp_csum) {
+                const uint32_t *o = (const uint32_t *)&before;
+                const uint32_t *n = (const uint32_t *)rb;
+                for (unsigned w = 0; w < BLOCK_WORDS; w++) {
+                    if (o[w] != n[w]) {
+                        udp_csum_replace4(udp_csum, o[w], n[w]);
+                    }
+                }
+            }
+        }
+        off += pkt_len;
+    }
+
+    // Trailing bytes that cannot hold a header
+    if (off != len) {
+        out->malformed = 1;
+    }
+}
+
+static int remb_valid(const unsigned char *fb, int len) {
+    return len >= REMB_OFFSET + 4 && memcmp(fb + 12, "REMB", 4) == 0 &&
+           REMB_OFFSET + 4 + 4 * fb[REMB_OFFSET] <= len;
+}
+
+int64_t remb_get_bitrate(const unsigned char *fb, int len) {
+    uint32_t w;
+
+    if (!remb_valid(fb, len)) {
+        return -1;
+    }
+    memcpy(&w, fb + REMB_OFFSET, 4);
+    w = ntohl(w);
+    int exp = (w >> 18) & 0x3F;
+    uint64_t mantissa = w & 0x3FFFF;
+    if (exp > 63 - 18) {
+        return INT64_MAX;
+    }
+    return (int64_t)(mantissa << exp);
+}
+
+int remb_set_bitrate(unsigned char *fb, int len, uint64_t bitrate, uint16_t *udp_csum) {
+    uint32_t old_word, new_word;
+    int exp = 0;
+
+    if (!remb_valid(fb, len)) {
+        return -1;
+    }
+    // Smallest exponent that fits the 18-bit mantissa
+    while ((bitrate >> exp) > 0x3FFFF) {
+        exp++;
+    }
+    memcpy(&old_word, fb + REMB_OFFSET, 4);
+    new_word = htonl((ntohl(old_word) & 0xFF000000) | ((uint32_t)exp << 18) |
+                     (uint32_t)(bitrate >> exp));
+    if (new_word == old_word) {
+        return 0;
+    }
+    memcpy(fb + REMB_OFFSET, &new_word, 4);
+    if (udp_csum) {
+        udp_csum_replace4(udp_csum, old_word, new_word);
+    }
+    return 1;
+}
+
+// Packet status chunk: run length (T=0) or status vector of 14 one-bit or
+// 7 two-bit symbols (T=1, S=0/1)
+static int chunk_symbols(uint16_t c) {
+    if (!(c & 0x8000)) {
+        return c & 0x1FFF;
+    }
+    return (c & 0x4000) ? 7 : 14;
+}
+
+static int chunk_symbol(uint16_t c, int i) {
+    if (!(c & 0x8000)) {
+        return (c >> 13) & 3;
+    }
+    if (c & 0x4000) {
+        return (c >> (12 - 2 * i)) & 3;
+    }
+    return (c >> (13 - i)) & 1;
+}
+
+// Replace one byte, folding the 16-bit word it sits in into the checksum.
+// fb starts on a 32-bit boundary of the UDP payload, so even offsets in fb
+// are even offsets in the datagram.
+static void patch_byte(unsigned char *fb, int off, uint8_t v, uint16_t *udp_csum) {
+    uint16_t before, after;
+    unsigned char *w = fb + (off & ~1);
+
+    if (fb[off] == v) {
+        return;
+    }
+    memcpy(&before, w, 2);
+    fb[off] = v;
+    memcpy(&after, w, 2);
+    if (udp_csum) {
+        udp_csum_replace2(udp_csum, before, after);
+    }
+}
+
+static int32_t adjust_delta(int32_t d, twcc_op_t op, int32_t value, int32_t lo, int32_t hi) {
+    int64_t r = op == TWCC_SCALE ? (int64_t)d * value / 100 : (int64_t)d + value;
+    return r < lo ? lo : r > hi ? hi : (int32_t)r;
+}
+
+int twcc_adjust_deltas(unsigned char *fb, int len, twcc_op_t op, int32_t value,
+                       uint16_t *udp_csum) {
+    if (len < TWCC_CHUNKS_OFFSET) {
+        return -1;
+    }
+    // Padding at the end of the message is not part of the deltas
+    if (fb[0] & 0x20) {
+        len -= fb[len - 1];
+    }
+    int status_count = (fb[14] << 8) | fb[15];
+
+    // First pass: the receive deltas start after the last chunk
+    int off = TWCC_CHUNKS_OFFSET, left = status_count;
+    while (left > 0) {
+        if (off + 2 > len) {
+            return -1;
+        }
+        int n = chunk_symbols((fb[off] << 8) | fb[off + 1]);
+        if (n == 0) {
+            return -1;
+        }
+        left -= n < left ? n : left;
+        off += 2;
+    }
+
+    // Second pass: walk the symbols again, stepping over the deltas
+    int delta = off, changed = 0;
+    left = status_count;
+    for (off = TWCC_CHUNKS_OFFSET; left > 0; off += 2) {
+        uint16_t c = (fb[off] << 8) | fb[off + 1];
+        int n = chunk_symbols(c);
+        if (n > left) {
+            n = left;
+        }
+        left -= n;
+        for (int i = 0; i < n; i++) {
+            int sym = chunk_symbol(c, i);
+            if (sym == 0) {
+                continue;                       // not received, no delta
+            }
+            if (sym == 3) {
+                return -1;                      // reserved
+            }
+            if (sym == 1) {
+                if (delta + 1 > len) {
+                    return -1;
+                }
+                int32_t d = adjust_delta(fb[delta], op, value, 0, 255);
+                if (d != fb[delta]) {
+                    patch_byte(fb, delta, (uint8_t)d, udp_csum);
+                    changed++;
+                }
+                delta += 1;
+            } else {
+                if (delta + 2 > len) {
+                    return -1;
+                }
+                int32_t old_d = (int16_t)((fb[delta] << 8) | fb[delta + 1]);
+                int32_t d = adjust_delta(old_d, op, value, INT16_MIN, INT16_MAX);
+                if (d != old_d) {
+                    patch_byte(fb, delta, (uint8_t)((uint16_t)d >> 8), udp_csum);
+                    patch_byte(fb, delta + 1, (uint8_t)d, udp_csum);
+                    changed++;
+                }
+                delta += 2;
+            }
+        }
+    }
+    return changed;
+}
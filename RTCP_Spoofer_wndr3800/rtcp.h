@@ -0,0 +1,106 @@
+/* rtcp.h
+   Zero-copy walker over compound RTCP packets (RFC 3550 section 6.1).
+
+   rtcp_walk() steps through every sub-packet by its length field, checking
+   each against the bytes actually present, and hands every SR/RR report
+   block, REMB and transport-wide CC message to a callback that may edit it
+   in place. Changed words are folded into the UDP checksum incrementally,
+   so one pass over the headers does parsing, rewriting and checksum fix-up
+   without copying or allocating.
+*/
+
+#ifndef RTCP_H
+#define RTCP_H
+
+#include <stdint.h>
+
+#define RTCP_SR    200
+#define RTCP_RR    201
+#define RTCP_SDES  202
+#define RTCP_BYE   203
+#define RTCP_APP   204
+#define RTCP_RTPFB 205
+#define RTCP_PSFB  206
+
+// Common header of every RTCP sub-packet
+struct rtcp_header {
+    uint8_t version_p_count;    // Version (2 bits) | P | RC/FMT (5 bits)
+    uint8_t packet_type;
+    uint16_t length;            // Length in 32-bit words - 1
+};
+
+// One SR/RR report block; all fields in network byte order
+struct rtcp_report_block {
+    uint32_t ssrc;              // SSRC of the source being reported
+    uint32_t fraction_lost;     // Fraction lost (8 bits) + Cumulative packets lost (24 bits)
+    uint32_t extended_high_seq; // Extended highest sequence number received
+    uint32_t jitter;            // Interarrival jitter
+    uint32_t lsr;               // Last SR timestamp
+    uint32_t dlsr;              // Delay since last SR
+};
+
+#define RTCP_SR_BLOCKS_OFFSET 28    // header + sender SSRC + 20-byte sender info
+#define RTCP_RR_BLOCKS_OFFSET 8     // header + sender SSRC
+
+// Feedback messages (FMT 15 of RTPFB / PSFB) understood by the walker
+#define RTCP_FB_TWCC 1              // transport-wide CC (draft-holmer-rmcat-transport-wide-cc-extensions)
+#define RTCP_FB_REMB 2              // receiver estimated max bitrate (draft-alvestrand-rmcat-remb)
+
+// Called for each report block; sender_ssrc is in host order. The block
+// may be modified in place; return 1 if it was.
+typedef int (*rtcp_block_fn)(void *ctx, uint32_t sender_ssrc, struct rtcp_report_block *rb);
+
+// Called for each REMB / TWCC message (the whole sub-packet, header
+// included). It may edit it in place, patching udp_csum (which may be NULL)
+// itself; return 1 if it changed anything, -1 if the message is malformed.
+typedef int (*rtcp_fb_fn)(void *ctx, int type, unsigned char *fb, int len, uint16_t *udp_csum);
+
+// Called for each SR with its 20-byte sender info (NTP timestamp, RTP
+// timestamp, packet and octet counts; network byte order), before its
+// report blocks
+typedef void (*rtcp_sr_fn)(void *ctx, uint32_t sender_ssrc, const unsigned char *info);
+
+struct rtcp_handlers {
+    rtcp_block_fn block;        // may be NULL
+    rtcp_fb_fn feedback;        // may be NULL
+    rtcp_sr_fn sr;              // may be NULL
+};
+
+struct rtcp_walk {
+    int packets;                // sub-packets walked
+    int reports;                // SR/RR sub-packets
+    int blocks;                 // report blocks seen
+    int rewritten;              // blocks the callback changed
+    int remb;                   // REMB messages seen
+    int twcc;                   // transport-wide CC messages seen
+    int fb_rewritten;           // feedback messages the callback changed
+    uint32_t sender_ssrc;       // of the first SR/RR, host order
+    int malformed;              // walk stopped at an inconsistent header
+};
+
+// Walk the compound packet in rtcp[0..len). ops may be NULL (read-only walk);
+// udp_csum may be NULL (no checksum to maintain). Blocks before a malformed
+// sub-packet keep their edits, with the checksum still consistent.
+void rtcp_walk(unsigned char *rtcp, int len, const struct rtcp_handlers *ops, void *ctx,
+               uint16_t *udp_csum, struct rtcp_walk *out);
+
+// REMB bitrate in bits/s (mantissa << exponent), -1 if malformed
+int64_t remb_get_bitrate(const unsigned char *fb, int len);
+
+// Re-encode the REMB bitrate in place. Returns 1 if the word changed.
+int remb_set_bitrate(unsigned char *fb, int len, uint64_t bitrate, uint16_t *udp_csum);
+
+// How twcc_adjust_deltas changes each receive delta (250 us ticks)
+typedef enum {
+    TWCC_SCALE = 0,             // delta * value / 100
+    TWCC_ADD                    // delta + value (may be negative)
+} twcc_op_t;
+
+// Adjust every receive delta of a TWCC message in place. Deltas keep their
+// encoded size (1 byte unsigned or 2 bytes signed), so results are clamped
+// to what the packet status chunks already allow. Returns the number of
+// deltas changed, -1 if the message is malformed.
+int twcc_adjust_deltas(unsigned char *fb, int len, twcc_op_t op, int32_t value,
+                       uint16_t *udp_csum);
+
+#endif
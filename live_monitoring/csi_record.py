@@ -0,0 +1,291 @@
+#!/usr/bin/env python3
+# csi_record.py
+# Session files of the columnar recorder (layout in
+# CSI_Monitor_rt-ac86u/src/csi_rec.h): Recorder appends through
+# libcsi_rec.so, Reader maps a file and returns time ranges as NumPy arrays.
+#
+#   rec = Recorder("session.csr")
+#   rec.append(FEATURES, t_us=t, core=c, ampl_mean=a, ...)   # arrays (or scalars)
+#   rec.append_row(QUEUE, t_us=t, backlog=b, ...)            # one row, cheaper
+#   rec.close()
+#
+#   r = Reader("session.csr")
+#   q = r.read(QUEUE, t0_us, t1_us)          # dict of column arrays
+#   f = r.read(FRAMES)                       # f["csi"]: n x 64 complex64
+#
+# Only the chunks whose time span overlaps the range are touched. A file
+# whose writer did not close it (still recording, or crashed) has no index;
+# Reader then walks the chunk headers, skipping the column data.
+#
+# Run directly for a summary, or to export a table as CSV:
+#   csi_record.py file [table [t0_us t1_us]]
+
+import ctypes
+import mmap
+import os
+import struct
+import sys
+import threading
+
+import numpy as np
+
+FRAMES, VARIANCE, QUEUE, FEATURES, DELAYS = range(5)
+TABLE_NAMES = ("frames", "variance", "queue", "features", "delays")
+
+VERSION = 1
+NFFT = 64
+
+# Columns of each table, in file order; shape is per row
+COLUMNS = {
+    FRAMES: [("t_us", np.uint64, ()), ("ts_us", np.uint64, ()), ("seq", np.uint16, ()),
+             ("core", np.uint8, ()), ("stream", np.uint8, ()), ("csi", np.complex64, (NFFT,))],
+    VARIANCE: [("t_us", np.uint64, ()), ("seq", np.uint16, ()), ("core", np.uint8, ()),
+               ("n", np.uint16, ()), ("ampl_var", np.float32, ()), ("phase_var", np.float32, ())],
+    QUEUE: [("t_us", np.uint64, ()), ("ts_us", np.uint64, ()), ("backlog", np.uint32, ()),
+            ("qlen", np.uint32, ()), ("drops", np.uint32, ()), ("rssi", np.int16, ()),
+            ("noise", np.int16, ()), ("snr", np.float32, ())],
+    FEATURES: [("t_us", np.uint64, ()), ("core", np.uint8, ()), ("ampl_mean", np.float32, ()),
+               ("phase_std", np.float32, ()), ("ampl_ma", np.float32, ()),
+               ("phase_ma", np.float32, ()), ("phase_deriv", np.float32, ()),
+               ("iat_ms", np.float32, ())],
+    DELAYS: [("t_us", np.uint64, ()), ("source", np.uint8, ()), ("delay_ms", np.float32, ())],
+}
+
+FILE_HEADER = np.dtype([("magic", "<u4"), ("version", "<u4"), ("created_us", "<u8"),
+                        ("tables", "<u4"), ("reserved", "<u4"), ("reserved2", "<u8")])
+CHUNK = np.dtype([("magic", "<u4"), ("table", "<u2"), ("n_cols", "<u2"), ("rows", "<u4"),
+                  ("reserved", "<u4"), ("t_first_us", "<u8"), ("t_last_us", "<u8"),
+                  ("bytes", "<u8")])
+INDEX = np.dtype([("table", "<u2"), ("reserved", "<u2"), ("rows", "<u4"),
+                  ("t_first_us", "<u8"), ("t_last_us", "<u8"), ("offset", "<u8")])
+TRAILER = np.dtype([("magic", "<u4"), ("chunks", "<u4"), ("index_offset", "<u8")])
+
+# One row packed column after column, for single-row appends; csi goes last
+ROW_FORMAT = {np.uint64: "Q", np.uint32: "I", np.uint16: "H", np.int16: "h", np.uint8: "B",
+              np.float32: "f"}
+
+MAGIC_FILE = 0x46525343     # "CSRF"
+MAGIC_CHUNK = 0x4B4E4843    # "CHNK"
+MAGIC_INDEX = 0x58444943    # "CIDX"
+
+LIB_PATH = os.path.join(os.path.dirname(os.path.abspath(__file__)),
+                        "..", "CSI_Monitor_rt-ac86u", "libcsi_rec.so")
+
+
+class Recorder:
+    """Appends rows through libcsi_rec.so (build it with ringd.sh). Safe to
+    share between the monitor's receiver threads."""
+
+    def __init__(self, path, lib_path=LIB_PATH):
+        lib = ctypes.CDLL(os.environ.get("CSI_REC_LIB", lib_path))
+        lib.csi_rec_open.restype = ctypes.c_void_p
+        lib.csi_rec_open.argtypes = [ctypes.c_char_p]
+        lib.csi_rec_append.restype = ctypes.c_int
+        lib.csi_rec_append.argtypes = [ctypes.c_void_p, ctypes.c_int, ctypes.c_size_t,
+                                       ctypes.POINTER(ctypes.c_void_p)]
+        lib.csi_rec_flush.argtypes = [ctypes.c_void_p]
+        lib.csi_rec_close.argtypes = [ctypes.c_void_p]
+        self.lib = lib
+        self.path = path
+        self.handle = lib.csi_rec_open(path.encode())
+        if not self.handle:
+            raise OSError(f"{path}: cannot create session file")
+        self.lock = threading.Lock()
+        self.failed = False
+
+        # Packing and column offsets of a single row, per table
+        self.rows = {}
+        for table, columns in COLUMNS.items():
+            scalars = [(name, dtype) for name, dtype, shape in columns if not shape]
+            packer = struct.Struct("=" + "".join(ROW_FORMAT[d] for _, d in scalars))
+            offsets, off = [], 0
+            for name, dtype, shape in columns:
+                offsets.append(off if shape == () else packer.size)
+                if shape == ():
+                    off += np.dtype(dtype).itemsize
+            self.rows[table] = ([name for name, _ in scalars], packer, offsets,
+                                [name for name, _, shape in columns if shape])
+
+    def append_row(self, table, **cols):
+        """One row of scalars (csi as 64 complex values): the per-frame path,
+        without a NumPy array per column."""
+        names, packer, offsets, vectors = self.rows[table]
+        data = packer.pack(*[cols[name] for name in names])
+        for name in vectors:
+            data += np.asarray(cols[name], dtype=np.complex64).tobytes()
+        buf = ctypes.create_string_buffer(data, len(data))
+        base = ctypes.addressof(buf)
+        ptrs = (ctypes.c_void_p * len(offsets))(*[base + off for off in offsets])
+        with self.lock:
+            if self.handle and self.lib.csi_rec_append(self.handle, table, 1, ptrs) < 0:
+                self.failed = True
+
+    def append(self, table, **cols):
+        """One row (scalars) or a batch (equal-length arrays) of a table; every
+        column must be given."""
+        arrays = []
+        n = None
+        for name, dtype, shape in COLUMNS[table]:
+            a = np.ascontiguousarray(cols[name], dtype=dtype)
+            if a.ndim == len(shape):
+                a = a.reshape((1,) + shape)
+            if n is None:
+                n = len(a)
+            elif len(a) != n:
+                raise ValueError(f"{TABLE_NAMES[table]}.{name}: {len(a)} rows, expected {n}")
+            arrays.append(a)
+        ptrs = (ctypes.c_void_p * len(arrays))(*[a.ctypes.data for a in arrays])
+        with self.lock:
+            if self.handle and self.lib.csi_rec_append(self.handle, table, n, ptrs) < 0:
+                self.failed = True
+
+    def flush(self):
+        with self.lock:
+            if self.handle:
+                self.lib.csi_rec_flush(self.handle)
+
+    def close(self):
+        with self.lock:
+            if self.handle:
+                if self.lib.csi_rec_close(self.handle) < 0:
+                    self.failed = True
+                self.handle = None
+
+
+class Reader:
+    def __init__(self, path):
+        self.path = path
+        with open(path, "rb") as f:
+            self.mm = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+        hdr = np.frombuffer(self.mm, FILE_HEADER, count=1)[0]
+        if hdr["magic"] != MAGIC_FILE or hdr["version"] != VERSION:
+            raise ValueError(f"{path}: not a version {VERSION} session file")
+        self.created_us = int(hdr["created_us"])
+        self.index = self._read_index()
+        if self.index is None:
+            self.complete = False
+            self.index = self._walk_chunks()
+        else:
+            self.complete = True
+
+    def _read_index(self):
+        size = len(self.mm)
+        if size < FILE_HEADER.itemsize + TRAILER.itemsize:
+            return None
+        tr = np.frombuffer(self.mm, TRAILER, count=1, offset=size - TRAILER.itemsize)[0]
+        off, n = int(tr["index_offset"]), int(tr["chunks"])
+        if tr["magic"] != MAGIC_INDEX or off + n * INDEX.itemsize != size - TRAILER.itemsize:
+            return None
+        return np.frombuffer(self.mm, INDEX, count=n, offset=off)
+
+    def _walk_chunks(self):
+        size = len(self.mm)
+        entries = []
+        off = FILE_HEADER.itemsize
+        while off + CHUNK.itemsize <= size:
+            h = np.frombuffer(self.mm, CHUNK, count=1, offset=off)[0]
+            end = off + CHUNK.itemsize + int(h["bytes"])
+            if h["magic"] != MAGIC_CHUNK or end > size:
+                break           # the chunk being written when the file was cut
+            entries.append((h["table"], 0, h["rows"], h["t_first_us"], h["t_last_us"], off))
+            off = end
+        return np.array(entries, dtype=INDEX)
+
+    def chunks(self, table, t0_us=None, t1_us=None):
+        """Index entries of table overlapping [t0_us, t1_us)."""
+        sel = self.index["table"] == table
+        if t0_us is not None:
+            sel &= self.index["t_last_us"] >= t0_us
+        if t1_us is not None:
+            sel &= self.index["t_first_us"] < t1_us
+        return self.index[sel]
+
+    def _columns(self, table, entry):
+        # Views of one chunk's columns
+        rows = int(entry["rows"])
+        off = int(entry["offset"]) + CHUNK.itemsize
+        out = {}
+        for name, dtype, shape in COLUMNS[table]:
+            count = rows * int(np.prod(shape, dtype=np.int64))
+            v = np.frombuffer(self.mm, dtype, count=count, offset=off)
+            out[name] = v.reshape((rows,) + shape)
+            off += (v.nbytes + 7) & ~7
+        return out
+
+    def read(self, table, t0_us=None, t1_us=None):
+        """Rows of table with t0_us <= t_us < t1_us (either bound optional), in
+        file order, as a dict of column arrays."""
+        parts = []
+        for entry in self.chunks(table, t0_us, t1_us):
+            cols = self._columns(table, entry)
+            inside = (t0_us is None or entry["t_first_us"] >= t0_us) and \
+                     (t1_us is None or entry["t_last_us"] < t1_us)
+            if not inside:
+                t = cols["t_us"]
+                sel = np.ones(len(t), dtype=bool)
+                if t0_us is not None:
+                    sel &= t >= t0_us
+                if t1_us is not None:
+                    sel &= t < t1_us
+                cols = {k: v[sel] for k, v in cols.items()}
+            parts.append(cols)
+        if not parts:
+            return {name: np.empty((0,) + shape, dtype) for name, dtype, shape in COLUMNS[table]}
+        return {name: np.concatenate([p[name] for p in parts]) for name, _, _ in COLUMNS[table]}
+
+    def close(self):
+        self.mm.close()
+
+
+def ampl_phase(csi):
+    """Per-subcarrier amplitude and detrended phase of n x 64 recorded CSI,
+    computed as monitor_all_rx does (the old CSV's ampl_sc / phase_sc)."""
+    csi = np.fft.fftshift(csi.astype(np.complex128), axes=1)
+    mags = np.abs(csi)
+    phase = np.unwrap(np.angle(csi), axis=1)
+    k = np.arange(csi.shape[1])
+    coeffs = np.polyfit(k, phase.T, 1) if len(phase) else np.zeros((2, 0))
+    return mags, phase - (np.outer(coeffs[0], k) + coeffs[1][:, None])
+
+
+def main():
+    if len(sys.argv) < 2:
+        print("Usage: csi_record.py file [table [t0_us t1_us]]")
+        return 1
+    r = Reader(sys.argv[1])
+    if len(sys.argv) == 2:
+        state = "closed" if r.complete else "no index (still recording, or cut short)"
+        print(f"{r.path}: {len(r.index)} chunks, {state}")
+        for table, name in enumerate(TABLE_NAMES):
+            c = r.chunks(table)
+            if len(c):
+                span = (int(c["t_last_us"].max()) - int(c["t_first_us"].min())) / 1e6
+                print(f"  {name:9s} {int(c['rows'].sum()):10d} rows in {len(c):5d} chunks, "
+                      f"{int(c['t_first_us'].min())}..{int(c['t_last_us'].max())} ({span:.1f} s)")
+        return 0
+
+    table = TABLE_NAMES.index(sys.argv[2])
+    t0 = int(sys.argv[3]) if len(sys.argv) > 3 else None
+    t1 = int(sys.argv[4]) if len(sys.argv) > 4 else None
+    cols = r.read(table, t0, t1)
+    names = []
+    for name, _, shape in COLUMNS[table]:
+        if name == "csi":
+            names += [f"{p}{i}" for i in range(NFFT) for p in ("re", "im")]
+        else:
+            names.append(name)
+    print(",".join(names))
+    for i in range(len(cols["t_us"])):
+        row = []
+        for name, _, _ in COLUMNS[table]:
+            v = cols[name][i]
+            if name == "csi":
+                row += [f"{x:g}" for x in v.view(np.float32)]
+            else:
+                row.append(str(v))
+        print(",".join(row))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,165 @@
+#!/usr/bin/env python3
+# csi_ring.py
+# Reads the shared-memory ring csi_ringd writes (layout in
+# CSI_Monitor_rt-ac86u/src/csi_ring.h) as NumPy views: no parsing, no copies.
+#
+#   ring = CsiRing("csi_ring")
+#   b = ring.read(FRAMES)            # None if nothing new
+#   if b is not None:
+#       mags = np.abs(b.csi)         # n x 64 complex64, fields b.core, b.rx_us, ...
+#       ok = ring.intact(b)          # rows the writer did not overwrite meanwhile
+#
+# A batch never wraps around the end of the ring; the next read returns the
+# rest. The seqlock check relies on loads not being reordered with each
+# other, which holds on x86-64 hosts.
+#
+# Run directly to print the rate of each ring: csi_ring.py [name]
+
+import mmap
+import os
+import sys
+import time
+
+import numpy as np
+
+FRAMES, VAR, QUEUE = 0, 1, 2
+KIND_NAMES = ("frames", "variance", "queue")
+
+MAGIC = 0x52495343
+VERSION = 1
+NFFT = 64
+MAX_FIELDS = 10
+
+# Field arrays of each ring, in header order
+FIELDS = {
+    FRAMES: [("lock", np.uint32), ("rx_us", np.uint64), ("ts_us", np.uint64),
+             ("seq", np.uint16), ("core", np.uint8), ("stream", np.uint8),
+             ("csi", np.complex64)],
+    VAR: [("lock", np.uint32), ("rx_us", np.uint64), ("seq", np.uint16),
+          ("core", np.uint8), ("n", np.uint16), ("ampl_var", np.float32),
+          ("phase_var", np.float32)],
+    QUEUE: [("lock", np.uint32), ("rx_us", np.uint64), ("ts_us", np.uint64),
+            ("backlog", np.uint32), ("qlen", np.uint32), ("drops", np.uint32),
+            ("rssi", np.int16), ("noise", np.int16), ("radio", np.uint8)],
+}
+
+HEADER = np.dtype([
+    ("magic", np.uint32), ("version", np.uint32), ("nfft", np.uint32),
+    ("writer_pid", np.uint32), ("size", np.uint64), ("started_us", np.uint64),
+    ("ring", [("head", np.uint64), ("cap", np.uint32), ("n_fields", np.uint32),
+              ("off", np.uint64, (MAX_FIELDS,))], (3,)),
+])
+
+REOPEN_CHECK_S = 1.0
+
+
+class Batch:
+    """Consecutive records of one ring: one view per field, plus valid (the
+    rows that were complete when read) and first (record number of row 0)."""
+
+    def __init__(self, first, views, expected, valid):
+        self.__dict__.update(views)
+        self.first = first
+        self.expected = expected
+        self.valid = valid
+
+    def __len__(self):
+        return len(self.valid)
+
+
+class CsiRing:
+    def __init__(self, name="csi_ring", from_start=False):
+        self.path = "/dev/shm/" + name.lstrip("/")
+        self.from_start = from_start
+        self.lost = [0, 0, 0]           # records overwritten before they were read
+        self.mm = None
+        self._open()
+
+    def _open(self):
+        with open(self.path, "rb") as f:
+            mm = mmap.mmap(f.fileno(), 0, access=mmap.ACCESS_READ)
+            self.ino = os.fstat(f.fileno()).st_ino
+        hdr = np.frombuffer(mm, HEADER, count=1)
+        if hdr["magic"][0] != MAGIC or hdr["version"][0] != VERSION or hdr["nfft"][0] != NFFT:
+            raise ValueError(f"{self.path}: not a version {VERSION} CSI ring")
+
+        self.mm = mm
+        self.hdr = hdr[0]
+        self.heads = hdr["ring"]["head"][0]     # live view of the write counters
+        self.cap = [int(c) for c in hdr["ring"]["cap"][0]]
+        self.views = []
+        for kind, fields in FIELDS.items():
+            cap = self.cap[kind]
+            views = {}
+            for i, (name, dtype) in enumerate(fields):
+                off = int(hdr["ring"]["off"][0][kind][i])
+                count = cap * NFFT if name == "csi" else cap
+                v = np.frombuffer(mm, dtype, count=count, offset=off)
+                views[name] = v.reshape(cap, NFFT) if name == "csi" else v
+            self.views.append(views)
+        self.tail = [0 if self.from_start else int(h) for h in self.heads]
+        self.next_check = time.monotonic() + REOPEN_CHECK_S
+
+    def _check_reopen(self):
+        # csi_ringd creates a new segment when it restarts
+        now = time.monotonic()
+        if now < self.next_check:
+            return
+        self.next_check = now + REOPEN_CHECK_S
+        try:
+            if os.stat(self.path).st_ino != self.ino:
+                self.from_start = True
+                self._open()
+        except (OSError, ValueError):
+            pass
+
+    def read(self, kind, max_records=None):
+        """Records written since the last read of this ring, as a Batch of
+        views into the segment, or None."""
+        self._check_reopen()
+        cap = self.cap[kind]
+        head = int(self.heads[kind])
+        tail = self.tail[kind]
+        # The slot at head may be in the middle of being rewritten
+        if head - tail >= cap:
+            self.lost[kind] += head - cap + 1 - tail
+            tail = head - cap + 1
+        start = tail % cap
+        n = min(head - tail, cap - start)
+        if max_records is not None:
+            n = min(n, max_records)
+        if n <= 0:
+            return None
+        self.tail[kind] = tail + n
+
+        views = {name: v[start:start + n] for name, v in self.views[kind].items()}
+        expected = ((2 * np.arange(tail, tail + n, dtype=np.uint64) + 2)
+                    & 0xFFFFFFFF).astype(np.uint32)
+        return Batch(tail, views, expected, views["lock"] == expected)
+
+    def intact(self, batch):
+        """Rows of batch that were complete when read and still are."""
+        return batch.valid & (batch.lock == batch.expected)
+
+
+def main():
+    ring = CsiRing(sys.argv[1] if len(sys.argv) > 1 else "csi_ring")
+    print(f"{ring.path}: {ring.cap[FRAMES]} records per ring, writer pid {ring.hdr['writer_pid']}")
+    counts = [0, 0, 0]
+    t0 = time.monotonic()
+    while True:
+        for kind in (FRAMES, VAR, QUEUE):
+            b = ring.read(kind)
+            while b is not None:
+                counts[kind] += int(np.count_nonzero(ring.intact(b)))
+                b = ring.read(kind)
+        time.sleep(0.01)
+        if time.monotonic() - t0 >= 1.0:
+            print(", ".join(f"{counts[k]} {KIND_NAMES[k]}/s" for k in range(3)) +
+                  f" ({sum(ring.lost)} lost)")
+            counts = [0, 0, 0]
+            t0 = time.monotonic()
+
+
+if __name__ == "__main__":
+    main()
@@ -6,6 +6,14 @@ import collections
 import threading
 import queue
 
+# --- Recording ---
+# Session file for the frame delays (csi_record.py, "delays" table), or None
+RECORD_PATH = None
+recorder = None
+if RECORD_PATH:
+    from csi_record import Recorder, DELAYS
+    recorder = Recorder(RECORD_PATH)
+
 # --- Frame tracking ---
 last_rtp_ts = {}
 last_frame_time = {}
@@ -60,6 +68,8 @@ def packet_handler(pkt):
                     if ssrc in last_frame_time:
                         delta = (now - last_frame_time[ssrc]) * 1000  # ms
                         frame_queue.put((now, delta))
+                        if recorder:
+                            recorder.append(DELAYS, t_us=int(now * 1e6), source=0, delay_ms=delta)
                         print(f"SSRC={ssrc} TS={ts}, Frame duration={delta:.3f} ms")
                     else:
                         print(f"SSRC={ssrc} TS={ts}, first frame")
@@ -108,3 +118,5 @@ sniffer_thread = threading.Thread(
 sniffer_thread.start()
 
 plt.show()
+if recorder:
+    recorder.close()
@@ -103,6 +103,12 @@ def csi_receiver():
                 parts = s.strip().split(',')
                 if len(parts) < 3 + 2 * N_SUB:
                     continue
+                # CSI lines start with the sequence number; "M,", "V," and
+                # "Q," records are not CSI
+                try:
+                    int(parts[0])
+                except ValueError:
+                    continue
 
                 reals = np.array([float(parts[3 + 2*i]) for i in range(N_SUB)])
                 imags = np.array([float(parts[4 + 2*i]) for i in range(N_SUB)])
@@ -13,14 +13,25 @@ from matplotlib import gridspec
 # ===== Settings =====
 CSI_PORT = 12346
 QUEUE_PORT = 12345
+# "SOCKET": parse csi_analyzer's CSV here. "RING": read the shared-memory ring
+# csi_ringd fills on this host (CSI_Monitor_rt-ac86u/ringd.sh), in batches
+CSI_SOURCE = "SOCKET"
+RING_NAME = "csi_ring"
+LEGACY_QUEUE_FEED = False  # queue/SNR now arrive as "Q," lines in the CSI stream (csi_analyzer -q)
 MA_WINDOW = 10
 CORR_SCALE = 1000  
 # PLOT_MODE can be "ALL", "TOPTWO", or any other string (defaulting to Variance only)
 PLOT_MODE = "ALL" 
-VARIANCE_WINDOW = 10
+VARIANCE_WINDOW = 10  # set on the router: csi_analyzer -w 10
 PLOT_TIME_WINDOW = 10.0 # Time window for history plots (in seconds)
+# "RECORD": raw frames, features and queue samples in a columnar session file
+# (csi_record.py, needs libcsi_rec.so from ringd.sh). "CSV": one text row each
+LOG_FORMAT = "RECORD"
 
-log_filename = f"monitoring_log_{datetime.now().strftime('%Y%m%d_%H%M%S')}.csv"
+log_stamp = datetime.now().strftime('%Y%m%d_%H%M%S')
+log_filename = f"monitoring_log_{log_stamp}.csv"
+record_filename = f"monitoring_log_{log_stamp}.csr"
+recorder = None
 
 # ===== Shared data & History =====
 ampl_data = collections.deque(maxlen=2000)
@@ -31,17 +42,34 @@ phase_deriv_data = collections.deque(maxlen=2000)
 snr_data = collections.deque(maxlen=2000)
 backlog_data = collections.deque(maxlen=2000)
 
-# Variance tracking for Core 0 and Core 1
-core0_ampl_history = collections.deque(maxlen=VARIANCE_WINDOW)
-core0_phase_history = collections.deque(maxlen=VARIANCE_WINDOW)
-core1_ampl_history = collections.deque(maxlen=VARIANCE_WINDOW)
-core1_phase_history = collections.deque(maxlen=VARIANCE_WINDOW)
+
+class RouterClock:
+    """Maps a Q line's ts_us (the router's CLOCK_MONOTONIC) onto host time,
+    so queue samples plot where the router took them rather than where the
+    stream delivered them. The smallest host-minus-router difference seen
+    is the least delayed sample; a jump past RESYNC_S (router restart,
+    drift) starts over."""
+    RESYNC_S = 1.0
+
+    def __init__(self):
+        self.offset = None
+
+    def host_time(self, ts_us, now):
+        off = now - ts_us / 1e6
+        if self.offset is None or off < self.offset or off - self.offset > self.RESYNC_S:
+            self.offset = off
+        return ts_us / 1e6 + self.offset
+
+
+queue_clock = RouterClock()
+
+# Sliding-window variance per core, computed by csi_analyzer ("V," lines)
+core_ampl_var = [collections.deque(maxlen=2000) for _ in range(4)]
+core_phase_var = [collections.deque(maxlen=2000) for _ in range(4)]
 
 # Variance data for plotting
-core0_ampl_var = collections.deque(maxlen=2000)
-core0_phase_var = collections.deque(maxlen=2000)
-core1_ampl_var = collections.deque(maxlen=2000)
-core1_phase_var = collections.deque(maxlen=2000)
+core0_ampl_var, core1_ampl_var = core_ampl_var[0], core_ampl_var[1]
+core0_phase_var, core1_phase_var = core_phase_var[0], core_phase_var[1]
 
 # ===== Frame Delay Ports =====
 FRAME_DELAY_SENDER_PORT = 23456
@@ -100,7 +128,16 @@ def log_data(source, amplitude="", phase_std="", amp_ma="", phase_ma="",
             row += [""] * N_SUB
         writer.writerow(row)
 
-init_log_file()
+if LOG_FORMAT == "RECORD":
+    try:
+        from csi_record import Recorder, FRAMES as REC_FRAMES, VARIANCE as REC_VARIANCE, \
+            QUEUE as REC_QUEUE, FEATURES as REC_FEATURES
+        recorder = Recorder(record_filename)
+        print(f"[Log] Recording to {record_filename}")
+    except OSError as e:
+        print(f"[Log] No recorder ({e}), logging CSV to {log_filename}")
+if recorder is None:
+    init_log_file()
 
 # ===== CSI Receiver (UDP) =====
 def csi_receiver():
@@ -135,6 +172,51 @@ def csi_receiver():
             
             if not s:
                 continue
+
+            # Q,ts_us,backlog,qlen,drops,rssi,noise,snr (radio fields may be empty)
+            if s.startswith('Q,'):
+                try:
+                    qparts = s.split(',')
+                    q_ts_us = int(qparts[1])
+                    fq = int(qparts[2])
+                    qlen, drops = int(qparts[3]), int(qparts[4])
+                    rssi = int(qparts[5]) if qparts[5] else 0
+                    noise = int(qparts[6]) if qparts[6] else 0
+                    snr_val = float(qparts[7]) if qparts[7] else None
+                except (ValueError, IndexError):
+                    continue
+                q_t = queue_clock.host_time(q_ts_us, now)
+                with lock:
+                    backlog_data.append((q_t, fq))
+                    if snr_val is not None:
+                        snr_data.append((q_t, snr_val))
+                if recorder:
+                    recorder.append_row(REC_QUEUE, t_us=int(now * 1e6), ts_us=q_ts_us,
+                                        backlog=fq, qlen=qlen, drops=drops, rssi=rssi,
+                                        noise=noise,
+                                        snr=np.nan if snr_val is None else snr_val)
+                else:
+                    log_data("QUEUE", snr="" if snr_val is None else snr_val, backlog=fq)
+                continue
+
+            # V,seq,core,n,ampl_var_mean,phase_var_mean
+            if s.startswith('V,'):
+                try:
+                    _, vseq, vcore, vn, ampl_var, phase_var = s.split(',')
+                    vseq, vcore, vn = int(vseq), int(vcore), int(vn)
+                    ampl_var = float(ampl_var)
+                    phase_var = float(phase_var)
+                except ValueError:
+                    continue
+                if 0 <= vcore < N_CORES:
+                    with lock:
+                        core_ampl_var[vcore].append((now, ampl_var))
+                        core_phase_var[vcore].append((now, phase_var))
+                    if recorder:
+                        recorder.append_row(REC_VARIANCE, t_us=int(now * 1e6), seq=vseq,
+                                            core=vcore, n=vn, ampl_var=ampl_var,
+                                            phase_var=phase_var)
+                continue
             
             parts = s.split(',')
             if len(parts) < 3 + 2 * N_SUB:
@@ -143,6 +225,8 @@ def csi_receiver():
             try:
                 seq_num = int(parts[0]) 
                 rxcore = int(parts[1])
+                stream = int(parts[2])
+                ts_us = int(parts[3 + 2 * N_SUB]) if len(parts) > 3 + 2 * N_SUB else 0
             except:
                 continue
             if rxcore < 0 or rxcore >= N_CORES:
@@ -184,29 +268,6 @@ def csi_receiver():
                     if dt_phase > 0:
                         phase_deriv = (std - phase_data[-1][1]) / dt_phase
                 
-                # --- Variance calculation (for plotting) ---
-                if rxcore == 0:
-                    core0_ampl_history.append(mags.copy())
-                    core0_phase_history.append(resid.copy())
-                    if len(core0_ampl_history) >= 2:
-                        ampl_variances = np.var(np.array(core0_ampl_history), axis=0)
-                        phase_variances = np.var(np.array(core0_phase_history), axis=0)
-                        mean_ampl_var = np.mean(ampl_variances)
-                        mean_phase_var = np.mean(phase_variances)
-                        core0_ampl_var.append((now, mean_ampl_var))
-                        core0_phase_var.append((now, mean_phase_var))
-                
-                elif rxcore == 1:
-                    core1_ampl_history.append(mags.copy())
-                    core1_phase_history.append(resid.copy())
-                    if len(core1_ampl_history) >= 2:
-                        ampl_variances = np.var(np.array(core1_ampl_history), axis=0)
-                        phase_variances = np.var(np.array(core1_phase_history), axis=0)
-                        mean_ampl_var = np.mean(ampl_variances)
-                        mean_phase_var = np.mean(phase_variances)
-                        core1_ampl_var.append((now, mean_ampl_var))
-                        core1_phase_var.append((now, mean_phase_var))
-
                 # append per-core data for subplots and shared metrics
                 ampl_data.append((now, avg))
                 phase_data.append((now, std))
@@ -222,13 +283,154 @@ def csi_receiver():
                 last_phase_frame = resid.copy()
 
             # Log CSI line
-            log_data("CSI", avg, std, avg_ma, std_ma, phase_deriv,
-                        iat_ms=instant_iat_ms, ampl_sc=mags, phase_sc=resid)
+            if recorder:
+                t_us = int(now * 1e6)
+                recorder.append_row(REC_FRAMES, t_us=t_us, ts_us=ts_us, seq=seq_num,
+                                    core=rxcore, stream=stream, csi=reals + 1j * imags)
+                recorder.append_row(REC_FEATURES, t_us=t_us, core=rxcore, ampl_mean=avg,
+                                    phase_std=std, ampl_ma=avg_ma, phase_ma=std_ma,
+                                    phase_deriv=phase_deriv, iat_ms=instant_iat_ms)
+            else:
+                log_data("CSI", avg, std, avg_ma, std_ma, phase_deriv,
+                            iat_ms=instant_iat_ms, ampl_sc=mags, phase_sc=resid)
 
         except Exception as e:
             print(f"[CSI] Error: {e}")
             break
 
+# ===== CSI Receiver (shared-memory ring) =====
+def ring_receiver():
+    global last_ampl_frame, last_phase_frame, last_recv_time
+    from csi_ring import CsiRing, FRAMES, VAR, QUEUE
+
+    while True:
+        try:
+            ring = CsiRing(RING_NAME)
+            break
+        except (OSError, ValueError) as e:
+            print(f"[CSI] Waiting for csi_ringd ({e})")
+            time.sleep(1)
+    print(f"[CSI] Reading {ring.path}")
+
+    moving_amp = collections.deque(maxlen=MA_WINDOW)
+    moving_phase = collections.deque(maxlen=MA_WINDOW)
+    k = np.arange(N_SUB)
+
+    while True:
+        idle = True
+
+        b = ring.read(QUEUE)
+        if b is not None:
+            idle = False
+            rx_us, ts_us = b.rx_us.copy(), b.ts_us.copy()
+            backlog = b.backlog.astype(int)
+            qlen, drops = b.qlen.copy(), b.drops.copy()
+            rssi, noise = b.rssi.copy(), b.noise.copy()
+            radio = b.radio != 0
+            snr = (rssi.astype(int) - noise.astype(int)).astype(float)
+            # Checked after reading: rows the writer lapped meanwhile are dropped
+            keep = ring.intact(b)
+            rx_us, ts_us = rx_us[keep], ts_us[keep]
+            backlog, radio, snr = backlog[keep], radio[keep], snr[keep]
+            if recorder:
+                recorder.append(REC_QUEUE, t_us=rx_us, ts_us=ts_us, backlog=backlog,
+                                qlen=qlen[keep], drops=drops[keep], rssi=rssi[keep],
+                                noise=noise[keep], snr=np.where(radio, snr, np.nan))
+            rx, ts = (rx_us / 1e6).tolist(), ts_us.tolist()
+            backlog, radio, snr = backlog.tolist(), radio.tolist(), snr.tolist()
+            q_t = [queue_clock.host_time(ts[i], rx[i]) for i in range(len(rx))]
+            with lock:
+                for i in range(len(rx)):
+                    backlog_data.append((q_t[i], backlog[i]))
+                    if radio[i]:
+                        snr_data.append((q_t[i], snr[i]))
+            if not recorder:
+                for i in range(len(rx)):
+                    log_data("QUEUE", snr=snr[i] if radio[i] else "", backlog=backlog[i])
+
+        b = ring.read(VAR)
+        if b is not None:
+            idle = False
+            rx_us = b.rx_us.copy()
+            seqs, ns = b.seq.copy(), b.n.copy()
+            cores = b.core.copy()
+            ampl_var = b.ampl_var.astype(float)
+            phase_var = b.phase_var.astype(float)
+            keep = ring.intact(b) & (cores < N_CORES)
+            if recorder:
+                recorder.append(REC_VARIANCE, t_us=rx_us[keep], seq=seqs[keep], core=cores[keep],
+                                n=ns[keep], ampl_var=ampl_var[keep], phase_var=phase_var[keep])
+            rx = rx_us / 1e6
+            rx, cores = rx[keep].tolist(), cores[keep].tolist()
+            ampl_var, phase_var = ampl_var[keep].tolist(), phase_var[keep].tolist()
+            with lock:
+                for i in range(len(rx)):
+                    core_ampl_var[cores[i]].append((rx[i], ampl_var[i]))
+                    core_phase_var[cores[i]].append((rx[i], phase_var[i]))
+
+        b = ring.read(FRAMES)
+        if b is not None:
+            idle = False
+            # Whole batch at once
+            raw = b.csi.copy()
+            rx_us, ts_us = b.rx_us.copy(), b.ts_us.copy()
+            seqs, streams = b.seq.copy(), b.stream.copy()
+            cores = b.core.copy()
+            keep = ring.intact(b) & (cores < N_CORES)
+            raw, rx_us, cores = raw[keep], rx_us[keep], cores[keep]
+            if recorder:
+                recorder.append(REC_FRAMES, t_us=rx_us, ts_us=ts_us[keep], seq=seqs[keep],
+                                core=cores, stream=streams[keep], csi=raw)
+            csi = np.fft.fftshift(raw.astype(np.complex128), axes=1)
+            rx = rx_us / 1e6
+
+            mags = np.abs(csi)
+            nonzero = np.count_nonzero(mags, axis=1)
+            avgs = np.where(nonzero > 0, mags.sum(axis=1) / np.maximum(nonzero, 1), 0.0)
+            phase = np.unwrap(np.angle(csi), axis=1)
+            coeffs = np.polyfit(k, phase.T, 1) if len(phase) else np.zeros((2, 0))
+            resid = phase - (np.outer(coeffs[0], k) + coeffs[1][:, None])
+            stds = resid.std(axis=1)
+
+            rx, avgs, stds = rx.tolist(), avgs.tolist(), stds.tolist()
+            feats = np.zeros((len(rx), 4))     # ampl_ma, phase_ma, phase_deriv, iat_ms
+            for i in range(len(rx)):
+                now, avg, std = rx[i], avgs[i], stds[i]
+                instant_iat_ms = (now - last_recv_time) * 1000.0
+                last_recv_time = now
+                moving_amp.append(avg)
+                moving_phase.append(std)
+                avg_ma = np.mean(moving_amp)
+                std_ma = np.mean(moving_phase)
+                with lock:
+                    phase_deriv = 0
+                    if phase_data:
+                        dt_phase = now - phase_data[-1][0]
+                        if dt_phase > 0:
+                            phase_deriv = (std - phase_data[-1][1]) / dt_phase
+                    iat_instant_data.append((now, instant_iat_ms))
+                    ampl_data.append((now, avg))
+                    phase_data.append((now, std))
+                    ampl_ma_data.append((now, avg_ma))
+                    phase_ma_data.append((now, std_ma))
+                    phase_deriv_data.append((now, phase_deriv))
+                    core_ampl_frames[cores[i]] = mags[i]
+                    core_phase_frames[cores[i]] = resid[i]
+                    last_ampl_frame = mags[i]
+                    last_phase_frame = resid[i]
+                if recorder:
+                    feats[i] = (avg_ma, std_ma, phase_deriv, instant_iat_ms)
+                else:
+                    log_data("CSI", avg, std, avg_ma, std_ma, phase_deriv,
+                             iat_ms=instant_iat_ms, ampl_sc=mags[i], phase_sc=resid[i])
+            if recorder and len(rx):
+                recorder.append(REC_FEATURES, t_us=rx_us, core=cores, ampl_mean=avgs,
+                                phase_std=stds, ampl_ma=feats[:, 0], phase_ma=feats[:, 1],
+                                phase_deriv=feats[:, 2], iat_ms=feats[:, 3])
+
+        if idle:
+            time.sleep(0.001)
+
 # ===== Queue Receiver (TCP) =====
 def parse_queue_data(line):
     try:
@@ -268,7 +470,12 @@ def queue_receiver():
                     with lock:
                         backlog_data.append((now, fq))
                         snr_data.append((now, snr_val))
-                    log_data("QUEUE", snr=snr_val, backlog=fq)
+                    if recorder:
+                        recorder.append_row(REC_QUEUE, t_us=int(now * 1e6), ts_us=0,
+                                            backlog=fq, qlen=0, drops=0, rssi=0, noise=0,
+                                            snr=snr_val)
+                    else:
+                        log_data("QUEUE", snr=snr_val, backlog=fq)
         except Exception as e:
             print(f"[Queue] Error: {e}")
             break
@@ -436,10 +643,14 @@ def update(frame):
     return artists_to_return
 
 # ===== Start Threads and Animation (1ms Interval) =====
-threading.Thread(target=csi_receiver, daemon=True).start()
-threading.Thread(target=queue_receiver, daemon=True).start()
+threading.Thread(target=ring_receiver if CSI_SOURCE == "RING" else csi_receiver,
+                 daemon=True).start()
+if LEGACY_QUEUE_FEED:
+    threading.Thread(target=queue_receiver, daemon=True).start()
 
 # Setting interval to 1ms for near instantaneous updates
 ani = FuncAnimation(fig, update, interval=1, blit=False) 
 plt.tight_layout()
-plt.show()
\ No newline at end of file
+plt.show()
+if recorder:
+    recorder.close()
\ No newline at end of file